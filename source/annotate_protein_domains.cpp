@@ -2,8 +2,10 @@
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "common.hpp"
+#include "sample_log.hpp"
 #include "annotation.hpp"
 #include "assembly.hpp"
 #include "read_compressed_file.hpp"
@@ -16,7 +18,7 @@ bool get_gff3_attribute(const string& attributes, const string& attribute_name,
 	// find start of attribute
 	size_t start = attributes.find(attribute_name + "=");
 	if (start >= attributes.size()) {
-		cerr << "WARNING: failed to extract " << attribute_name << " from line in GFF3 file: " << attributes << endl;
+		print_warning("failed to extract " + attribute_name + " from line in GFF3 file: " + attributes);
 		return false;
 	}
 	start += attribute_name.size() + 1; // move to position after "="
@@ -30,7 +32,7 @@ bool get_gff3_attribute(const string& attributes, const string& attribute_name,
 	return true;
 }
 
-void load_protein_domains(const string& filename, const contigs_t& contigs, const gene_annotation_t& gene_annotation, const unordered_map<string,gene_t>& gene_names, protein_domain_annotation_t& protein_domain_annotation, protein_domain_annotation_index_t& protein_domain_annotation_index) {
+void load_protein_domains(const string& filename, const contigs_t& contigs, const gene_annotation_t& gene_annotation, const unordered_map<string,gene_t>& gene_names, const unordered_set<gene_t>* genes_of_interest, protein_domain_annotation_t& protein_domain_annotation, protein_domain_annotation_index_t& protein_domain_annotation_index) {
 
 	// make a map of gene id -> gene
 	unordered_map<string,gene_t> gene_ids;
@@ -41,6 +43,7 @@ void load_protein_domains(const string& filename, const contigs_t& contigs, cons
 	autodecompress_file_t gff3_file(filename);
 	string line;
 	set<string> unknown_genes;
+	bool parsed_any_line = false;
 	while (gff3_file.getline(line)) {
 		if (!line.empty() && line[0] != '#') { // skip comment lines
 
@@ -51,7 +54,7 @@ void load_protein_domains(const string& filename, const contigs_t& contigs, cons
 			// parse line
 			tsv >> contig >> trash >> trash >> protein_domain.start >> protein_domain.end >> trash >> strand >> trash >> attributes;
 			if (tsv.fail() || contig.empty() || strand.empty() || attributes.empty()) {
-				cerr << "WARNING: failed to parse line in GFF3 file: " << line << endl;
+				print_warning("failed to parse line in GFF3 file: " + line);
 				continue;
 			}
 
@@ -60,11 +63,33 @@ void load_protein_domains(const string& filename, const contigs_t& contigs, cons
 			    !get_gff3_attribute(attributes, "gene_id", gene_id) ||
 			    !get_gff3_attribute(attributes, "Name", protein_domain.name))
 				continue;
+			parsed_any_line = true;
+
+			// map protein domain to gene by gene ID or name
+			auto find_gene_by_id = gene_ids.find(strip_ensembl_version_number(gene_id));
+			if (find_gene_by_id == gene_ids.end()) {
+				auto find_gene_by_name = gene_names.find(gene_name);
+				if (find_gene_by_name == gene_names.end()) {
+					if (unknown_genes.find(gene_name + " " + gene_id) == unknown_genes.end()) {
+						print_warning("unknown gene: " + gene_name + " " + gene_id);
+						unknown_genes.insert(gene_name + " " + gene_id); // report an unknown gene only once
+					}
+					continue;
+				} else {
+					protein_domain.gene = find_gene_by_name->second;
+				}
+			} else {
+				protein_domain.gene = find_gene_by_id->second;
+			}
+
+			// skip domains of genes which are not needed
+			if (genes_of_interest != NULL && genes_of_interest->find(protein_domain.gene) == genes_of_interest->end())
+				continue;
 
 			// convert string representation of contig to numeric ID
 			contigs_t::const_iterator find_contig_by_name = contigs.find(removeChr(contig));
 			if (find_contig_by_name == contigs.end()) {
-				cerr << "WARNING: unknown contig: " << contig << endl;
+				print_warning("unknown contig: " + contig);
 				continue;
 			}
 
@@ -88,23 +113,6 @@ void load_protein_domains(const string& filename, const contigs_t& contigs, cons
 				if (protein_domain.name[pos] < '!' || protein_domain.name[pos] > '~' || protein_domain.name[pos] == ',' || protein_domain.name[pos] == '|')
 					protein_domain.name[pos] = '_';
 
-			// map protein domain to gene by gene ID or name
-			auto find_gene_by_id = gene_ids.find(strip_ensembl_version_number(gene_id));
-			if (find_gene_by_id == gene_ids.end()) {
-				auto find_gene_by_name = gene_names.find(gene_name);
-				if (find_gene_by_name == gene_names.end()) {
-					if (unknown_genes.find(gene_name + " " + gene_id) == unknown_genes.end()) {
-						cerr << "WARNING: unknown gene: " << gene_name << " " << gene_id << endl;
-						unknown_genes.insert(gene_name + " " + gene_id); // report an unknown gene only once
-					}
-					continue;
-				} else {
-					protein_domain.gene = find_gene_by_name->second;
-				}
-			} else {
-				protein_domain.gene = find_gene_by_id->second;
-			}
-
 			// make annotation record
 			protein_domain.contig = find_contig_by_name->second;
 			protein_domain.start--; // GFF3 files are one-based
@@ -114,9 +122,12 @@ void load_protein_domains(const string& filename, const contigs_t& contigs, cons
 		}
 	}
 
-	crash(protein_domain_annotation.empty(), "failed to parse GFF3 file");
+	crash((genes_of_interest == NULL) ? protein_domain_annotation.empty() : !parsed_any_line, "failed to parse GFF3 file");
 
 	// index domains by coordinate
+	// (when only few domains are loaded, there may be fewer domains than contigs)
+	if (protein_domain_annotation_index.size() < contigs.size())
+		protein_domain_annotation_index.resize(contigs.size());
 	make_annotation_index(protein_domain_annotation, protein_domain_annotation_index);
 }
 
@@ -204,7 +215,7 @@ void translate_reference_protein(const exon_t exon_with_start_codon, const assem
 				reference_protein[position] = dna_to_protein(codon);
 				codon.clear();
 				if (!already_reported_annotation_error && position < exon->coding_region_end && position > exon->coding_region_start && reference_protein[position] == '*') {
-					cerr << "WARNING: encountered early stop codon in transcript " << exon->transcript->name << " at amino acid " << reference_protein.size() << " (error in GTF file?) => predicted peptide sequence may be wrong" << endl;
+					print_warning("encountered early stop codon in transcript " + exon->transcript->name + " at amino acid " + to_string(static_cast<long long unsigned int>(reference_protein.size())) + " (error in GTF file?) => predicted peptide sequence may be wrong");
 					already_reported_annotation_error = true;
 				}
 			}
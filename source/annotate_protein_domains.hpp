@@ -3,8 +3,8 @@
 
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
-#include <unordered_map>
 #include "common.hpp"
 
 using namespace std;
@@ -18,7 +18,8 @@ typedef protein_domain_annotation_record_t* protein_domain_t;
 typedef contig_annotation_index_t<protein_domain_t> protein_domain_contig_annotation_index_t;
 typedef annotation_index_t<protein_domain_t> protein_domain_annotation_index_t;
 
-void load_protein_domains(const string& filename, const contigs_t& contigs, const gene_annotation_t& gene_annotation, const unordered_map<string,gene_t>& gene_names, protein_domain_annotation_t& protein_domain_annotation, protein_domain_annotation_index_t& protein_domain_annotation_index);
+// when genes_of_interest is not NULL, only the protein domains of the given genes are loaded
+void load_protein_domains(const string& filename, const contigs_t& contigs, const gene_annotation_t& gene_annotation, const unordered_map<string,gene_t>& gene_names, const unordered_set<gene_t>* genes_of_interest, protein_domain_annotation_t& protein_domain_annotation, protein_domain_annotation_index_t& protein_domain_annotation_index);
 
 string annotate_retained_protein_domains(const contig_t contig, const position_t breakpoint, const strand_t predicted_strand, const bool predicted_strand_ambiguous, const gene_t gene, const direction_t direction, const protein_domain_annotation_index_t& protein_domain_annotation_index);
 
@@ -10,7 +10,7 @@
 
 using namespace std;
 
-typedef unordered_map< genome_bin_t, vector< tuple<blacklist_item_t,blacklist_item_t,string> > > tags_t;
+typedef indexed_rules_t< tuple<blacklist_item_t,blacklist_item_t,string> > tags_t;
 
 void load_tags(const string& tags_file_path, const contigs_t& contigs, const unordered_map<string,gene_t>& genes, tags_t& tags);
 
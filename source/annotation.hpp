@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 #include "common.hpp"
+#include "operation_counters.hpp"
 
 using namespace std;
 
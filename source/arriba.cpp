@@ -1,13 +1,17 @@
 #include <algorithm>
 #include <ctime>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <stdlib.h>
 #include <string>
 #include <sys/resource.h>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "common.hpp"
 #include "annotation.hpp"
@@ -15,6 +19,7 @@
 #include "options.hpp"
 #include "read_stats.hpp"
 #include "read_chimeric_alignments.hpp"
+#include "read_breakpoint_coverage.hpp"
 #include "filter_duplicates.hpp"
 #include "filter_uninteresting_contigs.hpp"
 #include "filter_viral_contigs.hpp"
@@ -55,16 +60,12 @@
 #include "annotate_tags.hpp"
 #include "annotate_protein_domains.hpp"
 #include "output_fusions.hpp"
+#include "serve_jobs.hpp"
+#include "stage_metrics.hpp"
+#include "sample_log.hpp"
 
 using namespace std;
 
-string get_time_string() {
-	time_t now = time(0);
-	char buffer[100];
-	strftime(buffer, sizeof(buffer), "[%Y-%m-%dT%X]", localtime(&now));
-	return buffer;
-}
-
 string get_hhmmss_string(unsigned long long seconds) {
 	ostringstream oss;
 	oss << setfill('0');
@@ -76,58 +77,128 @@ string get_hhmmss_string(unsigned long long seconds) {
 	return oss.str();
 }
 
-int main(int argc, char **argv) {
-
-	// measure elapsed time
-	time_t start_time;
-	time(&start_time);
-	cout << get_time_string() << " Launching Arriba " << ARRIBA_VERSION << endl << flush;
-
-	{ // the runtime of everything in this block is measured
+// references which are loaded once and shared by all samples
+// they must not be modified while samples are processed, because samples may be processed concurrently in batch mode
+struct references_t {
+	contigs_t contigs;
+	vector<string> original_contig_names; // "chr" prefix is removed from contig names to ensure compatibility between assembly and annotation; this vector stores the original names
+	assembly_t assembly;
+	gene_annotation_t gene_annotation;
+	transcript_annotation_t transcript_annotation;
+	exon_annotation_t exon_annotation;
+	unordered_map<string,gene_t> gene_names;
+	exon_annotation_index_t exon_annotation_index;
+	gene_annotation_index_t gene_annotation_index;
+	blacklist_t blacklist;
+	known_fusions_t known_fusions;
+	tags_t tags;
+	protein_domain_annotation_t protein_domain_annotation;
+	protein_domain_annotation_index_t protein_domain_annotation_index;
+};
 
-	// parse command-line options
-	options_t options = parse_arguments(argc, argv);
+void load_references(const options_t& options, references_t& references, stage_metrics_t& metrics) {
 
 	// load sequences of contigs from assembly
-	if (!options.filters.at("uninteresting_contigs"))
-		options.interesting_contigs = "*"; // load all contigs when the filter is disabled
-	contigs_t contigs;
-	vector<string> original_contig_names; // "chr" prefix is removed from contig names to ensure compatibility between assembly and annotation; this vector stores the original names
 	cout << get_time_string() << " Loading assembly from '" << options.assembly_file << "' " << endl;
-	assembly_t assembly;
-	load_assembly(assembly, options.assembly_file, contigs, original_contig_names, options.interesting_contigs);
+	load_assembly(references.assembly, options.assembly_file, options.assembly_cache_file, references.contigs, references.original_contig_names, options.interesting_contigs);
+	metrics.record("load_assembly");
 
 	// load GTF file
 	// must be loaded after assembly to check if genes exceed the boundaries of contigs
 	cout << get_time_string() << " Loading annotation from '" << options.gene_annotation_file << "' " << endl << flush;
-	gene_annotation_t gene_annotation;
-	transcript_annotation_t transcript_annotation;
-	exon_annotation_t exon_annotation;
-	unordered_map<string,gene_t> gene_names;
-	read_annotation_gtf(options.gene_annotation_file, options.gtf_features, contigs, original_contig_names, assembly, gene_annotation, transcript_annotation, exon_annotation, gene_names);
+	read_annotation_gtf(options.gene_annotation_file, options.gtf_features, references.contigs, references.original_contig_names, references.assembly, references.gene_annotation, references.transcript_annotation, references.exon_annotation, references.gene_names);
 
 	// sort genes and exons by coordinate (make index)
-	exon_annotation_index_t exon_annotation_index;
-	make_annotation_index(exon_annotation, exon_annotation_index);
-	gene_annotation_index_t gene_annotation_index;
-	make_annotation_index(gene_annotation, gene_annotation_index);
+	make_annotation_index(references.exon_annotation, references.exon_annotation_index);
+	make_annotation_index(references.gene_annotation, references.gene_annotation_index);
 
-	// prevent htslib from downloading the assembly via the Internet, if CRAM is used
-	setenv("REF_PATH", ".", 0);
+	// calculate sum of the lengths of all exons for each gene
+	// we will need this to normalize the number of events over the gene length
+	for (exon_annotation_index_t::iterator contig = references.exon_annotation_index.begin(); contig != references.exon_annotation_index.end(); ++contig) {
+		position_t region_start = 0;
+		for (exon_contig_annotation_index_t::iterator region = contig->begin(); region != contig->end(); ++region) {
+			gene_t previous_gene = NULL;
+			for (exon_set_t::iterator overlapping_exon = region->second.begin(); overlapping_exon != region->second.end(); ++overlapping_exon) {
+				gene_t& current_gene = (**overlapping_exon).gene;
+				if (previous_gene != current_gene) {
+					current_gene->exonic_length += region->first - region_start;
+					previous_gene = current_gene;
+				}
+			}
+			region_start = region->first;
+		}
+	}
+	for (gene_annotation_t::iterator gene = references.gene_annotation.begin(); gene != references.gene_annotation.end(); ++gene)
+		if (gene->exonic_length == 0)
+			gene->exonic_length = gene->end - gene->start; // use total gene length, if the gene has no exons
+
+
+	// assign IDs to genes
+	// this is necessary for deterministic behavior, because fusions are hashed by genes
+	unsigned int gene_id = 0;
+	for (gene_annotation_t::iterator gene = references.gene_annotation.begin(); gene != references.gene_annotation.end(); ++gene)
+		gene->id = gene_id++;
+	metrics.record("load_annotation");
+
+	if (options.filters.at("blacklist") && !options.blacklist_file.empty()) {
+		cout << get_time_string() << " Loading blacklist from '" << options.blacklist_file << "'" << endl;
+		load_blacklist(options.blacklist_file, references.contigs, references.gene_names, references.blacklist);
+		metrics.record("load_blacklist");
+	}
+
+	if (!options.known_fusions_file.empty() && options.filters.at("known_fusions")) {
+		cout << get_time_string() << " Loading known fusions from '" << options.known_fusions_file << "'" << endl;
+		load_known_fusions(options.known_fusions_file, references.contigs, references.gene_names, references.known_fusions);
+		metrics.record("load_known_fusions");
+	}
+
+	if (!options.tags_file.empty()) {
+		cout << get_time_string() << " Loading tags from '" << options.tags_file << "'" << endl;
+		load_tags(options.tags_file, references.contigs, references.gene_names, references.tags);
+		metrics.record("load_tags");
+	}
+
+	// protein domains are only needed for the genes of the reported fusions
+	// => in the case of a single sample, they are loaded after the fusions are known (see process_sample())
+	if (!options.protein_domains_file.empty() && (!options.server_socket.empty() || !options.batch_samples.empty())) {
+		cout << get_time_string() << " Loading protein domains from '" << options.protein_domains_file << "'" << endl;
+		load_protein_domains(options.protein_domains_file, references.contigs, references.gene_annotation, references.gene_names, NULL, references.protein_domain_annotation, references.protein_domain_annotation_index);
+		metrics.record("load_protein_domains");
+	}
+}
+
+// the metrics of loading the references are prepended to the metrics of the sample, if given
+void process_sample(const options_t& options, const references_t& references, ostream& log, const stage_metrics_t* loading_metrics = NULL) {
+
+	count_operations_of_sample(); // samples processed concurrently must not count each other's operations
+	stage_metrics_t metrics;
+
+	// the BAM files may add contigs which are not in the assembly => every sample needs its own copy of the contigs
+	contigs_t contigs = references.contigs;
+	vector<string> original_contig_names = references.original_contig_names;
+	// every sample needs its own copy of the gene annotation index, because dummy genes are added to it
+	gene_annotation_index_t gene_annotation_index = references.gene_annotation_index;
+	const assembly_t& assembly = references.assembly;
 
 	// load chimeric alignments
 	chimeric_alignments_t chimeric_alignments;
 	unsigned long int mapped_reads = 0;
 	vector<unsigned long int> mapped_viral_reads_by_contig;
-	coverage_t coverage;
+	// when the coverage is computed around breakpoints later, only viral contigs need genome-wide coverage
+	coverage_t coverage(options.coverage_resolution, (options.breakpoint_coverage) ? options.viral_contigs : "");
 	if (!options.chimeric_bam_file.empty()) { // when STAR was run with --chimOutType SeparateSAMold, chimeric alignments must be read from a separate file named Chimeric.out.sam
-		cout << get_time_string() << " Reading chimeric alignments from '" << options.chimeric_bam_file << "' " << flush;
-		cout << "(total=" << read_chimeric_alignments(options.chimeric_bam_file, assembly, options.assembly_file, chimeric_alignments, mapped_reads, mapped_viral_reads_by_contig, coverage, contigs, original_contig_names, options.interesting_contigs, options.viral_contigs, gene_annotation_index, true, false, options.external_duplicate_marking, options.max_itd_length) << ")" << endl;
+		log << get_time_string() << " Reading chimeric alignments from '" << options.chimeric_bam_file << "' " << flush;
+		log << "(total=" << read_chimeric_alignments(options.chimeric_bam_file, assembly, options.assembly_file, chimeric_alignments, mapped_reads, mapped_viral_reads_by_contig, coverage, contigs, original_contig_names, options.interesting_contigs, options.viral_contigs, gene_annotation_index, true, false, options.external_duplicate_marking, options.max_itd_length, options.collation_memory_limit) << ")" << endl;
+		metrics.record("reading_chimeric_alignments");
 	}
 
 	// extract chimeric alignments and read-through alignments from Aligned.out.bam
-	cout << get_time_string() << " Reading chimeric alignments from '" << options.rna_bam_file << "' " << flush;
-	cout << "(total=" << read_chimeric_alignments(options.rna_bam_file, assembly, options.assembly_file, chimeric_alignments, mapped_reads, mapped_viral_reads_by_contig, coverage, contigs, original_contig_names, options.interesting_contigs, options.viral_contigs, gene_annotation_index, !options.chimeric_bam_file.empty(), true, options.external_duplicate_marking, options.max_itd_length) << ")" << endl;
+	log << get_time_string() << " Reading chimeric alignments from '" << options.rna_bam_file << "' " << flush;
+	log << "(total=" << metrics.record_reads("reading_alignments", read_chimeric_alignments(options.rna_bam_file, assembly, options.assembly_file, chimeric_alignments, mapped_reads, mapped_viral_reads_by_contig, coverage, contigs, original_contig_names, options.interesting_contigs, options.viral_contigs, gene_annotation_index, !options.chimeric_bam_file.empty(), true, options.external_duplicate_marking, options.max_itd_length, options.collation_memory_limit)) << ")" << endl;
+
+	// compute coverage from the changes recorded while reading the alignments
+	coverage.finalize(options.threads);
+	metrics.record("coverage");
 
 	// convert viral contigs to vector of booleans for faster lookup
 	vector<bool> viral_contigs(contigs.size());
@@ -139,50 +210,39 @@ int main(int argc, char **argv) {
 		interesting_contigs[contig->second] = is_interesting_contig(contig->first, options.interesting_contigs);
 
 	// mark multi-mapping alignments
-	cout << get_time_string() << " Marking multi-mapping alignments " << flush;
-	cout << "(marked=" << mark_multimappers(chimeric_alignments) << ")" << endl;
+	log << get_time_string() << " Marking multi-mapping alignments " << flush;
+	log << "(marked=" << mark_multimappers(chimeric_alignments) << ")" << endl;
+	metrics.record("multimappers_marking");
 
 	// the BAM files may have added some contigs which were not in the GTF file
 	// => add empty indices for the new contigs so that lookups of these contigs won't cause array-out-of-bounds exceptions
-	gene_annotation_index.resize(contigs.size());
-	exon_annotation_index.resize(contigs.size());
+	// the shared exon index is usually large enough already, so it only needs to be copied in rare cases
+	if (gene_annotation_index.size() < contigs.size())
+		gene_annotation_index.resize(contigs.size());
+	exon_annotation_index_t extended_exon_annotation_index;
+	if (references.exon_annotation_index.size() < contigs.size()) {
+		extended_exon_annotation_index = references.exon_annotation_index;
+		extended_exon_annotation_index.resize(contigs.size());
+	}
+	const exon_annotation_index_t& exon_annotation_index = (extended_exon_annotation_index.empty()) ? references.exon_annotation_index : extended_exon_annotation_index;
 
 	strandedness_t strandedness = options.strandedness;
 	if (options.strandedness == STRANDEDNESS_AUTO) {
-		cout << get_time_string() << " Detecting strandedness " << flush;
+		log << get_time_string() << " Detecting strandedness " << flush;
 		strandedness = detect_strandedness(chimeric_alignments, gene_annotation_index, exon_annotation_index);
 		switch (strandedness) {
-			case STRANDEDNESS_YES: cout << "(yes)" << endl; break;
-			case STRANDEDNESS_REVERSE: cout << "(reverse)" << endl; break;
-			default: cout << "(no)" << endl;
+			case STRANDEDNESS_YES: log << "(yes)" << endl; break;
+			case STRANDEDNESS_REVERSE: log << "(reverse)" << endl; break;
+			default: log << "(no)" << endl;
 		}
+		metrics.record("strandedness");
 	}
 	if (strandedness != STRANDEDNESS_NO) {
-		cout << get_time_string() << " Assigning strands to alignments " << endl << flush;
+		log << get_time_string() << " Assigning strands to alignments " << endl << flush;
 		assign_strands_from_strandedness(chimeric_alignments, strandedness);
 	}
 
-	cout << get_time_string() << " Annotating alignments " << flush << endl;
-	// calculate sum of the lengths of all exons for each gene
-	// we will need this to normalize the number of events over the gene length
-	for (exon_annotation_index_t::iterator contig = exon_annotation_index.begin(); contig != exon_annotation_index.end(); ++contig) {
-		position_t region_start = 0;
-		for (exon_contig_annotation_index_t::iterator region = contig->begin(); region != contig->end(); ++region) {
-			gene_t previous_gene = NULL;
-			for (exon_set_t::iterator overlapping_exon = region->second.begin(); overlapping_exon != region->second.end(); ++overlapping_exon) {
-				gene_t& current_gene = (**overlapping_exon).gene;
-				if (previous_gene != current_gene) {
-					current_gene->exonic_length += region->first - region_start;
-					previous_gene = current_gene;
-				}
-			}
-			region_start = region->first;
-		}
-	}
-	for (gene_annotation_t::iterator gene = gene_annotation.begin(); gene != gene_annotation.end(); ++gene)
-		if (gene->exonic_length == 0)
-			gene->exonic_length = gene->end - gene->start; // use total gene length, if the gene has no exons
-
+	log << get_time_string() << " Annotating alignments " << flush << endl;
 	// first, try to annotate with exons
 	for (chimeric_alignments_t::iterator mates = chimeric_alignments.begin(); mates != chimeric_alignments.end(); ++mates)
 		annotate_alignments(mates->second, exon_annotation_index);
@@ -205,6 +265,8 @@ int main(int argc, char **argv) {
 	}
 
 	// if the alignment maps neither to an exon nor to a gene, make a dummy gene which subsumes all alignments with a distance of 10kb
+	// dummy genes are kept separate from the shared gene annotation, because they are specific to the sample
+	gene_annotation_t dummy_genes;
 	gene_annotation_t unmapped_alignments;
 	for (chimeric_alignments_t::iterator chimeric_alignment = chimeric_alignments.begin(); chimeric_alignment != chimeric_alignments.end(); ++chimeric_alignment) {
 		gene_annotation_record_t gene_annotation_record;
@@ -246,7 +308,7 @@ int main(int argc, char **argv) {
 			    gene_annotation_record.end+10000 < unmapped_alignment->start || // current alignment is too far away
 			    (next_known_gene != gene_annotation_index[gene_annotation_record.contig].end() && next_known_gene->first <= unmapped_alignment->start) || // dummy gene must not overlap known genes
 			    unmapped_alignment->contig != gene_annotation_record.contig) { // end of contig reached
-				gene_annotation.push_back(gene_annotation_record);
+				dummy_genes.push_back(gene_annotation_record);
 				if (unmapped_alignment != unmapped_alignments.end()) {
 					gene_annotation_record.contig = unmapped_alignment->contig;
 					gene_annotation_record.start = unmapped_alignment->start;
@@ -260,8 +322,7 @@ int main(int argc, char **argv) {
 	}
 
 	// map yet unmapped alignments to the newly created dummy genes
-	gene_annotation_index.clear();
-	make_annotation_index(gene_annotation, gene_annotation_index); // index needs to be regenerated after adding dummy genes
+	make_annotation_index(dummy_genes, gene_annotation_index); // dummy genes need to be added to the index
 	for (chimeric_alignments_t::iterator chimeric_alignment = chimeric_alignments.begin(); chimeric_alignment != chimeric_alignments.end(); ++chimeric_alignment) {
 		if (chimeric_alignment->second.size() == 3) { // split read
 			if (chimeric_alignment->second[MATE1].genes.empty() || chimeric_alignment->second[SPLIT_READ].genes.empty()) {
@@ -318,163 +379,174 @@ int main(int argc, char **argv) {
 		}
 	}
 
-	// assign IDs to genes
+	// assign IDs to dummy genes following the IDs of the annotated genes
 	// this is necessary for deterministic behavior, because fusions are hashed by genes
-	unsigned int gene_id = 0;
-	for (gene_annotation_t::iterator gene = gene_annotation.begin(); gene != gene_annotation.end(); ++gene)
+	unsigned int gene_id = references.gene_annotation.size();
+	for (gene_annotation_t::iterator gene = dummy_genes.begin(); gene != dummy_genes.end(); ++gene)
 		gene->id = gene_id++;
+	metrics.record("alignment_annotation");
 
 	if (options.filters.at("duplicates")) {
-		cout << get_time_string() << " Filtering duplicates " << flush;
-		cout << "(remaining=" << filter_duplicates(chimeric_alignments, options.external_duplicate_marking) << ")" << endl;
+		log << get_time_string() << " Filtering duplicates " << flush;
+		log << "(remaining=" << metrics.record_reads("duplicates", filter_duplicates(chimeric_alignments, options.external_duplicate_marking)) << ")" << endl;
 	}
 
 	if (options.filters.at("uninteresting_contigs")) {
-		cout << get_time_string() << " Filtering mates which do not map to interesting contigs (" << options.interesting_contigs << ") " << flush;
-		cout << "(remaining=" << filter_uninteresting_contigs(chimeric_alignments, interesting_contigs) << ")" << endl;
+		log << get_time_string() << " Filtering mates which do not map to interesting contigs (" << options.interesting_contigs << ") " << flush;
+		log << "(remaining=" << metrics.record_reads("uninteresting_contigs", filter_uninteresting_contigs(chimeric_alignments, interesting_contigs)) << ")" << endl;
 	}
 
 	if (options.filters.at("viral_contigs")) {
-		cout << get_time_string() << " Filtering mates which only map to viral contigs (" << options.viral_contigs << ") " << flush;
-		cout << "(remaining=" << filter_viral_contigs(chimeric_alignments, viral_contigs) << ")" << endl;
+		log << get_time_string() << " Filtering mates which only map to viral contigs (" << options.viral_contigs << ") " << flush;
+		log << "(remaining=" << metrics.record_reads("viral_contigs", filter_viral_contigs(chimeric_alignments, viral_contigs)) << ")" << endl;
 	}
 
 	if (options.filters.at("top_expressed_viral_contigs")) {
-		cout << get_time_string() << " Filtering viral contigs with expression lower than the top " << options.top_viral_contigs << " " << flush;
-		cout << "(remaining=" << filter_top_expressed_viral_contigs(chimeric_alignments, options.top_viral_contigs, viral_contigs, interesting_contigs, mapped_viral_reads_by_contig, assembly) << ")" << endl;
+		log << get_time_string() << " Filtering viral contigs with expression lower than the top " << options.top_viral_contigs << " " << flush;
+		log << "(remaining=" << metrics.record_reads("top_expressed_viral_contigs", filter_top_expressed_viral_contigs(chimeric_alignments, options.top_viral_contigs, viral_contigs, interesting_contigs, mapped_viral_reads_by_contig, assembly)) << ")" << endl;
 	}
 
 	if (options.filters.at("low_coverage_viral_contigs")) {
-		cout << get_time_string() << " Filtering viral contigs with less than " << (options.viral_contig_min_covered_fraction*100) << "% coverage " << flush;
-		cout << "(remaining=" << filter_low_coverage_viral_contigs(chimeric_alignments, coverage, viral_contigs, options.viral_contig_min_covered_fraction, 100) << ")" << endl;
+		log << get_time_string() << " Filtering viral contigs with less than " << (options.viral_contig_min_covered_fraction*100) << "% coverage " << flush;
+		log << "(remaining=" << metrics.record_reads("low_coverage_viral_contigs", filter_low_coverage_viral_contigs(chimeric_alignments, coverage, viral_contigs, options.viral_contig_min_covered_fraction, 100)) << ")" << endl;
 	}
 
-	cout << get_time_string() << " Estimating fragment length " << flush;
+	log << get_time_string() << " Estimating fragment length " << flush;
 	int max_mate_gap;
 	float read_length_mean;
 	{
 		float mate_gap_mean, mate_gap_stddev; // these variables are declared in a subsection, because they may be undefined and should not be used elsewhere
 		if (estimate_fragment_length(chimeric_alignments, mate_gap_mean, mate_gap_stddev, read_length_mean, gene_annotation_index, exon_annotation_index)) {
-			cout << "(mate gap mean=" << mate_gap_mean << ", mate gap stddev=" << mate_gap_stddev << ", read length mean=" << read_length_mean << ")" << endl;
+			log << "(mate gap mean=" << mate_gap_mean << ", mate gap stddev=" << mate_gap_stddev << ", read length mean=" << read_length_mean << ")" << endl;
 			max_mate_gap = max(0, (int) (mate_gap_mean + 3*mate_gap_stddev));
 		} else {
 			max_mate_gap = options.fragment_length;
 			read_length_mean = options.fragment_length;
 		}
 	}
+	metrics.record("fragment_length");
 	
 	if (options.filters.at("read_through")) {
-		cout << get_time_string() << " Filtering read-through fragments with a distance <=" << options.min_read_through_distance << "bp " << flush;
-		cout << "(remaining=" << filter_proximal_read_through(chimeric_alignments, options.min_read_through_distance) << ")" << endl;
+		log << get_time_string() << " Filtering read-through fragments with a distance <=" << options.min_read_through_distance << "bp " << flush;
+		log << "(remaining=" << metrics.record_reads("read_through", filter_proximal_read_through(chimeric_alignments, options.min_read_through_distance)) << ")" << endl;
 	}
 
 	if (options.filters.at("inconsistently_clipped")) {
-		cout << get_time_string() << " Filtering inconsistently clipped mates " << flush;
-		cout << "(remaining=" << filter_inconsistently_clipped_mates(chimeric_alignments) << ")" << endl;
+		log << get_time_string() << " Filtering inconsistently clipped mates " << flush;
+		log << "(remaining=" << metrics.record_reads("inconsistently_clipped", filter_inconsistently_clipped_mates(chimeric_alignments)) << ")" << endl;
 	}
 
 	if (options.filters.at("homopolymer")) {
-		cout << get_time_string() << " Filtering breakpoints adjacent to homopolymers >=" << options.homopolymer_length << "nt " << flush;
-		cout << "(remaining=" << filter_homopolymer(chimeric_alignments, options.homopolymer_length, exon_annotation_index) << ")" << endl;
+		log << get_time_string() << " Filtering breakpoints adjacent to homopolymers >=" << options.homopolymer_length << "nt " << flush;
+		log << "(remaining=" << metrics.record_reads("homopolymer", filter_homopolymer(chimeric_alignments, options.homopolymer_length, exon_annotation_index)) << ")" << endl;
 	}
 
 	if (options.filters.at("small_insert_size")) {
-		cout << get_time_string() << " Filtering fragments with small insert size " << flush;
-		cout << "(remaining=" << filter_small_insert_size(chimeric_alignments, 5) << ")" << endl;
+		log << get_time_string() << " Filtering fragments with small insert size " << flush;
+		log << "(remaining=" << metrics.record_reads("small_insert_size", filter_small_insert_size(chimeric_alignments, 5)) << ")" << endl;
 	}
 
 	if (options.filters.at("long_gap")) {
-		cout << get_time_string() << " Filtering alignments with long gaps " << flush;
-		cout << "(remaining=" << filter_long_gap(chimeric_alignments) << ")" << endl;
+		log << get_time_string() << " Filtering alignments with long gaps " << flush;
+		log << "(remaining=" << metrics.record_reads("long_gap", filter_long_gap(chimeric_alignments)) << ")" << endl;
 	}
 
 	if (options.filters.at("same_gene")) {
-		cout << get_time_string() << " Filtering fragments with both mates in the same gene " << flush;
-		cout << "(remaining=" << filter_same_gene(chimeric_alignments, exon_annotation_index) << ")" << endl;
+		log << get_time_string() << " Filtering fragments with both mates in the same gene " << flush;
+		log << "(remaining=" << metrics.record_reads("same_gene", filter_same_gene(chimeric_alignments, exon_annotation_index)) << ")" << endl;
 	}
 
 	if (options.filters.at("hairpin")) {
-		cout << get_time_string() << " Filtering fusions arising from hairpin structures " << flush;
-		cout << "(remaining=" << filter_hairpin(chimeric_alignments, exon_annotation_index, max_mate_gap) << ")" << endl;
+		log << get_time_string() << " Filtering fusions arising from hairpin structures " << flush;
+		log << "(remaining=" << metrics.record_reads("hairpin", filter_hairpin(chimeric_alignments, exon_annotation_index, max_mate_gap)) << ")" << endl;
 	}
 
 	if (options.filters.at("mismatches")) {
-		cout << get_time_string() << " Filtering reads with a mismatch p-value <=" << options.mismatch_pvalue_cutoff << " " << flush;
-		cout << "(remaining=" << filter_mismatches(chimeric_alignments, assembly, interesting_contigs, viral_contigs, 0.01, options.mismatch_pvalue_cutoff) << ")" << endl;
+		log << get_time_string() << " Filtering reads with a mismatch p-value <=" << options.mismatch_pvalue_cutoff << " " << flush;
+		log << "(remaining=" << metrics.record_reads("mismatches", filter_mismatches(chimeric_alignments, assembly, interesting_contigs, viral_contigs, 0.01, options.mismatch_pvalue_cutoff)) << ")" << endl;
 	}
 
 	if (options.filters.at("low_entropy")) {
-		cout << get_time_string() << " Filtering reads with low entropy (k-mer content >=" << (options.max_kmer_content*100) << "%) " << flush;
-		cout << "(remaining=" << filter_low_entropy(chimeric_alignments, 3, options.max_kmer_content, options.max_itd_length) << ")" << endl;
+		log << get_time_string() << " Filtering reads with low entropy (k-mer content >=" << (options.max_kmer_content*100) << "%) " << flush;
+		log << "(remaining=" << metrics.record_reads("low_entropy", filter_low_entropy(chimeric_alignments, 3, options.max_kmer_content, options.max_itd_length)) << ")" << endl;
 	}
 
-	cout << get_time_string() << " Finding fusions and counting supporting reads " << flush;
+	log << get_time_string() << " Finding fusions and counting supporting reads " << flush;
 	fusions_t fusions;
-	cout << "(total=" << find_fusions(chimeric_alignments, fusions, exon_annotation_index, max_mate_gap, options.subsampling_threshold) << ")" << endl;
+	log << "(total=" << metrics.record_fusions("find_fusions", find_fusions(chimeric_alignments, fusions, exon_annotation_index, max_mate_gap, options.subsampling_threshold)) << ")" << endl;
 
 	if (!options.genomic_breakpoints_file.empty()) {
-		cout << get_time_string() << " Marking fusions with support from whole-genome sequencing in '" << options.genomic_breakpoints_file << "' " << flush;
-		cout << "(marked=" << mark_genomic_support(fusions, options.genomic_breakpoints_file, contigs, options.max_genomic_breakpoint_distance) << ")" << endl;
+		log << get_time_string() << " Marking fusions with support from whole-genome sequencing in '" << options.genomic_breakpoints_file << "' " << flush;
+		log << "(marked=" << mark_genomic_support(fusions, options.genomic_breakpoints_file, contigs, options.max_genomic_breakpoint_distance) << ")" << endl;
+		metrics.record("genomic_support_marking");
 	}
 
 	if (options.filters.at("merge_adjacent")) {
-		cout << get_time_string() << " Merging adjacent fusion breakpoints " << flush;
-		cout << "(remaining=" << merge_adjacent_fusions(fusions, 5, options.max_itd_length) << ")" << endl;
+		log << get_time_string() << " Merging adjacent fusion breakpoints " << flush;
+		log << "(remaining=" << metrics.record_fusions("merge_adjacent", merge_adjacent_fusions(fusions, 5, options.max_itd_length)) << ")" << endl;
 	}
 
 	// this step must come before the e-value calculation, or else multi-mapping reads are counted redundantly
 	if (options.filters.at("multimappers")) {
-		cout << get_time_string() << " Filtering multi-mapping fusions by alignment score and read support " << flush;
-		cout << "(remaining=" << filter_multimappers(chimeric_alignments, fusions, exon_annotation_index, assembly) << ")" << endl;
+		log << get_time_string() << " Filtering multi-mapping fusions by alignment score and read support " << flush;
+		log << "(remaining=" << metrics.record_fusions("multimappers", filter_multimappers(chimeric_alignments, fusions, exon_annotation_index, assembly)) << ")" << endl;
+	}
+
+	// this step must come after the 'merge_adjacent' filter, because merging moves breakpoints
+	if (options.breakpoint_coverage) {
+		log << get_time_string() << " Computing coverage around breakpoints from '" << options.rna_bam_file << "' " << flush;
+		log << "(regions=" << read_breakpoint_coverage(fusions, options.rna_bam_file, options.assembly_file, contigs, assembly, chimeric_alignments, options.external_duplicate_marking, options.threads, coverage) << ")" << endl;
+		metrics.record("breakpoint_coverage");
 	}
 
 	// this step must come after the 'merge_adjacent' filter,
 	// because STAR clips reads supporting the same breakpoints at different position
 	// and that spreads the supporting reads over multiple breakpoints
-	cout << get_time_string() << " Estimating expected number of fusions by random chance (e-value) " << endl << flush;
+	log << get_time_string() << " Estimating expected number of fusions by random chance (e-value) " << endl << flush;
 	estimate_expected_fusions(fusions, mapped_reads, exon_annotation_index);
+	metrics.record("evalue");
 
 	// this step must come before all filters that are potentially undone by the 'genomic_support' filter
 	if (options.filters.at("non_coding_neighbors")) {
-		cout << get_time_string() << " Filtering fusions with both breakpoints in adjacent non-coding/intergenic regions " << flush;
-		cout << "(remaining=" << filter_non_coding_neighbors(fusions) << ")" << endl;
+		log << get_time_string() << " Filtering fusions with both breakpoints in adjacent non-coding/intergenic regions " << flush;
+		log << "(remaining=" << metrics.record_fusions("non_coding_neighbors", filter_non_coding_neighbors(fusions)) << ")" << endl;
 	}
 
 	// this step must come before all filters that are potentially undone by the 'genomic_support' filter
 	if (options.filters.at("intragenic_exonic")) {
-		cout << get_time_string() << " Filtering intragenic fusions with both breakpoints in exonic regions " << flush;
-		cout << "(remaining=" << filter_intragenic_both_exonic(fusions, exon_annotation_index, options.exonic_fraction) << ")" << endl;
+		log << get_time_string() << " Filtering intragenic fusions with both breakpoints in exonic regions " << flush;
+		log << "(remaining=" << metrics.record_fusions("intragenic_exonic", filter_intragenic_both_exonic(fusions, exon_annotation_index, options.exonic_fraction)) << ")" << endl;
 	}
 
 	// this step must come after e-value calculation,
 	// because fusions with few supporting reads heavily influence the e-value
 	// it must come before all filters that are potentially undone by the 'genomic_support' filter
 	if (options.filters.at("min_support")) {
-		cout << get_time_string() << " Filtering fusions with <" << options.min_support << " supporting reads " << flush;
-		cout << "(remaining=" << filter_min_support(fusions, options.min_support) << ")" << endl;
+		log << get_time_string() << " Filtering fusions with <" << options.min_support << " supporting reads " << flush;
+		log << "(remaining=" << metrics.record_fusions("min_support", filter_min_support(fusions, options.min_support)) << ")" << endl;
 	}
 
 	if (options.filters.at("relative_support")) {
-		cout << get_time_string() << " Filtering fusions with an e-value >=" << options.evalue_cutoff << " " << flush;
-		cout << "(remaining=" << filter_relative_support(fusions, options.evalue_cutoff) << ")" << endl;
+		log << get_time_string() << " Filtering fusions with an e-value >=" << options.evalue_cutoff << " " << flush;
+		log << "(remaining=" << metrics.record_fusions("relative_support", filter_relative_support(fusions, options.evalue_cutoff)) << ")" << endl;
 	}
 
 	// this step must come after the 'intragenic_exonic' and 'relative_support' filters
 	if (options.filters.at("internal_tandem_duplication")) {
-		cout << get_time_string() << " Searching for internal tandem duplications <=" << options.max_itd_length << "bp with >=" << options.min_itd_support << " supporting reads and >=" << (options.min_itd_allele_fraction*100) << "% allele fraction " << flush;
-		cout << "(remaining=" << recover_internal_tandem_duplication(fusions, chimeric_alignments, coverage, exon_annotation_index, options.max_itd_length, options.min_itd_support, options.min_itd_allele_fraction, options.subsampling_threshold) << ")" << endl;
+		log << get_time_string() << " Searching for internal tandem duplications <=" << options.max_itd_length << "bp with >=" << options.min_itd_support << " supporting reads and >=" << (options.min_itd_allele_fraction*100) << "% allele fraction " << flush;
+		log << "(remaining=" << metrics.record_fusions("internal_tandem_duplication", recover_internal_tandem_duplication(fusions, chimeric_alignments, coverage, exon_annotation_index, options.max_itd_length, options.min_itd_support, options.min_itd_allele_fraction, options.subsampling_threshold)) << ")" << endl;
 	}
 
 	// this step must come before all filters that are potentially undone by the 'genomic_support' filter
 	if (options.filters.at("intronic")) {
-		cout << get_time_string() << " Filtering fusions with both breakpoints in intronic/intergenic regions " << flush;
-		cout << "(remaining=" << filter_both_intronic(fusions, viral_contigs) << ")" << endl;
+		log << get_time_string() << " Filtering fusions with both breakpoints in intronic/intergenic regions " << flush;
+		log << "(remaining=" << metrics.record_fusions("intronic", filter_both_intronic(fusions, viral_contigs)) << ")" << endl;
 	}
 
 	// this step must come right after the 'relative_support' and 'min_support' filters
 	if (!options.known_fusions_file.empty() && options.filters.at("known_fusions")) {
-		cout << get_time_string() << " Searching for known fusions in '" << options.known_fusions_file << "' " << flush;
-		cout << "(remaining=" << recover_known_fusions(fusions, options.known_fusions_file, contigs, gene_names, coverage, max_mate_gap) << ")" << endl;
+		log << get_time_string() << " Searching for known fusions in '" << options.known_fusions_file << "' " << flush;
+		log << "(remaining=" << metrics.record_fusions("known_fusions", recover_known_fusions(fusions, references.known_fusions, coverage, max_mate_gap)) << ")" << endl;
 	}
 
 	// this step must come after the 'merge_adjacent' filter,
@@ -482,131 +554,226 @@ int main(int argc, char **argv) {
 	// it must come before the 'spliced' and 'many_spliced' filters,
 	// which are prone to recovering reverse transcriptase-mediated fusions
 	if (options.filters.at("in_vitro")) {
-		cout << get_time_string() << " Filtering in vitro-generated fusions between genes with an expression above the " << (options.high_expression_quantile*100) << "% quantile " << flush;
-		cout << "(remaining=" << filter_in_vitro(fusions, chimeric_alignments, options.high_expression_quantile, gene_annotation_index, coverage) << ")" << endl;
+		log << get_time_string() << " Filtering in vitro-generated fusions between genes with an expression above the " << (options.high_expression_quantile*100) << "% quantile " << flush;
+		log << "(remaining=" << metrics.record_fusions("in_vitro", filter_in_vitro(fusions, chimeric_alignments, options.high_expression_quantile, gene_annotation_index, coverage)) << ")" << endl;
 	}
 
 	// this step must come closely after the 'relative_support' and 'min_support' filters
 	if (options.filters.at("spliced")) {
-		cout << get_time_string() << " Searching for fusions with spliced split reads " << flush;
-		cout << "(remaining=" << recover_both_spliced(fusions, chimeric_alignments, exon_annotation_index, coverage, 200, 0.998, 1000, 1000) << ")" << endl;
+		log << get_time_string() << " Searching for fusions with spliced split reads " << flush;
+		log << "(remaining=" << metrics.record_fusions("spliced", recover_both_spliced(fusions, chimeric_alignments, exon_annotation_index, coverage, 200, 0.998, 1000, 1000)) << ")" << endl;
 	}
 
 	// this step must come after the 'merge_adjacent' filter,
 	// because merging might yield a different best breakpoint
 	if (options.filters.at("select_best")) {
-		cout << get_time_string() << " Selecting best breakpoints from genes with multiple breakpoints " << flush;
-		cout << "(remaining=" << select_most_supported_breakpoints(fusions) << ")" << endl;
+		log << get_time_string() << " Selecting best breakpoints from genes with multiple breakpoints " << flush;
+		log << "(remaining=" << metrics.record_fusions("select_best_1", select_most_supported_breakpoints(fusions)) << ")" << endl;
 	}
 
 	// this step should come after the 'select_best' filter and before the 'many_spliced' filter
 	if (options.filters.at("marginal_read_through")) {
-		cout << get_time_string() << " Filtering read-through fusions with breakpoints near the gene boundary " << flush;
-		cout << "(remaining=" << filter_marginal_read_through(fusions, coverage) << ")" << endl;
+		log << get_time_string() << " Filtering read-through fusions with breakpoints near the gene boundary " << flush;
+		log << "(remaining=" << metrics.record_fusions("marginal_read_through", filter_marginal_read_through(fusions, coverage)) << ")" << endl;
 	}
 
 	// this step must come after the 'select_best' filter, because it increases the chances of
 	// an event to pass all filters by recovering multiple breakpoints which evidence the same event
 	// moreover, this step must come after all the filters the 'relative_support' and 'min_support' filters
 	if (options.filters.at("many_spliced")) {
-		cout << get_time_string() << " Searching for fusions with >=" << options.min_spliced_events << " spliced events " << flush;
-		cout << "(remaining=" << recover_many_spliced(fusions, options.min_spliced_events) << ")" << endl;
+		log << get_time_string() << " Searching for fusions with >=" << options.min_spliced_events << " spliced events " << flush;
+		log << "(remaining=" << metrics.record_fusions("many_spliced", recover_many_spliced(fusions, options.min_spliced_events)) << ")" << endl;
 	}
 
 	if (!options.genomic_breakpoints_file.empty() && options.filters.at("no_genomic_support")) {
-		cout << get_time_string() << " Assigning confidence scores to events " << endl << flush;
+		log << get_time_string() << " Assigning confidence scores to events " << endl << flush;
 		assign_confidence(fusions, coverage);
+		metrics.record("confidence_1");
 
 		// this step must come after assigning confidence scores
-		cout << get_time_string() << " Filtering low-confidence events with no support from WGS " << flush;
-		cout << "(remaining=" << filter_no_genomic_support(fusions) << ")" << endl;
+		log << get_time_string() << " Filtering low-confidence events with no support from WGS " << flush;
+		log << "(remaining=" << metrics.record_fusions("no_genomic_support", filter_no_genomic_support(fusions)) << ")" << endl;
 	}
 
 	// this step must come after the 'select_best' filter, because the 'select_best' filter prefers
 	// soft-clipped breakpoints, which are easier to remove by blacklisting, because they are more recurrent
 	if (options.filters.at("blacklist") && !options.blacklist_file.empty()) {
-		cout << get_time_string() << " Filtering blacklisted fusions in '" << options.blacklist_file << "' " << flush;
-		cout << "(remaining=" << filter_blacklisted_ranges(fusions, options.blacklist_file, contigs, gene_names, options.evalue_cutoff, max_mate_gap) << ")" << endl;
+		log << get_time_string() << " Filtering blacklisted fusions in '" << options.blacklist_file << "' " << flush;
+		log << "(remaining=" << metrics.record_fusions("blacklist", filter_blacklisted_ranges(fusions, references.blacklist, options.evalue_cutoff, max_mate_gap)) << ")" << endl;
 	}
 
 	if (options.filters.at("short_anchor")) {
-		cout << get_time_string() << " Filtering fusions with anchors <=" << options.min_anchor_length << "nt " << flush;
-		cout << "(remaining=" << filter_short_anchor(fusions, options.min_anchor_length) << ")" << endl;
+		log << get_time_string() << " Filtering fusions with anchors <=" << options.min_anchor_length << "nt " << flush;
+		log << "(remaining=" << metrics.record_fusions("short_anchor", filter_short_anchor(fusions, options.min_anchor_length)) << ")" << endl;
 	}
 
 	if (options.filters.at("end_to_end")) {
-		cout << get_time_string() << " Filtering end-to-end fusions with low support " << flush;
-		cout << "(remaining=" << filter_end_to_end_fusions(fusions, exon_annotation_index, viral_contigs) << ")" << endl;
+		log << get_time_string() << " Filtering end-to-end fusions with low support " << flush;
+		log << "(remaining=" << metrics.record_fusions("end_to_end", filter_end_to_end_fusions(fusions, exon_annotation_index, viral_contigs)) << ")" << endl;
 	}
 
 	if (options.filters.at("no_coverage")) {
-		cout << get_time_string() << " Filtering fusions with no coverage around the breakpoints " << flush;
-		cout << "(remaining=" << filter_no_coverage(fusions, coverage, exon_annotation_index) << ")" << endl;
+		log << get_time_string() << " Filtering fusions with no coverage around the breakpoints " << flush;
+		log << "(remaining=" << metrics.record_fusions("no_coverage", filter_no_coverage(fusions, coverage, exon_annotation_index)) << ")" << endl;
 	}
 
 	// make kmer indices from gene sequences
 	kmer_indices_t kmer_indices;
 	const char kmer_length = 8; // must not be longer than 16 or else conversion to int will fail
 	if (options.filters.at("homologs") || options.filters.at("mismappers")) {
-		cout << get_time_string() << " Indexing gene sequences " << endl << flush;
+		log << get_time_string() << " Indexing gene sequences " << endl << flush;
 		make_kmer_index(fusions, assembly, max_mate_gap + 2*read_length_mean, kmer_length, kmer_indices);
+		metrics.record("kmer_index");
 	}
 
 	// this step must come near the end, because it is expensive in terms of memory consumption
 	if (options.filters.at("homologs")) {
-		cout << get_time_string() << " Filtering genes with >=" << (options.max_homolog_identity*100) << "% identity " << flush;
-		cout << "(remaining=" << filter_homologs(fusions, kmer_indices, kmer_length, assembly, options.max_homolog_identity) << ")" << endl;
+		log << get_time_string() << " Filtering genes with >=" << (options.max_homolog_identity*100) << "% identity " << flush;
+		log << "(remaining=" << metrics.record_fusions("homologs", filter_homologs(fusions, kmer_indices, kmer_length, assembly, options.max_homolog_identity)) << ")" << endl;
 	}
 
 	// this step must come near the end, because it is expensive in terms of memory and CPU consumption
 	if (options.filters.at("mismappers")) {
-		cout << get_time_string() << " Re-aligning chimeric reads to filter fusions with >=" << (options.max_mismapper_fraction*100) << "% mis-mappers " << flush;
-		cout << "(remaining=" << filter_mismappers(fusions, kmer_indices, kmer_length, assembly, exon_annotation_index, options.max_mismapper_fraction, max_mate_gap) << ")" << endl;
+		log << get_time_string() << " Re-aligning chimeric reads to filter fusions with >=" << (options.max_mismapper_fraction*100) << "% mis-mappers " << flush;
+		log << "(remaining=" << metrics.record_fusions("mismappers", filter_mismappers(fusions, kmer_indices, kmer_length, assembly, exon_annotation_index, options.max_mismapper_fraction, max_mate_gap)) << ")" << endl;
 	}
 
 	// this step must come after all heuristic filters, to undo them
 	if (!options.genomic_breakpoints_file.empty() && options.filters.at("genomic_support")) {
-		cout << get_time_string() << " Searching for fusions with support from WGS " << flush;
-		cout << "(remaining=" << recover_genomic_support(fusions) << ")" << endl;
+		log << get_time_string() << " Searching for fusions with support from WGS " << flush;
+		log << "(remaining=" << metrics.record_fusions("genomic_support", recover_genomic_support(fusions)) << ")" << endl;
 	}
 
 	if (!options.genomic_breakpoints_file.empty() && options.filters.at("genomic_support") || options.filters.at("many_spliced")) {
 		// the 'select_best' filter needs to be run again, to remove redundant events recovered by the 'genomic_support' and 'many_spliced' filters
 		if (options.filters.at("select_best")) {
-			cout << get_time_string() << " Selecting best breakpoints from genes with multiple breakpoints " << flush;
-			cout << "(remaining=" << select_most_supported_breakpoints(fusions) << ")" << endl;
+			log << get_time_string() << " Selecting best breakpoints from genes with multiple breakpoints " << flush;
+			log << "(remaining=" << metrics.record_fusions("select_best_2", select_most_supported_breakpoints(fusions)) << ")" << endl;
 		}
 	}
 
 	// this filter must come last, because it should only recover isoforms of fusions which pass all other filters
 	if (options.filters.at("isoforms")) {
-		cout << get_time_string() << " Searching for additional isoforms " << flush;
-		cout << "(remaining=" << recover_isoforms(fusions) << ")" << endl;
+		log << get_time_string() << " Searching for additional isoforms " << flush;
+		log << "(remaining=" << metrics.record_fusions("isoforms", recover_isoforms(fusions)) << ")" << endl;
 	}
 
 	// this step must come after the 'isoforms' filter, because recovered isoforms need to be scored anew
-	cout << get_time_string() << " Assigning confidence scores to events " << endl << flush;
+	log << get_time_string() << " Assigning confidence scores to events " << endl << flush;
 	assign_confidence(fusions, coverage);
+	metrics.record("confidence_2");
+
+	// load the protein domains of the genes of the fusions to be reported, unless they are shared by all samples
+	protein_domain_annotation_t sample_protein_domain_annotation;
+	protein_domain_annotation_index_t sample_protein_domain_annotation_index;
+	if (!options.protein_domains_file.empty() && references.protein_domain_annotation.empty()) {
+		unordered_set<gene_t> genes_of_reported_fusions;
+		for (fusions_t::iterator fusion = fusions.begin(); fusion != fusions.end(); ++fusion) {
+			if (fusion->second.filter == FILTER_none || !options.discarded_output_file.empty()) {
+				genes_of_reported_fusions.insert(fusion->second.gene1);
+				genes_of_reported_fusions.insert(fusion->second.gene2);
+			}
+		}
+		log << get_time_string() << " Loading protein domains from '" << options.protein_domains_file << "'" << endl;
+		load_protein_domains(options.protein_domains_file, references.contigs, references.gene_annotation, references.gene_names, &genes_of_reported_fusions, sample_protein_domain_annotation, sample_protein_domain_annotation_index);
+		metrics.record("load_protein_domains_of_fusions");
+	}
+	const protein_domain_annotation_index_t& protein_domain_annotation_index = (references.protein_domain_annotation.empty()) ? sample_protein_domain_annotation_index : references.protein_domain_annotation_index;
 
-	tags_t tags;
-	if (!options.tags_file.empty()) {
-		cout << get_time_string() << " Loading tags from '" << options.tags_file << "'" << endl;
-		load_tags(options.tags_file, contigs, gene_names, tags);
+	log << get_time_string() << " Writing fusions to file '" << options.output_file << "' " << endl;
+	write_fusions_to_file(fusions, options.output_file, coverage, assembly, gene_annotation_index, exon_annotation_index, original_contig_names, references.tags, protein_domain_annotation_index, max_mate_gap, options.max_itd_length, true, options.fill_sequence_gaps, false, options.threads);
+	metrics.record("output");
+
+	if (options.discarded_output_file != "") {
+		log << get_time_string() << " Writing discarded fusions to file '" << options.discarded_output_file << "'" << endl;
+		write_fusions_to_file(fusions, options.discarded_output_file, coverage, assembly, gene_annotation_index, exon_annotation_index, original_contig_names, references.tags, protein_domain_annotation_index, max_mate_gap, options.max_itd_length, options.print_extra_info_for_discarded_fusions, options.fill_sequence_gaps, true, options.threads);
+		metrics.record("discarded_output");
 	}
 
-	protein_domain_annotation_t protein_domain_annotation;
-	protein_domain_annotation_index_t protein_domain_annotation_index;
-	if (!options.protein_domains_file.empty()) {
-		cout << get_time_string() << " Loading protein domains from '" << options.protein_domains_file << "'" << endl;
-		load_protein_domains(options.protein_domains_file, contigs, gene_annotation, gene_names, protein_domain_annotation, protein_domain_annotation_index);
+	if (!options.metrics_file.empty()) {
+		log << get_time_string() << " Writing metrics to file '" << options.metrics_file << "'" << endl;
+		metrics.write_json(options.metrics_file, loading_metrics);
 	}
+}
 
-	cout << get_time_string() << " Writing fusions to file '" << options.output_file << "' " << endl;
-	write_fusions_to_file(fusions, options.output_file, coverage, assembly, gene_annotation_index, exon_annotation_index, original_contig_names, tags, protein_domain_annotation_index, max_mate_gap, options.max_itd_length, true, options.fill_sequence_gaps, false);
+// the workers of batch mode take the next unprocessed sample from the manifest, until all samples have been processed
+void process_batch_samples(const options_t& options, const references_t& references, unsigned int& next_sample, mutex& batch_mutex) {
+	const unsigned int sample_count = options.batch_samples.size();
+	while (true) {
+
+		unsigned int sample;
+		{
+			lock_guard<mutex> lock(batch_mutex);
+			if (next_sample >= sample_count)
+				return;
+			sample = next_sample++;
+			cout << get_time_string() << " Processing sample " << (sample+1) << " of " << sample_count << " ('" << options.batch_samples[sample].rna_bam_file << "')" << endl;
+		}
 
-	if (options.discarded_output_file != "") {
-		cout << get_time_string() << " Writing discarded fusions to file '" << options.discarded_output_file << "'" << endl;
-		write_fusions_to_file(fusions, options.discarded_output_file, coverage, assembly, gene_annotation_index, exon_annotation_index, original_contig_names, tags, protein_domain_annotation_index, max_mate_gap, options.max_itd_length, options.print_extra_info_for_discarded_fusions, options.fill_sequence_gaps, true);
+		// the sample is processed with the same options as an individual run
+		options_t sample_options = options;
+		sample_options.rna_bam_file = options.batch_samples[sample].rna_bam_file;
+		sample_options.chimeric_bam_file = options.batch_samples[sample].chimeric_bam_file;
+		sample_options.output_file = options.batch_samples[sample].output_file;
+		sample_options.discarded_output_file = options.batch_samples[sample].discarded_output_file;
+		sample_options.genomic_breakpoints_file = options.batch_samples[sample].genomic_breakpoints_file;
+		sample_options.metrics_file = options.batch_samples[sample].metrics_file;
+
+		// warnings go to the log of the sample, too, so that they can be attributed to the sample
+		if (options.batch_workers == 1) {
+			sample_log_scope_t sample_log_scope(cout);
+			process_sample(sample_options, references, cout);
+		} else {
+			// the log of a sample is printed only after the sample has been processed,
+			// so that the logs of concurrently processed samples are not interleaved
+			ostringstream log;
+			{
+				sample_log_scope_t sample_log_scope(log);
+				process_sample(sample_options, references, log);
+			}
+			lock_guard<mutex> lock(batch_mutex);
+			cout << get_time_string() << " Finished sample " << (sample+1) << " of " << sample_count << " ('" << options.batch_samples[sample].rna_bam_file << "')" << endl
+			     << log.str() << flush;
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+
+	// measure elapsed time
+	time_t start_time;
+	time(&start_time);
+	cout << get_time_string() << " Launching Arriba " << ARRIBA_VERSION << endl << flush;
+
+	{ // the runtime of everything in this block is measured
+
+	// parse command-line options
+	options_t options = parse_arguments(argc, argv);
+
+	// load assembly, annotation, and the other references
+	if (!options.filters.at("uninteresting_contigs"))
+		options.interesting_contigs = "*"; // load all contigs when the filter is disabled
+	references_t references;
+	stage_metrics_t loading_metrics;
+	load_references(options, references, loading_metrics);
+
+	// prevent htslib from downloading the assembly via the Internet, if CRAM is used
+	setenv("REF_PATH", ".", 0);
+
+	if (!options.server_socket.empty()) {
+		// run jobs received over a socket until the server is terminated
+		serve_jobs(options, [&references](const options_t& job_options) { process_sample(job_options, references, cout); });
+	} else if (options.batch_samples.empty()) {
+		process_sample(options, references, cout, &loading_metrics);
+	} else {
+		// process the samples listed in the manifest with the given number of workers
+		unsigned int next_sample = 0;
+		mutex batch_mutex;
+		vector<thread> workers;
+		for (unsigned int worker = 0; worker < options.batch_workers && worker < options.batch_samples.size(); ++worker)
+			workers.push_back(thread(process_batch_samples, cref(options), cref(references), ref(next_sample), ref(batch_mutex)));
+		for (auto worker = workers.begin(); worker != workers.end(); ++worker)
+			worker->join();
 	}
 
 	cout << get_time_string() << " Freeing resources" << endl;
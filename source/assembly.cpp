@@ -1,8 +1,16 @@
+#include <cerrno>
 #include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "sam.h"
 #include "common.hpp"
 #include "annotation.hpp"
@@ -25,9 +33,8 @@ string dna_to_reverse_complement(const string& dna) {
 	return reverse_complement;
 }
 
-void load_assembly(assembly_t& assembly, const string& fasta_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs) {
-
-	// read FastA file line by line
+// read FastA file line by line
+void read_fasta(const string& fasta_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs, unordered_map<contig_t,string>& sequences) {
 	autodecompress_file_t fasta_file(fasta_file_path);
 	string line;
 	contig_t current_contig = USHRT_MAX;
@@ -51,9 +58,138 @@ void load_assembly(assembly_t& assembly, const string& fasta_file_path, contigs_
 			// get sequence
 			} else if (current_contig != USHRT_MAX) { // skip line if contig is undefined or not interesting
 				std::transform(line.begin(), line.end(), line.begin(), (int (*)(int))std::toupper); // convert sequence to uppercase
-				assembly[current_contig] += line;
+				sequences[current_contig] += line;
 			}
 		}
 	}
 }
 
+// the cache is only valid, if the FastA file has not changed since the cache was written and if the same contigs were selected
+string get_assembly_cache_signature(const string& fasta_file_path, const string& interesting_contigs) {
+	struct stat fasta_file_info;
+	crash(stat(fasta_file_path.c_str(), &fasta_file_info) != 0, "failed to access file '" + fasta_file_path + "': " + strerror(errno));
+	return "ARRIBA_ASSEMBLY_CACHE\t1\n" +
+	       to_string(static_cast<long long int>(fasta_file_info.st_size)) + "\t" + to_string(static_cast<long long int>(fasta_file_info.st_mtime)) + "\n" +
+	       interesting_contigs + "\n";
+}
+
+// the cache file has a header, which lists the contigs, followed by the null-terminated sequences of the contigs
+// the cache is written to a temporary file first, such that concurrent processes never see an incomplete cache
+bool write_assembly_cache(const string& cache_file_path, const string& signature, const vector<string>& original_contig_names, const unordered_map<contig_t,string>& sequences) {
+	const string temporary_file_path = cache_file_path + ".tmp." + to_string(static_cast<long long int>(getpid()));
+	{
+		ofstream cache_file(temporary_file_path.c_str(), ios::binary | ios::trunc);
+		if (!cache_file.is_open())
+			return false;
+		cache_file << signature << original_contig_names.size() << "\n";
+		string::size_type offset = 0;
+		for (contig_t contig = 0; contig < original_contig_names.size(); ++contig) {
+			unordered_map<contig_t,string>::const_iterator sequence = sequences.find(contig);
+			cache_file << original_contig_names[contig] << "\t" << (sequence != sequences.end()) << "\t" << offset << "\t" << ((sequence != sequences.end()) ? sequence->second.size() : 0) << "\n";
+			if (sequence != sequences.end())
+				offset += sequence->second.size() + 1;
+		}
+		cache_file << '\0';
+		for (contig_t contig = 0; contig < original_contig_names.size(); ++contig) {
+			unordered_map<contig_t,string>::const_iterator sequence = sequences.find(contig);
+			if (sequence != sequences.end())
+				cache_file.write(sequence->second.c_str(), sequence->second.size() + 1);
+		}
+		if (!cache_file.good()) {
+			cache_file.close();
+			unlink(temporary_file_path.c_str());
+			return false;
+		}
+	}
+	if (rename(temporary_file_path.c_str(), cache_file_path.c_str()) != 0) {
+		unlink(temporary_file_path.c_str());
+		return false;
+	}
+	return true;
+}
+
+// map the cache file into memory read-only, such that the operating system shares the pages among all processes which use the same cache
+bool load_assembly_cache(assembly_t& assembly, const string& cache_file_path, const string& signature, contigs_t& contigs, vector<string>& original_contig_names) {
+
+	// parse header
+	ifstream cache_file(cache_file_path.c_str(), ios::binary);
+	if (!cache_file.is_open())
+		return false;
+	string header(signature.size(), '\0');
+	if (!cache_file.read(&header[0], header.size()) || header != signature)
+		return false; // cache is outdated
+	unsigned int contig_count;
+	if (!(cache_file >> contig_count) || contig_count >= USHRT_MAX)
+		return false;
+	struct cached_contig_t { string name; bool in_assembly; string::size_type offset; string::size_type length; };
+	vector<cached_contig_t> cached_contigs(contig_count);
+	for (vector<cached_contig_t>::iterator contig = cached_contigs.begin(); contig != cached_contigs.end(); ++contig)
+		if (!(cache_file >> contig->name >> contig->in_assembly >> contig->offset >> contig->length))
+			return false;
+	string line;
+	if (!getline(cache_file, line) || cache_file.get() != '\0')
+		return false;
+	const streamoff data_offset = cache_file.tellg();
+	cache_file.close();
+
+	// map file into memory
+	int file_descriptor = open(cache_file_path.c_str(), O_RDONLY);
+	if (file_descriptor < 0)
+		return false;
+	struct stat cache_file_info;
+	if (fstat(file_descriptor, &cache_file_info) != 0) {
+		close(file_descriptor);
+		return false;
+	}
+	const size_t cache_file_size = cache_file_info.st_size;
+	for (vector<cached_contig_t>::iterator contig = cached_contigs.begin(); contig != cached_contigs.end(); ++contig)
+		if (contig->in_assembly && data_offset + contig->offset + contig->length >= cache_file_size) {
+			close(file_descriptor);
+			return false; // truncated file
+		}
+	void* mapped_file = mmap(NULL, cache_file_size, PROT_READ, MAP_SHARED, file_descriptor, 0);
+	close(file_descriptor);
+	if (mapped_file == MAP_FAILED)
+		return false;
+	assembly.mapped_file = shared_ptr<const char>(static_cast<const char*>(mapped_file), [cache_file_size](const char* address) { munmap(const_cast<char*>(address), cache_file_size); });
+
+	// make contigs refer to the sequences in the mapped file
+	original_contig_names.resize(contig_count);
+	for (contig_t contig = 0; contig < contig_count; ++contig) {
+		contigs[removeChr(cached_contigs[contig].name)] = contig;
+		original_contig_names[contig] = cached_contigs[contig].name;
+		if (cached_contigs[contig].in_assembly)
+			assembly[contig] = contig_sequence_t(assembly.mapped_file.get() + data_offset + cached_contigs[contig].offset, cached_contigs[contig].length);
+	}
+	return true;
+}
+
+void load_assembly(assembly_t& assembly, const string& fasta_file_path, const string& cache_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs) {
+
+	string cache_signature;
+	if (!cache_file_path.empty()) {
+		cache_signature = get_assembly_cache_signature(fasta_file_path, interesting_contigs);
+		if (load_assembly_cache(assembly, cache_file_path, cache_signature, contigs, original_contig_names))
+			return;
+	}
+
+	unordered_map<contig_t,string> sequences;
+	read_fasta(fasta_file_path, contigs, original_contig_names, interesting_contigs, sequences);
+
+	if (!cache_file_path.empty()) {
+		// use the sequences from the cache right away, such that the memory is shared with processes started later
+		contigs_t fasta_contigs;
+		vector<string> fasta_original_contig_names;
+		if (write_assembly_cache(cache_file_path, cache_signature, original_contig_names, sequences) &&
+		    load_assembly_cache(assembly, cache_file_path, cache_signature, fasta_contigs, fasta_original_contig_names))
+			return;
+		cerr << "WARNING: failed to write assembly cache '" << cache_file_path << "'" << endl;
+	}
+
+	// keep sequences in memory
+	for (unordered_map<contig_t,string>::iterator sequence = sequences.begin(); sequence != sequences.end(); ++sequence) {
+		assembly.sequences.push_back("");
+		assembly.sequences.back().swap(sequence->second);
+		assembly[sequence->first] = contig_sequence_t(assembly.sequences.back().c_str(), assembly.sequences.back().size());
+	}
+}
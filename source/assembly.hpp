@@ -24,6 +24,7 @@ void dna_to_reverse_complement(const string& dna, string& reverse_complement);
 
 string dna_to_reverse_complement(const string& dna);
 
-void load_assembly(assembly_t& assembly, const string& fasta_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs);
+// when a cache file is given, the sequences are read from the cache, which is memory-mapped and thus shared by concurrent processes
+void load_assembly(assembly_t& assembly, const string& fasta_file_path, const string& cache_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs);
 
 #endif /* ASSEMBLY_H */
@@ -0,0 +1,312 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "sam.h"
+#include "common.hpp"
+#include "annotation.hpp"
+#include "annotate_protein_domains.hpp"
+#include "assembly.hpp"
+#include "filter_mismappers.hpp"
+#include "filter_mismatches.hpp"
+#include "filter_multimappers.hpp"
+#include "output_fusions.hpp"
+#include "read_compressed_file.hpp"
+#include "read_stats.hpp"
+
+using namespace std;
+
+// microbenchmarks of the routines which dominate the runtime of Arriba
+// every benchmark runs on synthetic data, which is generated with a fixed seed, such that runs are comparable
+// usage: benchmark [minimum runtime of each benchmark in seconds]
+
+const unsigned int CONTIG_LENGTH = 4000000;
+const unsigned int GENE_COUNT = 200;
+const position_t GENE_DISTANCE = CONTIG_LENGTH / GENE_COUNT;
+const position_t GENE_LENGTH = GENE_DISTANCE / 2;
+const unsigned int EXONS_PER_GENE = 8;
+const position_t EXON_LENGTH = 150;
+const unsigned int READ_LENGTH = 100;
+const char KMER_LENGTH = 8; // same as in arriba.cpp
+
+volatile unsigned long long int benchmark_sink = 0; // results are accumulated here, such that the compiler cannot optimize away the benchmarked code
+
+// run <operation> repeatedly until at least <min_seconds> have elapsed and report the time per operation
+// <items_per_operation> is used to report the throughput in units of <item_name> (bases, reads, lines, ...)
+template <class F> void run_benchmark(const string& name, const double min_seconds, const unsigned long long int items_per_operation, const string& item_name, F operation) {
+	operation(); // warm-up, e.g., to populate caches
+	unsigned long long int operations = 0;
+	double elapsed_seconds = 0;
+	for (unsigned long long int batch_size = 1; elapsed_seconds < min_seconds; batch_size *= 2) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (unsigned long long int i = 0; i < batch_size; ++i)
+			operation();
+		elapsed_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		operations += batch_size;
+	}
+	cout << left << setw(34) << name << right
+	     << setw(14) << fixed << setprecision(1) << (elapsed_seconds * 1e9 / operations) << " ns/op"
+	     << setw(16) << setprecision(2) << (operations * items_per_operation / elapsed_seconds / 1e6) << " M" << item_name << "/s" << endl;
+}
+
+// random DNA sequence of the given length
+string make_random_sequence(mt19937& random, const unsigned int length) {
+	const char bases[] = "ACGT";
+	string sequence(length, 'N');
+	for (unsigned int i = 0; i < length; ++i)
+		sequence[i] = bases[random() % 4];
+	return sequence;
+}
+
+// copy of <sequence> with the given fraction of bases mutated
+string mutate_sequence(mt19937& random, string sequence, const double mutation_rate) {
+	const char bases[] = "ACGT";
+	for (unsigned int i = 0; i < sequence.size(); ++i)
+		if (random() % 1000 < mutation_rate * 1000)
+			sequence[i] = bases[random() % 4];
+	return sequence;
+}
+
+int main(int argc, char **argv) {
+
+	const double min_seconds = (argc > 1) ? atof(argv[1]) : 1.0;
+	mt19937 random(42);
+
+	// synthetic assembly with a single contig
+	contigs_t contigs;
+	contigs["1"] = 0;
+	assembly_t assembly;
+	assembly.sequences.push_back(make_random_sequence(random, CONTIG_LENGTH));
+	assembly[0] = contig_sequence_t(assembly.sequences.back().c_str(), assembly.sequences.back().size());
+	const string& contig_sequence = assembly.sequences.back();
+
+	// synthetic gene annotation with evenly spaced genes, each of which has several exons
+	gene_annotation_t gene_annotation;
+	exon_annotation_t exon_annotation;
+	for (unsigned int i = 0; i < GENE_COUNT; ++i) {
+		gene_annotation_record_t gene;
+		gene.contig = 0;
+		gene.start = i * GENE_DISTANCE + 1000;
+		gene.end = gene.start + GENE_LENGTH;
+		gene.strand = (i % 2 == 0) ? FORWARD : REVERSE;
+		gene.id = i;
+		gene.gene_id = gene.name = "GENE" + to_string(static_cast<long long int>(i));
+		gene.exonic_length = EXONS_PER_GENE * EXON_LENGTH;
+		gene.is_dummy = false;
+		gene.is_protein_coding = true;
+		gene_annotation.push_back(gene);
+		exon_annotation_record_t* previous_exon = NULL;
+		for (unsigned int j = 0; j < EXONS_PER_GENE; ++j) {
+			exon_annotation_record_t exon;
+			exon.contig = 0;
+			exon.start = gene.start + j * (GENE_LENGTH / EXONS_PER_GENE);
+			exon.end = exon.start + EXON_LENGTH - 1;
+			exon.strand = gene.strand;
+			exon.gene = &gene_annotation.back();
+			exon.transcript = NULL;
+			exon.previous_exon = previous_exon;
+			exon.next_exon = NULL;
+			exon.coding_region_start = exon.start;
+			exon.coding_region_end = exon.end;
+			exon_annotation.push_back(exon);
+			if (previous_exon != NULL)
+				previous_exon->next_exon = &exon_annotation.back();
+			previous_exon = &exon_annotation.back();
+		}
+	}
+	gene_annotation_index_t gene_annotation_index;
+	gene_annotation_index.resize(contigs.size());
+	make_annotation_index(gene_annotation, gene_annotation_index);
+	exon_annotation_index_t exon_annotation_index;
+	exon_annotation_index.resize(contigs.size());
+	make_annotation_index(exon_annotation, exon_annotation_index);
+
+	// synthetic fusions between pairs of neighboring genes
+	fusions_t fusions;
+	for (auto gene = gene_annotation.begin(); gene != gene_annotation.end(); ++gene) {
+		auto next_gene = gene; ++next_gene;
+		if (next_gene == gene_annotation.end())
+			break;
+		fusion_t& fusion = fusions[make_tuple(gene->id, next_gene->id, 0, 0, gene->end, next_gene->start, DOWNSTREAM, UPSTREAM)];
+		fusion.gene1 = &(*gene); fusion.gene2 = &(*next_gene);
+		fusion.contig1 = fusion.contig2 = 0;
+		fusion.breakpoint1 = gene->end; fusion.breakpoint2 = next_gene->start;
+		++gene; // every gene is part of only one fusion
+	}
+
+	// synthetic reads sampled from the exons with a few sequencing errors
+	vector<position_t> read_positions;
+	vector<string> read_sequences;
+	for (auto exon = exon_annotation.begin(); exon != exon_annotation.end(); ++exon) {
+		position_t position = exon->start + random() % (EXON_LENGTH - READ_LENGTH / 2);
+		read_positions.push_back(position);
+		read_sequences.push_back(mutate_sequence(random, contig_sequence.substr(position, READ_LENGTH), 0.01));
+	}
+
+	cout << left << setw(34) << "benchmark" << right << setw(20) << "time" << setw(24) << "throughput" << endl;
+
+	run_benchmark("kmer_to_int", min_seconds, READ_LENGTH - KMER_LENGTH, "kmers", [&]() {
+		const string& read_sequence = read_sequences[benchmark_sink % read_sequences.size()];
+		kmer_as_int_t result = 0;
+		for (unsigned int position = 0; position < READ_LENGTH - KMER_LENGTH; ++position)
+			result += kmer_to_int(read_sequence, position, KMER_LENGTH);
+		benchmark_sink += result;
+	});
+
+	kmer_indices_t kmer_indices;
+	run_benchmark("make_kmer_index", min_seconds, CONTIG_LENGTH / 2, "bases", [&]() {
+		kmer_indices.clear();
+		make_kmer_index(fusions, assembly, 0, KMER_LENGTH, kmer_indices);
+		benchmark_sink += kmer_indices.size();
+	});
+
+	splice_sites_t splice_sites;
+	for (auto exon = exon_annotation.begin(); exon != exon_annotation.end(); ++exon)
+		splice_sites.insert(exon->end);
+	vector<gene_t> genes;
+	for (auto gene = gene_annotation.begin(); gene != gene_annotation.end(); ++gene)
+		genes.push_back(&(*gene));
+	unsigned int next_read = 0;
+	run_benchmark("align", min_seconds, 1, "reads", [&]() {
+		const unsigned int read = next_read++ % read_sequences.size();
+		const gene_t gene = genes[read / EXONS_PER_GENE]; // gene from which the read was sampled
+		benchmark_sink += align(0, read_sequences[read], 0, assembly.at(0), gene->start, gene->start, gene->end, kmer_indices[0], KMER_LENGTH, splice_sites, READ_LENGTH * 0.8, 1);
+	});
+
+	run_benchmark("get_annotation_by_coordinate", min_seconds, 1, "lookups", [&]() {
+		gene_set_t genes;
+		const position_t position = (benchmark_sink * 2654435761ULL) % CONTIG_LENGTH;
+		get_annotation_by_coordinate(0, position, position + READ_LENGTH, genes, gene_annotation_index);
+		benchmark_sink += genes.size() + 1;
+	});
+
+	{
+		// pairs of mates, half of which are spliced
+		const unsigned int fragment_count = 1000;
+		vector<bam1_t*> mates;
+		for (unsigned int i = 0; i < fragment_count; ++i) {
+			position_t position = random() % (CONTIG_LENGTH - 10000);
+			uint32_t spliced_cigar[3] = { bam_cigar_gen(READ_LENGTH/2, BAM_CMATCH), bam_cigar_gen(500, BAM_CREF_SKIP), bam_cigar_gen(READ_LENGTH/2, BAM_CMATCH) };
+			uint32_t unspliced_cigar[1] = { bam_cigar_gen(READ_LENGTH, BAM_CMATCH) };
+			for (unsigned int mate = 0; mate < 2; ++mate) {
+				bam1_t* bam_record = bam_init1();
+				const string name = "read" + to_string(static_cast<long long int>(i));
+				const uint16_t flag = BAM_FPAIRED | BAM_FPROPER_PAIR | ((mate == 0) ? BAM_FREAD1 | BAM_FMREVERSE : BAM_FREAD2 | BAM_FREVERSE);
+				bam_set1(bam_record, name.size(), name.c_str(), flag, 0, position + mate * 300, 255,
+				         (i % 2 == 0) ? 3 : 1, (i % 2 == 0) ? spliced_cigar : unspliced_cigar,
+				         0, position + (1 - mate) * 300, 0, 0, NULL, NULL, 0);
+				mates.push_back(bam_record);
+			}
+		}
+		coverage_t coverage;
+		coverage.resize(contigs, assembly);
+		run_benchmark("coverage_t::add_fragment", min_seconds, fragment_count, "fragments", [&]() {
+			for (unsigned int i = 0; i < mates.size(); i += 2)
+				coverage.add_fragment(mates[i], mates[i+1], false);
+			benchmark_sink += coverage.get_window_count(0);
+		});
+		for (auto mate = mates.begin(); mate != mates.end(); ++mate)
+			bam_destroy1(*mate);
+	}
+
+	vector<alignment_t> alignments(read_sequences.size());
+	for (unsigned int i = 0; i < alignments.size(); ++i) {
+		alignments[i].contig = 0;
+		alignments[i].strand = FORWARD;
+		alignments[i].start = read_positions[i];
+		alignments[i].end = read_positions[i] + READ_LENGTH - 1;
+		alignments[i].cigar.push_back(bam_cigar_gen(READ_LENGTH, BAM_CMATCH));
+		alignments[i].sequence = read_sequences[i];
+		get_annotation_by_coordinate(0, alignments[i].start, alignments[i].end, alignments[i].genes, gene_annotation_index);
+	}
+
+	run_benchmark("count_mismatches", min_seconds, READ_LENGTH, "bases", [&]() {
+		const unsigned int read = next_read++ % alignments.size();
+		unsigned int mismatches, alignment_length;
+		count_mismatches(alignments[read], read_sequences[read], assembly, mismatches, alignment_length);
+		benchmark_sink += mismatches + alignment_length;
+	});
+
+	run_benchmark("calculate_segment_score", min_seconds, READ_LENGTH, "bases", [&]() {
+		const unsigned int read = next_read++ % alignments.size();
+		benchmark_sink += calculate_segment_score(alignments[read], read_sequences[read], exon_annotation_index, assembly);
+	});
+
+	run_benchmark("dna_to_reverse_complement", min_seconds, READ_LENGTH, "bases", [&]() {
+		string reverse_complement;
+		dna_to_reverse_complement(read_sequences[next_read++ % read_sequences.size()], reverse_complement);
+		benchmark_sink += reverse_complement[0];
+	});
+
+	{
+		vector<string> triplets;
+		for (unsigned int i = 0; i < 64; ++i)
+			triplets.push_back(string() + "ACGT"[i / 16] + "ACGT"[i / 4 % 4] + "ACGT"[i % 4]);
+		run_benchmark("dna_to_protein", min_seconds, triplets.size(), "codons", [&]() {
+			for (auto triplet = triplets.begin(); triplet != triplets.end(); ++triplet)
+				benchmark_sink += dna_to_protein(*triplet);
+		});
+	}
+
+	{
+		// a line resembling a blacklist or known fusions file
+		const string line = "1:123456-234567\t2:345678-456789\tGENE1\tGENE2\t123\t456\tread_through\t+/-\t789\tsplit_reads";
+		run_benchmark("tsv_stream_t", min_seconds, 1, "lines", [&]() {
+			tsv_stream_t tsv(line);
+			string column1, column2, column3, column4, column7, column8, column10;
+			int column5, column6, column9;
+			tsv >> column1 >> column2 >> column3 >> column4 >> column5 >> column6 >> column7 >> column8 >> column9 >> column10;
+			benchmark_sink += column1.size() + column5 + column9 + tsv.fail();
+		});
+	}
+
+	{
+		// split reads spanning the breakpoint of a fusion with a few sequencing errors
+		const unsigned int split_read_count = 200;
+		const position_t breakpoint1 = GENE_DISTANCE + 5000;
+		const position_t breakpoint2 = 3 * GENE_DISTANCE + 5000;
+		chimeric_alignments_t chimeric_alignments;
+		vector<chimeric_alignments_t::iterator> split_reads;
+		for (unsigned int i = 0; i < split_read_count; ++i) {
+			const unsigned int anchor_length = READ_LENGTH / 4 + random() % (READ_LENGTH / 2);
+			mates_t& mates = chimeric_alignments["read" + to_string(static_cast<long long int>(i))];
+			mates.resize(3);
+			mates[MATE1].contig = 0;
+			mates[MATE1].strand = REVERSE;
+			mates[MATE1].start = breakpoint1 - 300 + random() % 100;
+			mates[MATE1].end = mates[MATE1].start + READ_LENGTH - 1;
+			mates[MATE1].cigar.push_back(bam_cigar_gen(READ_LENGTH, BAM_CMATCH));
+			mates[MATE1].sequence = mutate_sequence(random, contig_sequence.substr(mates[MATE1].start, READ_LENGTH), 0.01);
+			mates[SPLIT_READ].contig = 0;
+			mates[SPLIT_READ].strand = FORWARD;
+			mates[SPLIT_READ].start = breakpoint1 - anchor_length + 1;
+			mates[SPLIT_READ].end = breakpoint1;
+			mates[SPLIT_READ].cigar.push_back(bam_cigar_gen(anchor_length, BAM_CMATCH));
+			mates[SPLIT_READ].cigar.push_back(bam_cigar_gen(READ_LENGTH - anchor_length, BAM_CSOFT_CLIP));
+			mates[SPLIT_READ].sequence = mutate_sequence(random, contig_sequence.substr(mates[SPLIT_READ].start, anchor_length) + contig_sequence.substr(breakpoint2, READ_LENGTH - anchor_length), 0.01);
+			mates[SUPPLEMENTARY].contig = 0;
+			mates[SUPPLEMENTARY].strand = FORWARD;
+			mates[SUPPLEMENTARY].supplementary = true;
+			mates[SUPPLEMENTARY].start = breakpoint2;
+			mates[SUPPLEMENTARY].end = breakpoint2 + READ_LENGTH - anchor_length - 1;
+			mates[SUPPLEMENTARY].cigar.push_back(bam_cigar_gen(anchor_length, BAM_CHARD_CLIP));
+			mates[SUPPLEMENTARY].cigar.push_back(bam_cigar_gen(READ_LENGTH - anchor_length, BAM_CMATCH));
+		}
+		for (auto chimeric_alignment = chimeric_alignments.begin(); chimeric_alignment != chimeric_alignments.end(); ++chimeric_alignment)
+			split_reads.push_back(chimeric_alignment);
+		run_benchmark("pileup_chimeric_alignments", min_seconds, split_read_count * 3, "alignments", [&]() {
+			pileup_t pileup1, pileup2;
+			pileup_chimeric_alignments(split_reads, SPLIT_READ, false, DOWNSTREAM, breakpoint1, pileup1);
+			pileup_chimeric_alignments(split_reads, MATE1, false, DOWNSTREAM, breakpoint1, pileup1);
+			pileup_chimeric_alignments(split_reads, SUPPLEMENTARY, false, UPSTREAM, breakpoint2, pileup2);
+			pileup_t::covered_positions_t covered_positions;
+			pileup1.get_covered_positions(covered_positions);
+			benchmark_sink += covered_positions.size();
+		});
+	}
+
+	return 0;
+}
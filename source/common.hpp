@@ -5,15 +5,20 @@
 #include <climits>
 #include <cmath>
 #include <cstdlib>
+#include <ctime>
+#include <fstream>
 #include <list>
 #include <map>
+#include <memory>
 #include <set>
+#include <stdexcept>
 #include <string>
 #include <sstream>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
 #include <vector>
+#include <unistd.h>
 #include "sam.h"
 
 using namespace std;
@@ -109,7 +114,35 @@ inline bool is_interesting_contig(string contig, const string& interesting_conti
 	return false;
 };
 
-typedef unordered_map<contig_t,string> assembly_t;
+// sequence of a contig of the assembly
+// the sequence is not owned by this class, but by the assembly_t, which holds it either in memory or in a memory-mapped file
+class contig_sequence_t {
+	private:
+		const char* sequence; // null-terminated
+		string::size_type length;
+	public:
+		contig_sequence_t(): sequence(""), length(0) {};
+		contig_sequence_t(const char* sequence, const string::size_type length): sequence(sequence), length(length) {};
+		inline char operator[](const string::size_type position) const { return sequence[position]; };
+		inline string::size_type size() const { return length; };
+		inline bool empty() const { return length == 0; };
+		inline const char* c_str() const { return sequence; };
+		string substr(const string::size_type position, const string::size_type count = string::npos) const {
+			if (position > length)
+				throw out_of_range("contig_sequence_t::substr");
+			return string(sequence + position, min(count, length - position));
+		};
+};
+
+class assembly_t: public unordered_map<contig_t,contig_sequence_t> {
+	public:
+		list<string> sequences; // sequences loaded into memory
+		shared_ptr<const char> mapped_file; // sequences loaded from a memory-mapped file, which is shared by concurrent processes
+		assembly_t() {};
+	private:
+		assembly_t(const assembly_t&); // copies are not allowed, since the contig sequences would point to the storage of the original
+		assembly_t& operator=(const assembly_t&);
+};
 
 struct annotation_record_t {
 	contig_t contig;
@@ -187,6 +220,44 @@ class cigar_t: public vector<uint32_t> {
 		uint32_t op_length(unsigned int index) const { return bam_cigar_oplen(this->at(index)); };
 };
 
+// sequence of a read in the 4-bit encoding of BAM files, i.e., two bases per byte,
+// which halves the memory footprint of the read sequences; bases are only decoded where they are needed
+class read_sequence_t {
+	private:
+		string encoded;
+		string::size_type bases; // number of bases
+		inline uint8_t encoded_base(const string::size_type position) const { return (position % 2 == 0) ? ((uint8_t) encoded[position/2]) >> 4 : encoded[position/2] & 15; };
+	public:
+		read_sequence_t(): bases(0) {};
+		read_sequence_t(const string& sequence) { *this = sequence; };
+		read_sequence_t& operator=(const string& sequence) {
+			bases = sequence.size();
+			encoded.assign((bases + 1) / 2, 0);
+			for (string::size_type position = 0; position < bases; ++position)
+				encoded[position/2] |= seq_nt16_table[(unsigned char) sequence[position]] << ((position % 2 == 0) ? 4 : 0);
+			return *this;
+		};
+		// take over the sequence of a BAM record as is
+		void assign(const uint8_t* bam_sequence, const string::size_type bam_sequence_length) {
+			bases = bam_sequence_length;
+			encoded.assign((const char*) bam_sequence, (bases + 1) / 2);
+		};
+		inline char operator[](const string::size_type position) const { return seq_nt16_str[encoded_base(position)]; };
+		inline string::size_type size() const { return bases; };
+		inline string::size_type length() const { return bases; };
+		inline bool empty() const { return bases == 0; };
+		inline void clear() { encoded.clear(); bases = 0; };
+		string substr(const string::size_type position, const string::size_type count = string::npos) const {
+			if (position > bases)
+				throw out_of_range("read_sequence_t::substr");
+			string sequence(min(count, bases - position), 0);
+			for (string::size_type i = 0; i < sequence.size(); ++i)
+				sequence[i] = seq_nt16_str[encoded_base(position + i)];
+			return sequence;
+		};
+		inline string str() const { return substr(0); };
+};
+
 struct alignment_t {
 	bool supplementary;
 	bool first_in_pair;
@@ -198,7 +269,7 @@ struct alignment_t {
 	position_t start;
 	position_t end;
 	cigar_t cigar;
-	string sequence;
+	read_sequence_t sequence;
 	gene_set_t genes;
 	alignment_t(): supplementary(false), first_in_pair(false), exonic(false), predicted_strand_ambiguous(true) {};
 	unsigned int preclipping() const { return (cigar.operation(0) == BAM_CSOFT_CLIP || cigar.operation(0) == BAM_CHARD_CLIP) ? cigar.op_length(0) : 0; };
@@ -325,6 +396,40 @@ inline bool str_to_float(const char* s, float& f) {
 	return (*s != ' ' && end_of_parsing != s && *end_of_parsing == '\0' && f != HUGE_VALF && f != -HUGE_VALF);
 }
 
+// timestamp for log messages
+inline string get_time_string() {
+	time_t now = time(0);
+	struct tm local_time;
+	char buffer[100];
+	strftime(buffer, sizeof(buffer), "[%Y-%m-%dT%X]", localtime_r(&now, &local_time)); // reentrant, because samples may be processed concurrently
+	return buffer;
+}
+
+// get the resident memory of a process in bytes
+inline unsigned long long int get_memory_usage(const pid_t pid) {
+	ifstream statm("/proc/" + to_string(static_cast<long long int>(pid)) + "/statm");
+	unsigned long long int size, resident;
+	if (!(statm >> size >> resident))
+		return 0; // process has terminated in the meantime
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+// get the memory of a process in bytes which is not shared with any other process
+// unlike the shared memory reported by statm, which only covers files, this excludes the anonymous memory
+// which a forked process still shares with its parent via copy-on-write (such as the references of the server)
+inline unsigned long long int get_private_memory_usage(const pid_t pid) {
+	const string process = "/proc/" + to_string(static_cast<long long int>(pid));
+	ifstream smaps(process + "/smaps_rollup"); // sum over all mappings, available as of Linux 4.14
+	if (!smaps.is_open())
+		smaps.open(process + "/smaps"); // the fields of every mapping are added up instead
+	unsigned long long int private_memory = 0; // in kB
+	string line;
+	while (getline(smaps, line))
+		if (line.compare(0, 14, "Private_Clean:") == 0 || line.compare(0, 14, "Private_Dirty:") == 0)
+			private_memory += strtoull(line.c_str() + 14, NULL, 10);
+	return private_memory * 1024;
+}
+
 // convenience function to print an error message and exit if given condition is true
 #define crash(condition,message) { if (condition) { cerr << string("ERROR: ") + message << endl; exit(1); }; }
 
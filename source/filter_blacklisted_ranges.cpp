@@ -1,7 +1,6 @@
 #include <algorithm>
 #include <cmath>
 #include <iostream>
-#include <set>
 #include <string>
 #include <tuple>
 #include <unordered_map>
@@ -223,33 +222,58 @@ bool matches_blacklist_item(const blacklist_item_t& blacklist_item, const fusion
 }
 
 // divide the genome into fixed size bins
-void get_genome_bins_from_range(const contig_t contig, const position_t start, const position_t end, genome_bins_t& genome_bins) {
-	const int bucket_size = 100000; // bp
-	for (position_t position = start/bucket_size; position <= (end+bucket_size-1)/bucket_size /*integer ceil*/; ++position)
-		genome_bins.push_back(make_tuple(contig, position*bucket_size));
+const int GENOME_BIN_SIZE = 100000; // bp
+inline position_t get_first_genome_bin(const position_t start) { return start/GENOME_BIN_SIZE; }
+inline position_t get_last_genome_bin(const position_t end) { return (end+GENOME_BIN_SIZE-1)/GENOME_BIN_SIZE; /*integer ceil*/ }
+
+void genome_range_index_t::add(const unsigned int rule, const contig_t contig, const position_t start, const position_t end) {
+	range_t range;
+	range.contig = contig;
+	range.start = start;
+	range.end = end;
+	range.rule = rule;
+	ranges.push_back(range);
 }
 
-unsigned int filter_blacklisted_ranges(fusions_t& fusions, const string& blacklist_file_path, const contigs_t& contigs, const unordered_map<string,gene_t>& genes, const float evalue_cutoff, const int max_mate_gap) {
+void genome_range_index_t::compile() {
+	sort(ranges.begin(), ranges.end());
+	for (auto range = ranges.begin(); range != ranges.end(); ++range)
+		range->max_end = (range == ranges.begin() || (range-1)->contig != range->contig) ? range->end : max((range-1)->max_end, range->end);
+}
 
-	// index fusions by coordinate
-	unordered_map< genome_bin_t, set<fusion_t*> > fusions_by_coordinate;
-	for (fusions_t::iterator fusion = fusions.begin(); fusion != fusions.end(); ++fusion) {
+void genome_range_index_t::find(const contig_t contig, const position_t start, const position_t end, const int padding, vector<unsigned int>& rules) const {
+
+	// find the first range which starts in a bin after the given region
+	// the bins are monotonic in the coordinates, so the sorted order holds for the bins, too
+	const position_t first_bin = get_first_genome_bin(start);
+	const position_t last_bin = get_last_genome_bin(end);
+	auto range = partition_point(ranges.begin(), ranges.end(), [&](const range_t& x) {
+		return x.contig < contig || x.contig == contig && get_first_genome_bin(x.start - padding) <= last_bin;
+	});
+
+	// walk backwards until no preceding range on the same contig can reach the given region anymore
+	while (range != ranges.begin()) {
+		--range;
+		count_operation(OPERATION_blacklist_range_scans);
+		if (range->contig != contig || get_last_genome_bin(range->max_end + padding) < first_bin)
+			break;
+		if (get_last_genome_bin(range->end + padding) >= first_bin)
+			rules.push_back(range->rule);
+	}
+}
 
-		if (fusion->second.filter != FILTER_none && fusion->second.closest_genomic_breakpoint1 < 0)
-			continue; // fusion has already been filtered and won't be recovered by the 'genomic_support' filter
+void find_rules_near_fusion(const fusion_t& fusion, const genome_range_index_t& index, const int padding, vector<unsigned int>& rules) {
+	index.find(fusion.contig1, fusion.breakpoint1, fusion.breakpoint1, padding, rules);
+	index.find(fusion.contig2, fusion.breakpoint2, fusion.breakpoint2, padding, rules);
+	index.find(fusion.contig1, fusion.gene1->start, fusion.gene1->end, padding, rules);
+	index.find(fusion.contig2, fusion.gene2->start, fusion.gene2->end, padding, rules);
 
-		// assign fusions within a window of ...bps to the same bin
-		// for fast lookup of fusions by coordinate
-		genome_bins_t genome_bins;
-		get_genome_bins_from_range(fusion->second.contig1, fusion->second.breakpoint1, fusion->second.breakpoint1, genome_bins);
-		get_genome_bins_from_range(fusion->second.contig2, fusion->second.breakpoint2, fusion->second.breakpoint2, genome_bins);
-		get_genome_bins_from_range(fusion->second.contig1, fusion->second.gene1->start, fusion->second.gene1->end, genome_bins);
-		get_genome_bins_from_range(fusion->second.contig2, fusion->second.gene2->start, fusion->second.gene2->end, genome_bins);
-		for (auto genome_bin = genome_bins.begin(); genome_bin != genome_bins.end(); ++genome_bin)
-			fusions_by_coordinate[*genome_bin].insert(&(fusion->second));
-	}
+	// a rule may be found multiple times, when it is near several of the regions
+	sort(rules.begin(), rules.end());
+	rules.erase(unique(rules.begin(), rules.end()), rules.end());
+}
 
-	// load blacklist from file
+void load_blacklist(const string& blacklist_file_path, const contigs_t& contigs, const unordered_map<string,gene_t>& genes, blacklist_t& blacklist) {
 	autodecompress_file_t blacklist_file(blacklist_file_path);
 	string line;
 	while (blacklist_file.getline(line)) {
@@ -266,27 +290,37 @@ unsigned int filter_blacklisted_ranges(fusions_t& fusions, const string& blackli
 		if (!parse_blacklist_item(range1, item1, contigs, genes, false) ||
 		    !parse_blacklist_item(range2, item2, contigs, genes, true))
 			continue;
+		blacklist.rules.push_back(make_pair(item1, item2));
 
-		// find all fusions with breakpoints in the vicinity of the blacklist items
-		genome_bins_t genome_bins;
+		// index the rule by the coordinates of its items (keywords have no coordinates)
 		if (item1.type == BLACKLIST_POSITION || item1.type == BLACKLIST_RANGE || item1.type == BLACKLIST_GENE)
-			get_genome_bins_from_range(item1.contig, item1.start-max_mate_gap, item1.end+max_mate_gap, genome_bins);
+			blacklist.index.add(blacklist.rules.size()-1, item1.contig, item1.start, item1.end);
 		if (item2.type == BLACKLIST_POSITION || item2.type == BLACKLIST_RANGE || item2.type == BLACKLIST_GENE)
-			get_genome_bins_from_range(item2.contig, item2.start-max_mate_gap, item2.end+max_mate_gap, genome_bins);
-		for (auto genome_bin = genome_bins.begin(); genome_bin != genome_bins.end(); ++genome_bin) {
-			auto fusions_near_coordinate = fusions_by_coordinate.find(*genome_bin);
-			if (fusions_near_coordinate != fusions_by_coordinate.end()) {
-				for (auto fusion = fusions_near_coordinate->second.begin(); fusion != fusions_near_coordinate->second.end();) {
-					if (matches_blacklist_item(item1, **fusion, 1, max_mate_gap, evalue_cutoff) &&
-					    matches_blacklist_item(item2, **fusion, 2, max_mate_gap, evalue_cutoff) ||
-					    matches_blacklist_item(item1, **fusion, 2, max_mate_gap, evalue_cutoff) &&
-					    matches_blacklist_item(item2, **fusion, 1, max_mate_gap, evalue_cutoff)) {
-						(**fusion).filter = FILTER_blacklist;
-						fusions_near_coordinate->second.erase(fusion++); // remove fusion from index, so we don't check it again
-					} else {
-						++fusion;
-					}
-				}
+			blacklist.index.add(blacklist.rules.size()-1, item2.contig, item2.start, item2.end);
+	}
+	blacklist.index.compile();
+}
+
+unsigned int filter_blacklisted_ranges(fusions_t& fusions, const blacklist_t& blacklist, const float evalue_cutoff, const int max_mate_gap) {
+
+	for (fusions_t::iterator fusion = fusions.begin(); fusion != fusions.end(); ++fusion) {
+
+		if (fusion->second.filter != FILTER_none && fusion->second.closest_genomic_breakpoint1 < 0)
+			continue; // fusion has already been filtered and won't be recovered by the 'genomic_support' filter
+		count_work_of_fusion(fusion->second);
+
+		// find all blacklist items in the vicinity of the breakpoints
+		vector<unsigned int> candidates;
+		find_rules_near_fusion(fusion->second, blacklist.index, max_mate_gap, candidates);
+		for (auto candidate = candidates.begin(); candidate != candidates.end(); ++candidate) {
+			const blacklist_item_t& item1 = blacklist.rules[*candidate].first;
+			const blacklist_item_t& item2 = blacklist.rules[*candidate].second;
+			if (matches_blacklist_item(item1, fusion->second, 1, max_mate_gap, evalue_cutoff) &&
+			    matches_blacklist_item(item2, fusion->second, 2, max_mate_gap, evalue_cutoff) ||
+			    matches_blacklist_item(item1, fusion->second, 2, max_mate_gap, evalue_cutoff) &&
+			    matches_blacklist_item(item2, fusion->second, 1, max_mate_gap, evalue_cutoff)) {
+				fusion->second.filter = FILTER_blacklist;
+				break;
 			}
 		}
 	}
@@ -25,11 +25,41 @@ bool parse_blacklist_item(const string& text, blacklist_item_t& blacklist_item,
 // check if the breakpoint of a fusion match an entry in the blacklist
 bool matches_blacklist_item(const blacklist_item_t& blacklist_item, const fusion_t& fusion, const unsigned char which_breakpoint, const int max_mate_gap, const float evalue_cutoff = 0);
 
-// divide the genome into fixed size bins
-typedef tuple<contig_t,position_t> genome_bin_t;
-typedef vector<genome_bin_t> genome_bins_t;
-void get_genome_bins_from_range(const contig_t contig, const position_t start, const position_t end, genome_bins_t& genome_bins);
+// index of the genomic ranges referenced by rules (blacklist, known fusions, tags)
+// the ranges are compiled into a vector sorted by contig and start, such that the rules
+// near a given region can be looked up by binary search
+// two ranges are considered near each other, if they touch a common bin of a genome divided into fixed size bins
+class genome_range_index_t {
+	private:
+		struct range_t {
+			contig_t contig;
+			position_t start;
+			position_t end;
+			position_t max_end; // largest end of all ranges on the same contig up to this one
+			unsigned int rule;
+			bool operator<(const range_t& x) const { return contig < x.contig || contig == x.contig && start < x.start; };
+		};
+		vector<range_t> ranges;
+	public:
+		void add(const unsigned int rule, const contig_t contig, const position_t start, const position_t end);
+		void compile();
+		// find rules with ranges near the given region; the ranges of the rules are extended by the given padding
+		void find(const contig_t contig, const position_t start, const position_t end, const int padding, vector<unsigned int>& rules) const;
+};
+
+// a list of rules indexed by the coordinates of their ranges
+template <class T> struct indexed_rules_t {
+	vector<T> rules;
+	genome_range_index_t index;
+};
+
+// find the rules with ranges near the breakpoints or the genes of a fusion
+void find_rules_near_fusion(const fusion_t& fusion, const genome_range_index_t& index, const int padding, vector<unsigned int>& rules);
+
+typedef indexed_rules_t< pair<blacklist_item_t,blacklist_item_t> > blacklist_t;
+
+void load_blacklist(const string& blacklist_file_path, const contigs_t& contigs, const unordered_map<string,gene_t>& genes, blacklist_t& blacklist);
 
-unsigned int filter_blacklisted_ranges(fusions_t& fusions, const string& blacklist_file_path, const contigs_t& contigs, const unordered_map<string,gene_t>& genes, const float evalue_cutoff, const int max_mate_gap);
+unsigned int filter_blacklisted_ranges(fusions_t& fusions, const blacklist_t& blacklist, const float evalue_cutoff, const int max_mate_gap);
 
 #endif /* FILTER_BLACKLISTED_RANGES_H */
@@ -3,8 +3,13 @@
 #include <map>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
+#include "kstring.h"
+#include "tbx.h"
+#include "vcf.h"
 #include "common.hpp"
+#include "sample_log.hpp"
 #include "annotation.hpp"
 #include "read_compressed_file.hpp"
 #include "read_stats.hpp"
@@ -77,93 +82,214 @@ bool is_genomic_breakpoint_close_enough(const direction_t direction, const posit
 	}
 }
 
-unsigned int mark_genomic_support(fusions_t& fusions, const string& genomic_breakpoints_file_path, const contigs_t& contigs, const int max_distance) {
+// index structure for genomic breakpoints
+typedef unordered_map< tuple<contig_t, contig_t, direction_t, direction_t>, map< position_t/*breakpoint1*/, vector<position_t/*breakpoint2*/> > > genomic_breakpoints_t;
+
+// parse a line of the genomic breakpoints file and add the breakpoints to the index
+void parse_genomic_breakpoint(const string& line, const contigs_t& contigs, genomic_breakpoints_t& genomic_breakpoints) {
+
+	// try to parse line as Arriba's four-column format (contig1:position1\tcontig2:position2\tdirection1\tdirection2)
+	tsv_stream_t tsv(line);
+	string breakpoint1, breakpoint2;
+	string string_direction1, string_direction2;
+	tsv >> breakpoint1 >> breakpoint2 >> string_direction1 >> string_direction2;
+	contig_t contig1, contig2;
+	position_t position1, position2;
+	direction_t direction1, direction2;
+	string vcf_sv_type = "";
+	if (!(parse_breakpoint(breakpoint1, contigs, contig1, position1) &&
+	      parse_breakpoint(breakpoint2, contigs, contig2, position2) &&
+	      parse_direction(string_direction1, direction1) &&
+	      parse_direction(string_direction2, direction2))) {
+
+		// parsing as Arriba's four-column format failed => try VCF
+		tsv_stream_t tsv2(line);
+		string vcf_chrom, vcf_pos, vcf_alt, vcf_info, vcf_filter, ignore;
+		tsv2 >> vcf_chrom >> vcf_pos >> ignore >> ignore >> vcf_alt >> ignore >> vcf_filter >> vcf_info;
+		if (!parse_vcf_info(vcf_info, "SVTYPE", vcf_sv_type))
+			goto failed_to_parse_line;
+		if (vcf_sv_type == "BND") {
+			size_t opening_bracket = vcf_alt.find('[');
+			size_t closing_bracket = vcf_alt.find(']');
+			char bracket = (opening_bracket < closing_bracket) ? '[' : ']';
+			size_t bracket_pos1 = min(opening_bracket, closing_bracket);
+			size_t bracket_pos2 = vcf_alt.find(bracket, bracket_pos1 + 1);
+			if (bracket_pos1 >= vcf_alt.size() || bracket_pos2 >= vcf_alt.size())
+				if (!vcf_alt.empty() && (vcf_alt[0] == '.' || vcf_alt[vcf_alt.size()-1] == '.')) // is it a single breakend?
+					return; // silently ignore single breakend
+				else
+					goto failed_to_parse_line;
+			direction1 = (bracket_pos1 == 0) ? UPSTREAM : DOWNSTREAM;
+			direction2 = (bracket == '[') ? UPSTREAM : DOWNSTREAM;
+			breakpoint2 = vcf_alt.substr(bracket_pos1 + 1, bracket_pos2 - bracket_pos1 - 1);
+		} else {
+			string vcf_info_end;
+			if (!parse_vcf_info(vcf_info, "END", vcf_info_end))
+				goto failed_to_parse_line;
+			breakpoint2 = vcf_chrom + ":" + vcf_info_end;
+			if (vcf_sv_type == "INV") {
+				direction1 = DOWNSTREAM;
+				direction2 = DOWNSTREAM;
+			} else if (vcf_sv_type == "DEL") {
+				direction1 = DOWNSTREAM;
+				direction2 = UPSTREAM;
+			} else if (vcf_sv_type == "DUP") {
+				direction1 = UPSTREAM;
+				direction2 = DOWNSTREAM;
+			} else
+				goto failed_to_parse_line;
+		}
+		if (!parse_breakpoint(vcf_chrom + ":" + vcf_pos, contigs, contig1, position1) ||
+		    !parse_breakpoint(breakpoint2, contigs, contig2, position2))
+			goto failed_to_parse_line;
 
-	// make index structure for genomic breakpoints
-	unordered_map< tuple<contig_t, contig_t, direction_t, direction_t>, map< position_t/*breakpoint1*/, vector<position_t/*breakpoint2*/> > > genomic_breakpoints;
+		if (vcf_filter != "PASS")
+			return;
+	}
 
-	// load genomic breakpoints from file into index
-	autodecompress_file_t genomic_breakpoints_file(genomic_breakpoints_file_path);
-	string line;
-	while (genomic_breakpoints_file.getline(line)) {
-		if (!line.empty() && line[0] != '#') {
-
-			// try to parse line as Arriba's four-column format (contig1:position1\tcontig2:position2\tdirection1\tdirection2)
-			tsv_stream_t tsv(line);
-			string breakpoint1, breakpoint2;
-			string string_direction1, string_direction2;
-			tsv >> breakpoint1 >> breakpoint2 >> string_direction1 >> string_direction2;
-			contig_t contig1, contig2;
-			position_t position1, position2;
-			direction_t direction1, direction2;
-			string vcf_sv_type = "";
-			if (!(parse_breakpoint(breakpoint1, contigs, contig1, position1) &&
-			      parse_breakpoint(breakpoint2, contigs, contig2, position2) &&
-			      parse_direction(string_direction1, direction1) &&
-			      parse_direction(string_direction2, direction2))) {
-
-				// parsing as Arriba's four-column format failed => try VCF
-				tsv_stream_t tsv2(line);
-				string vcf_chrom, vcf_pos, vcf_alt, vcf_info, vcf_filter, ignore;
-				tsv2 >> vcf_chrom >> vcf_pos >> ignore >> ignore >> vcf_alt >> ignore >> vcf_filter >> vcf_info;
-				if (!parse_vcf_info(vcf_info, "SVTYPE", vcf_sv_type))
-					goto failed_to_parse_line;
-				if (vcf_sv_type == "BND") {
-					size_t opening_bracket = vcf_alt.find('[');
-					size_t closing_bracket = vcf_alt.find(']');
-					char bracket = (opening_bracket < closing_bracket) ? '[' : ']';
-					size_t bracket_pos1 = min(opening_bracket, closing_bracket);
-					size_t bracket_pos2 = vcf_alt.find(bracket, bracket_pos1 + 1);
-					if (bracket_pos1 >= vcf_alt.size() || bracket_pos2 >= vcf_alt.size())
-						if (!vcf_alt.empty() && (vcf_alt[0] == '.' || vcf_alt[vcf_alt.size()-1] == '.')) // is it a single breakend?
-							continue; // silently ignore single breakend
-						else
-							goto failed_to_parse_line;
-					direction1 = (bracket_pos1 == 0) ? UPSTREAM : DOWNSTREAM;
-					direction2 = (bracket == '[') ? UPSTREAM : DOWNSTREAM;
-					breakpoint2 = vcf_alt.substr(bracket_pos1 + 1, bracket_pos2 - bracket_pos1 - 1);
-				} else {
-					string vcf_info_end;
-					if (!parse_vcf_info(vcf_info, "END", vcf_info_end))
-						goto failed_to_parse_line;
-					breakpoint2 = vcf_chrom + ":" + vcf_info_end;
-					if (vcf_sv_type == "INV") {
-						direction1 = DOWNSTREAM;
-						direction2 = DOWNSTREAM;
-					} else if (vcf_sv_type == "DEL") {
-						direction1 = DOWNSTREAM;
-						direction2 = UPSTREAM;
-					} else if (vcf_sv_type == "DUP") {
-						direction1 = UPSTREAM;
-						direction2 = DOWNSTREAM;
-					} else
-						goto failed_to_parse_line;
-				}
-				if (!parse_breakpoint(vcf_chrom + ":" + vcf_pos, contigs, contig1, position1) ||
-				    !parse_breakpoint(breakpoint2, contigs, contig2, position2))
-					goto failed_to_parse_line;
+	// make sure we index by the smaller coordinate
+	if (contig2 < contig1 || contig2 == contig1 && position2 < position1) {
+		swap(contig1, contig2);
+		swap(position1, position2);
+		swap(direction1, direction2);
+	}
 
-				if (vcf_filter != "PASS")
-					continue;
-			}
+	// add genomic breakpoint to index
+	genomic_breakpoints[make_tuple(contig1, contig2, direction1, direction2)][position1].push_back(position2);
+	// the VCF SVTYPE "INV" encodes two separate breakpoints
+	if (vcf_sv_type == "INV")
+		genomic_breakpoints[make_tuple(contig1, contig2, UPSTREAM, UPSTREAM)][position1].push_back(position2);
 
-			// make sure we index by the smaller coordinate
-			if (contig2 < contig1 || contig2 == contig1 && position2 < position1) {
-				swap(contig1, contig2);
-				swap(position1, position2);
-				swap(direction1, direction2);
-			}
+	return;
+	failed_to_parse_line:
+		print_warning("failed to parse line: " + line);
+}
 
-			// add genomic breakpoint to index
-			genomic_breakpoints[make_tuple(contig1, contig2, direction1, direction2)][position1].push_back(position2);
-			// the VCF SVTYPE "INV" encodes two separate breakpoints
-			if (vcf_sv_type == "INV")
-				genomic_breakpoints[make_tuple(contig1, contig2, UPSTREAM, UPSTREAM)][position1].push_back(position2);
+// determine the region in which a genomic breakpoint must be located to support a fusion breakpoint
+// (same boundaries as in is_genomic_breakpoint_close_enough())
+void get_genomic_breakpoint_window(const direction_t direction, const position_t fusion_breakpoint, const gene_t gene, const int max_distance, position_t& start, position_t& end) {
+	if (direction == UPSTREAM) {
+		start = ((gene->is_dummy) ? fusion_breakpoint : gene->start) - max_distance;
+		end = fusion_breakpoint + 5;
+	} else {
+		start = fusion_breakpoint - 5;
+		end = ((gene->is_dummy) ? fusion_breakpoint : gene->end) + max_distance;
+	}
+	start = max(start, 0);
+}
+
+// load only those genomic breakpoints which are near the breakpoints of the given fusions,
+// provided that the file is a bgzip-compressed VCF/TSV file with a tabix/CSI index or a BCF file with a CSI index
+// returns false, if the file is not indexed
+bool load_indexed_genomic_breakpoints(const string& genomic_breakpoints_file_path, const fusions_t& fusions, const contigs_t& contigs, const int max_distance, genomic_breakpoints_t& genomic_breakpoints) {
+
+	htsFile* genomic_breakpoints_file = hts_open(genomic_breakpoints_file_path.c_str(), "r");
+	crash(genomic_breakpoints_file == NULL, "failed to open '" + genomic_breakpoints_file_path + "'");
+
+	// load index, if there is one
+	const bool is_bcf = genomic_breakpoints_file->format.format == bcf;
+	bcf_hdr_t* bcf_header = NULL;
+	hts_idx_t* bcf_index = NULL;
+	tbx_t* tabix_index = NULL;
+	if (is_bcf) {
+		bcf_header = bcf_hdr_read(genomic_breakpoints_file);
+		crash(bcf_header == NULL, "failed to read header of '" + genomic_breakpoints_file_path + "'");
+		bcf_index = bcf_index_load3(genomic_breakpoints_file_path.c_str(), NULL, HTS_IDX_SILENT_FAIL);
+		crash(bcf_index == NULL, "BCF file must be indexed: " + genomic_breakpoints_file_path);
+	} else if (genomic_breakpoints_file->format.compression == bgzf) {
+		tabix_index = tbx_index_load3(genomic_breakpoints_file_path.c_str(), NULL, HTS_IDX_SILENT_FAIL);
+	}
+	if (!is_bcf && tabix_index == NULL) {
+		hts_close(genomic_breakpoints_file);
+		return false;
+	}
+
+	// map contigs to the sequence IDs of the index
+	int sequence_count = 0;
+	const char** sequence_names = (is_bcf) ? bcf_hdr_seqnames(bcf_header, &sequence_count) : tbx_seqnames(tabix_index, &sequence_count);
+	unordered_map<contig_t,int> sequence_ids;
+	for (int sequence_id = 0; sequence_id < sequence_count; ++sequence_id) {
+		contigs_t::const_iterator contig = contigs.find(removeChr(sequence_names[sequence_id]));
+		if (contig != contigs.end())
+			sequence_ids[contig->second] = sequence_id;
+	}
+	free(sequence_names);
+
+	// collect the regions around the fusion breakpoints in which genomic breakpoints may be located
+	// a structural variant is reported at the position of either one of its breakpoints,
+	// so the regions around both breakpoints of a fusion must be searched
+	map< contig_t, vector< pair<position_t,position_t> > > regions;
+	for (fusions_t::const_iterator fusion = fusions.begin(); fusion != fusions.end(); ++fusion) {
+		position_t start, end;
+		get_genomic_breakpoint_window(fusion->second.direction1, fusion->second.breakpoint1, fusion->second.gene1, max_distance, start, end);
+		regions[fusion->second.contig1].push_back(make_pair(start, end));
+		get_genomic_breakpoint_window(fusion->second.direction2, fusion->second.breakpoint2, fusion->second.gene2, max_distance, start, end);
+		regions[fusion->second.contig2].push_back(make_pair(start, end));
+	}
+
+	// query the index for each region
+	unordered_set<string> parsed_lines; // structural variants which overlap several regions are returned multiple times
+	kstring_t line = { 0, 0, NULL };
+	bcf1_t* bcf_record = bcf_init();
+	for (auto contig = regions.begin(); contig != regions.end(); ++contig) {
+
+		auto sequence_id = sequence_ids.find(contig->first);
+		if (sequence_id == sequence_ids.end())
+			continue; // there are no genomic breakpoints on this contig
+
+		sort(contig->second.begin(), contig->second.end());
+		for (auto region = contig->second.begin(); region != contig->second.end();) {
+
+			// merge overlapping regions
+			position_t start = region->first;
+			position_t end = region->second;
+			for (++region; region != contig->second.end() && region->first <= end; ++region)
+				end = max(end, region->second);
+
+			hts_itr_t* iterator = (is_bcf) ? bcf_itr_queryi(bcf_index, sequence_id->second, start, end + 1) : tbx_itr_queryi(tabix_index, sequence_id->second, start, end + 1);
+			crash(iterator == NULL, "failed to query '" + genomic_breakpoints_file_path + "'");
+			while (true) {
+				line.l = 0;
+				if (is_bcf) {
+					if (bcf_itr_next(genomic_breakpoints_file, iterator, bcf_record) < 0)
+						break;
+					crash(vcf_format(bcf_header, bcf_record, &line) < 0, "failed to convert BCF record to VCF: " + genomic_breakpoints_file_path);
+					if (line.l > 0 && line.s[line.l-1] == '\n')
+						line.s[--line.l] = '\0';
+				} else {
+					if (tbx_itr_next(genomic_breakpoints_file, tabix_index, iterator, &line) < 0)
+						break;
+				}
+				if (line.l > 0 && line.s[0] != '#' && parsed_lines.insert(line.s).second)
+					parse_genomic_breakpoint(line.s, contigs, genomic_breakpoints);
+			}
+			hts_itr_destroy(iterator);
 		}
+	}
+	bcf_destroy(bcf_record);
+	free(line.s);
+
+	if (tabix_index != NULL)
+		tbx_destroy(tabix_index);
+	if (bcf_index != NULL)
+		hts_idx_destroy(bcf_index);
+	if (bcf_header != NULL)
+		bcf_hdr_destroy(bcf_header);
+	hts_close(genomic_breakpoints_file);
+	return true;
+}
+
+unsigned int mark_genomic_support(fusions_t& fusions, const string& genomic_breakpoints_file_path, const contigs_t& contigs, const int max_distance) {
 
-		continue;
-		failed_to_parse_line:
-			cerr << "WARNING: failed to parse line: " << line << endl;
+	// load genomic breakpoints from file into index
+	// if the file is indexed, only the regions around the fusion breakpoints are read
+	genomic_breakpoints_t genomic_breakpoints;
+	if (!load_indexed_genomic_breakpoints(genomic_breakpoints_file_path, fusions, contigs, max_distance, genomic_breakpoints)) {
+		autodecompress_file_t genomic_breakpoints_file(genomic_breakpoints_file_path);
+		string line;
+		while (genomic_breakpoints_file.getline(line))
+			if (!line.empty() && line[0] != '#')
+				parse_genomic_breakpoint(line, contigs, genomic_breakpoints);
 	}
 
 	// for each fusion, check if it is supported by a genomic breakpoint
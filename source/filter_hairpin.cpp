@@ -26,7 +26,7 @@ bool is_breakpoint_within_aligned_segment(const position_t breakpoint, const ali
 	return false;
 }
 
-unsigned int filter_hairpin(chimeric_alignments_t& chimeric_alignments, exon_annotation_index_t& exon_annotation_index, const int max_mate_gap) {
+unsigned int filter_hairpin(chimeric_alignments_t& chimeric_alignments, const exon_annotation_index_t& exon_annotation_index, const int max_mate_gap) {
 
 	unsigned int remaining = 0;
 	for (chimeric_alignments_t::iterator chimeric_alignment = chimeric_alignments.begin(); chimeric_alignment != chimeric_alignments.end(); ++chimeric_alignment) {
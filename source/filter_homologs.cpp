@@ -12,6 +12,8 @@ using namespace std;
 
 bool is_homolog(const gene_t gene1, const gene_t gene2, const kmer_indices_t& kmer_indices, const char kmer_length, const assembly_t& assembly, const float max_identity_fraction) {
 
+	count_operation(OPERATION_homolog_evaluations);
+
 	// we look for kmers of length <kmer_length> + <extended_kmer_length> that are present in both genes
 	const char extended_kmer_length = 8;
 
@@ -46,6 +48,7 @@ bool is_homolog(const gene_t gene1, const gene_t gene2, const kmer_indices_t& km
 		kmer_index_t::const_iterator kmer_hits = kmer_indices[big_gene->contig].find(kmer_to_int(small_gene_sequence, pos, kmer_length));
 		if (kmer_hits != kmer_indices[big_gene->contig].end()) {
 			for (auto kmer_hit = lower_bound(kmer_hits->second.begin(), kmer_hits->second.end(), big_gene->start); kmer_hit != kmer_hits->second.end() && *kmer_hit <= big_gene->end; ++kmer_hit) {
+				count_operation(OPERATION_kmer_hits);
 				if (small_gene->contig != big_gene->contig || *kmer_hit < small_gene->start || *kmer_hit > small_gene->end) {
 					if (strncmp(assembly.at(big_gene->contig).c_str()+*kmer_hit+kmer_length, small_gene_sequence.c_str()+pos+kmer_length, extended_kmer_length) == 0) {
 						matching_kmers++;
@@ -76,6 +79,7 @@ unsigned int filter_homologs(fusions_t& fusions, const kmer_indices_t& kmer_indi
 
 		if ((**fusion).filter != FILTER_none)
 			continue;
+		count_work_of_fusion(**fusion);
 
 		if (is_homolog((**fusion).gene1, (**fusion).gene2, kmer_indices, kmer_length, assembly, max_identity_fraction)) {
 
@@ -13,16 +13,16 @@ unsigned int filter_low_coverage_viral_contigs(chimeric_alignments_t& chimeric_a
 	// compute average coverage for each viral contig
 	vector<float> average_coverage(viral_contigs.size());
 	for (contig_t contig = 0; contig < viral_contigs.size(); ++contig) {
-		for (auto window = coverage.coverage[contig].begin(); window != coverage.coverage[contig].end(); ++window)
-			average_coverage[contig] += *window;
-		average_coverage[contig] /= coverage.coverage[contig].size();
+		for (unsigned int window = 0; window < coverage.get_window_count(contig); ++window)
+			average_coverage[contig] += coverage.get_window_coverage(contig, window);
+		average_coverage[contig] /= coverage.get_window_count(contig);
 	}
 
 	// for each viral contig, determine fraction that is covered at least as highly as 0.05 * average coverage
 	vector<float> windows_with_sufficient_coverage(viral_contigs.size());
 	for (contig_t contig = 0; contig < viral_contigs.size(); ++contig)
-		for (auto window = coverage.coverage[contig].begin(); window != coverage.coverage[contig].end(); ++window)
-			if (*window > 0.05 * average_coverage[contig])
+		for (unsigned int window = 0; window < coverage.get_window_count(contig); ++window)
+			if (coverage.get_window_coverage(contig, window) > 0.05 * average_coverage[contig])
 				windows_with_sufficient_coverage[contig]++;
 
 	unsigned int remaining = 0;
@@ -34,8 +34,8 @@ unsigned int filter_low_coverage_viral_contigs(chimeric_alignments_t& chimeric_a
 		// remove alignments mapping to viral contigs with focal coverage
 		for (mates_t::iterator mate = chimeric_alignment->second.begin(); mate != chimeric_alignment->second.end(); ++mate) {
 			if (viral_contigs[mate->contig]) {
-				if (windows_with_sufficient_coverage[mate->contig] / coverage.coverage[mate->contig].size() < min_covered_fraction ||
-				    COVERAGE_RESOLUTION * windows_with_sufficient_coverage[mate->contig] <= min_covered_bases) {
+				if (windows_with_sufficient_coverage[mate->contig] / coverage.get_window_count(mate->contig) < min_covered_fraction ||
+				    coverage.get_resolution() * windows_with_sufficient_coverage[mate->contig] <= min_covered_bases) {
 					chimeric_alignment->second.filter = FILTER_low_coverage_viral_contigs;
 					goto next_read;
 				}
@@ -10,7 +10,6 @@
 
 using namespace std;
 
-typedef set<position_t> splice_sites_t;
 typedef unordered_map<gene_t,splice_sites_t> splice_sites_by_gene_t;
 
 void get_downstream_splice_sites(const gene_t gene, const exon_annotation_index_t& exon_annotation_index, splice_sites_t& splice_sites) {
@@ -30,11 +29,11 @@ void get_downstream_splice_sites(const gene_t gene, const exon_annotation_index_
 	}
 }
 
-kmer_as_int_t kmer_to_int(const string& kmer, const string::size_type position, const char kmer_length) {
+kmer_as_int_t kmer_to_int(const char* kmer, const string::size_type position, const char kmer_length) {
 	kmer_as_int_t result = 0;
 	for (char base = 0; base < kmer_length; ++base) {
 		result = result<<2;
-		switch (kmer.c_str()[position + base]) {
+		switch (kmer[position + base]) {
 			case 'T': result += 0; break;
 			case 'G': result += 1; break;
 			case 'C': result += 2; break;
@@ -63,7 +62,7 @@ void make_kmer_index(const fusions_t& fusions, const assembly_t& assembly, int p
 
 	// store positions of kmers in hash
 	for (gene_set_t::iterator gene = genes_to_filter.begin(); gene != genes_to_filter.end(); ++gene) {
-		const string& contig_sequence = assembly.at((**gene).contig);
+		const contig_sequence_t& contig_sequence = assembly.at((**gene).contig);
 		if ((int) kmer_indices.size() <= (**gene).contig)
 			kmer_indices.resize((**gene).contig+1);
 		position_t gene_start = max((**gene).start - padding, 0);
@@ -83,7 +82,10 @@ void make_kmer_index(const fusions_t& fusions, const assembly_t& assembly, int p
 		}
 }
 
-bool align(int score, const string& read_sequence, int read_pos, const string& contig_sequence, const int gene_pos, const position_t gene_start, const position_t gene_end, const kmer_index_t& kmer_index, const char kmer_length, const splice_sites_t& splice_sites, const int min_score, int max_deletions) {
+bool align(int score, const string& read_sequence, int read_pos, const contig_sequence_t& contig_sequence, const int gene_pos, const position_t gene_start, const position_t gene_end, const kmer_index_t& kmer_index, const char kmer_length, const splice_sites_t& splice_sites, const int min_score, int max_deletions) {
+
+	count_operation(OPERATION_align_calls);
+	track_align_depth();
 
 	int skipped_bases = 0;
 
@@ -99,6 +101,7 @@ bool align(int score, const string& read_sequence, int read_pos, const string& c
 
 		for (auto kmer_hit = lower_bound(kmer_hits->second.begin(), kmer_hits->second.end(), gene_pos); kmer_hit != kmer_hits->second.end() && *kmer_hit < gene_end; ++kmer_hit) {
 
+			count_operation(OPERATION_kmer_hits);
 			int extended_score = score + kmer_length;
 			if (read_pos == skipped_bases) // so far, all bases at the beginning of the read have been skipped
 				extended_score += skipped_bases; // this effectively removes any penalties on leading mismatches (as in local alignment)
@@ -272,6 +275,7 @@ unsigned int filter_mismappers(fusions_t& fusions, const kmer_indices_t& kmer_in
 
 		if (fusion->second.filter != FILTER_none)
 			continue;
+		count_work_of_fusion(fusion->second);
 
 		// re-align split reads
 		vector<chimeric_alignments_t::iterator> all_split_reads;
@@ -317,8 +321,8 @@ unsigned int filter_mismappers(fusions_t& fusions, const kmer_indices_t& kmer_in
 			float clipped_fraction1 = ((float) mate1.preclipping() + mate1.postclipping()) / mate1.sequence.size();
 			float clipped_fraction2 = ((float) mate2.preclipping() + mate2.postclipping()) / mate2.sequence.size();
 
-			if (align_both_strands(mate1.sequence, mate1.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, mate1.start, mate1.end, kmer_indices, assembly, exon_annotation_index, splice_sites_by_gene, mate2.genes, kmer_length, min(min_align_fraction, min_align_fraction*(1-clipped_fraction1))) ||
-			    align_both_strands(mate2.sequence, mate2.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, mate2.start, mate2.end, kmer_indices, assembly, exon_annotation_index, splice_sites_by_gene, mate1.genes, kmer_length, min(min_align_fraction, min_align_fraction*(1-clipped_fraction2)))) {
+			if (align_both_strands(mate1.sequence.str(), mate1.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, mate1.start, mate1.end, kmer_indices, assembly, exon_annotation_index, splice_sites_by_gene, mate2.genes, kmer_length, min(min_align_fraction, min_align_fraction*(1-clipped_fraction1))) ||
+			    align_both_strands(mate2.sequence.str(), mate2.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, mate2.start, mate2.end, kmer_indices, assembly, exon_annotation_index, splice_sites_by_gene, mate1.genes, kmer_length, min(min_align_fraction, min_align_fraction*(1-clipped_fraction2)))) {
 				(**chimeric_alignment).second.filter = FILTER_mismappers;
 			}
 		}
@@ -1,6 +1,7 @@
 #ifndef FILTER_MISMAPPER_H
 #define FILTER_MISMAPPER_H 1
 
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -13,10 +14,15 @@ using namespace std;
 typedef unsigned int kmer_as_int_t; // represent kmer as integer
 typedef unordered_map< kmer_as_int_t, vector<int> > kmer_index_t; // store coordinates of kmers
 typedef vector<kmer_index_t> kmer_indices_t; // one index per contig
+typedef set<position_t> splice_sites_t;
 
-kmer_as_int_t kmer_to_int(const string& kmer, const string::size_type position, const char kmer_length);
+kmer_as_int_t kmer_to_int(const char* kmer, const string::size_type position, const char kmer_length);
+inline kmer_as_int_t kmer_to_int(const string& kmer, const string::size_type position, const char kmer_length) { return kmer_to_int(kmer.c_str(), position, kmer_length); }
+inline kmer_as_int_t kmer_to_int(const contig_sequence_t& kmer, const string::size_type position, const char kmer_length) { return kmer_to_int(kmer.c_str(), position, kmer_length); }
 void make_kmer_index(const fusions_t& fusions, const assembly_t& assembly, int padding, const char kmer_length, kmer_indices_t& kmer_indices);
 
+bool align(int score, const string& read_sequence, int read_pos, const contig_sequence_t& contig_sequence, const int gene_pos, const position_t gene_start, const position_t gene_end, const kmer_index_t& kmer_index, const char kmer_length, const splice_sites_t& splice_sites, const int min_score, int max_deletions);
+
 unsigned int filter_mismappers(fusions_t& fusions, const kmer_indices_t& kmer_indices, const char kmer_length, const assembly_t& assembly, const exon_annotation_index_t& exon_annotation_index, const float max_mismapper_fraction, const int max_mate_gap);
 
 #endif /* FILTER_MISMAPPERS_H */
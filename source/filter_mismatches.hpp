@@ -1,11 +1,14 @@
 #ifndef FILTER_MISMATCHES_H
 #define FILTER_MISMATCHES_H 1
 
+#include <string>
 #include <vector>
 #include "common.hpp"
 
 using namespace std;
 
+void count_mismatches(const alignment_t& alignment, const string& sequence, const assembly_t& assembly, unsigned int& mismatches, unsigned int& alignment_length);
+
 unsigned int filter_mismatches(chimeric_alignments_t& chimeric_alignments, const assembly_t& assembly, const vector<bool>& interesting_contigs, const vector<bool>& viral_contigs, const float mismatch_probability, const float pvalue_cutoff);
 
 #endif /* FILTER_MISMATCHES_H */
@@ -64,11 +64,11 @@ int calculate_segment_score(const alignment_t& alignment, const string& sequence
 
 int calculate_alignment_score(const mates_t& mates, const exon_annotation_index_t& exon_annotation_index, const assembly_t& assembly) {
 
-	int score = calculate_segment_score(mates[MATE1], mates[MATE1].sequence, exon_annotation_index, assembly) +
-	            calculate_segment_score(mates[MATE2], mates[MATE2].sequence, exon_annotation_index, assembly);
+	int score = calculate_segment_score(mates[MATE1], mates[MATE1].sequence.str(), exon_annotation_index, assembly) +
+	            calculate_segment_score(mates[MATE2], mates[MATE2].sequence.str(), exon_annotation_index, assembly);
 
 	if (mates.size() == 3) { // has a supplementary alignment
-		score += calculate_segment_score(mates[SUPPLEMENTARY], (mates[SUPPLEMENTARY].strand == mates[SPLIT_READ].strand) ? mates[SPLIT_READ].sequence : dna_to_reverse_complement(mates[SPLIT_READ].sequence), exon_annotation_index, assembly);
+		score += calculate_segment_score(mates[SUPPLEMENTARY], (mates[SUPPLEMENTARY].strand == mates[SPLIT_READ].strand) ? mates[SPLIT_READ].sequence.str() : dna_to_reverse_complement(mates[SPLIT_READ].sequence.str()), exon_annotation_index, assembly);
 		// penalize if the read is not split at a splice site
 		if (!is_gap_at_splice_site((mates[SUPPLEMENTARY].strand == FORWARD) ? mates[SUPPLEMENTARY].end : mates[SUPPLEMENTARY].start, (mates[SUPPLEMENTARY].strand == FORWARD) ? DOWNSTREAM : UPSTREAM, mates[SUPPLEMENTARY].genes, exon_annotation_index) ||
 		    !is_gap_at_splice_site((mates[SPLIT_READ].strand == FORWARD) ? mates[SPLIT_READ].start : mates[SPLIT_READ].end, (mates[SPLIT_READ].strand == FORWARD) ? UPSTREAM : DOWNSTREAM, mates[SPLIT_READ].genes, exon_annotation_index))
@@ -1,10 +1,13 @@
 #ifndef FILTER_MULTIMAPPERS_H
 #define FILTER_MULTIMAPPERS_H 1
 
+#include <string>
 #include "common.hpp"
 
 using namespace std;
 
+int calculate_segment_score(const alignment_t& alignment, const string& sequence, const exon_annotation_index_t& exon_annotation_index, const assembly_t& assembly);
+
 unsigned int filter_multimappers(chimeric_alignments_t& chimeric_alignments, fusions_t& fusions, const exon_annotation_index_t& exon_annotation_index, const assembly_t& assembly);
 
 #endif /* FILTER_MULTIMAPPERS_H */
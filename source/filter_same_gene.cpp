@@ -4,7 +4,7 @@
 
 using namespace std;
 
-unsigned int filter_same_gene(chimeric_alignments_t& chimeric_alignments, exon_annotation_index_t& exon_annotation_index) {
+unsigned int filter_same_gene(chimeric_alignments_t& chimeric_alignments, const exon_annotation_index_t& exon_annotation_index) {
 	unsigned int remaining = 0;
 	for (chimeric_alignments_t::iterator chimeric_alignment = chimeric_alignments.begin(); chimeric_alignment != chimeric_alignments.end(); ++chimeric_alignment) {
 
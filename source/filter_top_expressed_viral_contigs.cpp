@@ -20,11 +20,11 @@ struct sort_contigs_by_expression_t {
 };
 
 // determine if viruses are related based on fraction of shared kmers in their genome
-bool related_viral_strains(const string& virus1, const string& virus2) {
+bool related_viral_strains(const contig_sequence_t& virus1, const contig_sequence_t& virus2) {
 
 	// choose smaller of the two viruses for making a list of its kmers
-	const string* small_virus = &virus1;
-	const string* big_virus = &virus2;
+	const contig_sequence_t* small_virus = &virus1;
+	const contig_sequence_t* big_virus = &virus2;
 	if (small_virus->size() > big_virus->size())
 		swap(small_virus, big_virus);
 
@@ -1,4 +1,7 @@
+#include <algorithm>
+#include <climits>
 #include <cmath>
+#include <functional>
 #include <iostream>
 #include <list>
 #include <string>
@@ -7,6 +10,7 @@
 #include <unordered_map>
 #include "sam.h"
 #include "common.hpp"
+#include "sample_log.hpp"
 #include "annotation.hpp"
 #include "fusions.hpp"
 
@@ -199,14 +203,221 @@ void predict_transcript_start(fusion_t& fusion) {
 	}
 }
 
+// rank reads by a hash of their names, such that the subsampled reads do not depend on the order of the input
+// the HI tag is ignored, such that all alignments of a multi-mapping read have the same rank
+unsigned long long int get_subsampling_rank(const string& read_name) {
+	const string::size_type hi_tag = read_name.find_last_of(',');
+	const string::size_type name_length = (hi_tag == string::npos) ? read_name.size() : hi_tag;
+	unsigned long long int hash = 14695981039346656037ULL; // FNV-1a
+	for (string::size_type i = 0; i < name_length; ++i)
+		hash = (hash ^ (unsigned char) read_name[i]) * 1099511628211ULL;
+	return hash;
+}
+
+// the filter of a fusion is FILTER_none, if any of the supporting reads passed all filters,
+// otherwise it is the filter of the first discarded read by name which is not a duplicate
+// the reads are not processed in the order of their names => remember the read which determined the filter
+void assign_filter_to_fusion(fusion_t& fusion, const bool is_new_fusion, const chimeric_alignments_t::iterator& chimeric_alignment, unordered_map<fusion_t*,chimeric_alignments_t::iterator>& filter_determining_reads) {
+	const filter_t filter = chimeric_alignment->second.filter;
+	if (is_new_fusion || filter == FILTER_none || fusion.filter == FILTER_duplicates ||
+	    fusion.filter != FILTER_none && filter != FILTER_duplicates && chimeric_alignment->first < filter_determining_reads[&fusion]->first) {
+		fusion.filter = filter;
+		if (filter != FILTER_none && filter != FILTER_duplicates)
+			filter_determining_reads[&fusion] = chimeric_alignment;
+	}
+}
 
-unsigned int find_fusions(chimeric_alignments_t& chimeric_alignments, fusions_t& fusions, exon_annotation_index_t& exon_annotation_index, const int max_mate_gap, const unsigned int subsampling_threshold) {
+bool sort_chimeric_alignments_by_name(const chimeric_alignments_t::iterator& x, const chimeric_alignments_t::iterator& y) {
+	return x->first < y->first;
+}
 
-	unordered_map< tuple<unsigned int/*gene1->id*/,unsigned int/*gene2->id*/,direction_t/*1*/,direction_t/*2*/>, vector< tuple<position_t/*breakpoint1*/,position_t/*breakpoint2*/,chimeric_alignments_t::iterator> > > discordant_mates_by_gene_pair; // contains the discordant mates for each pair of genes
+typedef tuple<position_t/*breakpoint1*/,position_t/*breakpoint2*/,chimeric_alignments_t::iterator,unsigned int/*rank*/> discordant_mate_t;
 
-	bool subsampled_fusions = false;
+bool sort_discordant_mates_by_breakpoint1(const discordant_mate_t& x, const discordant_mate_t& y) {
+	return get<0>(x) < get<0>(y);
+}
+
+bool sort_discordant_mates_by_breakpoint2(const discordant_mate_t& x, const discordant_mate_t& y) {
+	return get<1>(x) < get<1>(y);
+}
+
+bool discordant_mate_is_before_breakpoint2(const discordant_mate_t& discordant_mate, const position_t breakpoint2) {
+	return get<1>(discordant_mate) < breakpoint2;
+}
+
+bool breakpoint2_is_before_discordant_mate(const position_t breakpoint2, const discordant_mate_t& discordant_mate) {
+	return breakpoint2 < get<1>(discordant_mate);
+}
+
+// when at least one in this many mates of a gene pair matches a fusion, the mates are checked one by one in the order of their ranks
+const unsigned int DENSE_DISCORDANT_MATES = 32;
+
+// the range of mate breakpoints which a fusion accepts from its discordant mates
+struct discordant_mate_window_t {
+	fusion_t* fusion;
+	bool intragenic;
+	int max_overlap_with_breakpoint;
+	position_t min_breakpoint1;
+	position_t max_breakpoint1;
+	position_t min_breakpoint2;
+	position_t max_breakpoint2;
+	// within a group of windows with the same overlap, both ends of the mate1 range grow monotonically with the fusion breakpoint,
+	// such that the windows can be swept in this order
+	bool operator<(const discordant_mate_window_t& x) const {
+		return intragenic < x.intragenic ||
+		       intragenic == x.intragenic && (max_overlap_with_breakpoint < x.max_overlap_with_breakpoint ||
+		       max_overlap_with_breakpoint == x.max_overlap_with_breakpoint && (min_breakpoint1 < x.min_breakpoint1 ||
+		       min_breakpoint1 == x.min_breakpoint1 && max_breakpoint1 < x.max_breakpoint1));
+	};
+	bool same_group(const discordant_mate_window_t& x) const {
+		return intragenic == x.intragenic && max_overlap_with_breakpoint == x.max_overlap_with_breakpoint;
+	};
+};
+
+// the discordant mates of a pair of genes in the order of their ranks and the windows of the fusions between the genes
+struct discordant_mates_of_gene_pair_t {
+	vector<discordant_mate_t> by_rank;
+	vector<discordant_mate_window_t> windows;
+};
+
+// tournament tree over the discordant mates of a gene pair sorted by the breakpoint of mate2
+// every node holds the lowest rank and the number of the active mates beneath it, such that the active mates
+// in a range of mate2 breakpoints can be counted and retrieved in the order of their ranks
+class active_discordant_mates_t {
+	private:
+		unsigned int leaves;
+		vector<unsigned int> lowest_rank;
+		vector<unsigned int> active;
+		vector< pair<unsigned int/*lowest rank*/,unsigned int/*node*/> > queue; // heap of the nodes to be visited next
+		void enqueue(const unsigned int node) {
+			if (active[node] > 0) {
+				queue.push_back(make_pair(lowest_rank[node], node));
+				push_heap(queue.begin(), queue.end(), greater< pair<unsigned int,unsigned int> >());
+			}
+		};
+	public:
+		static const unsigned int INACTIVE = UINT_MAX;
+		void resize(const unsigned int size) {
+			for (leaves = 1; leaves < size; leaves *= 2);
+			lowest_rank.assign(2 * leaves, INACTIVE);
+			active.assign(2 * leaves, 0);
+		};
+		void set(unsigned int position, const unsigned int rank) {
+			position += leaves;
+			lowest_rank[position] = rank;
+			active[position] = (rank != INACTIVE) ? 1 : 0;
+			for (position /= 2; position > 0; position /= 2) {
+				lowest_rank[position] = min(lowest_rank[2*position], lowest_rank[2*position+1]);
+				active[position] = active[2*position] + active[2*position+1];
+			}
+		};
+		// count the active mates in the range [first, last)
+		unsigned int count(unsigned int first, unsigned int last) const {
+			unsigned int result = 0;
+			for (first += leaves, last += leaves; first < last; first /= 2, last /= 2) {
+				if (first % 2 == 1)
+					result += active[first++];
+				if (last % 2 == 1)
+					result += active[--last];
+			}
+			return result;
+		};
+		// start retrieving the active mates in the range [first, last)
+		void find(unsigned int first, unsigned int last) {
+			queue.clear();
+			for (first += leaves, last += leaves; first < last; first /= 2, last /= 2) {
+				if (first % 2 == 1)
+					enqueue(first++);
+				if (last % 2 == 1)
+					enqueue(--last);
+			}
+		};
+		// get the position of the active mate with the next lowest rank in the range, returns false when there are no more
+		bool next(unsigned int& position) {
+			if (queue.empty())
+				return false;
+			unsigned int node = queue.front().second;
+			pop_heap(queue.begin(), queue.end(), greater< pair<unsigned int,unsigned int> >());
+			queue.pop_back();
+			// descend to the mate with the lowest rank and remember the siblings on the way
+			while (node < leaves) {
+				if (lowest_rank[2*node] < lowest_rank[2*node+1]) {
+					enqueue(2*node+1);
+					node = 2*node;
+				} else {
+					enqueue(2*node);
+					node = 2*node+1;
+				}
+			}
+			position = node - leaves;
+			return true;
+		};
+};
+const unsigned int active_discordant_mates_t::INACTIVE;
+
+// count a matching discordant mate as supporting read of the fusion
+// returns false, when the fusion has enough supporting reads and no more mates need to be looked at
+bool add_discordant_mate(fusion_t& fusion, chimeric_alignments_t::iterator chimeric_alignment, const unsigned int subsampling_threshold, bool& subsampled_fusions) {
+
+	// ignore further discordant mates if we already have a lot of supporting reads,
+	// because runtime and memory increase quadratically with the number of discordant mates
+	if (chimeric_alignment->second.filter != FILTER_none && fusion.discordant_mate_list.size() >= subsampling_threshold) {
+		subsampled_fusions = true;
+		return true; // ignore discarded read, but continue looking for non-discarded reads
+	}
+	if (fusion.discordant_mates >= subsampling_threshold) {
+		subsampled_fusions = true;
+		return false; // abort and go to next fusion - we already have enough discordant mates for this one
+	}
 
-	for (chimeric_alignments_t::iterator chimeric_alignment = chimeric_alignments.begin(); chimeric_alignment != chimeric_alignments.end(); ++chimeric_alignment) {
+	// count the discordant mates as supporting reads
+	fusion.discordant_mate_list.push_back(chimeric_alignment);
+	if (chimeric_alignment->second.filter == FILTER_none)
+		fusion.discordant_mates++;
+
+	// make sure mate1 points to the mate with the lower coordinate
+	// this ensures that the coordinate of the correct mate is compared against the coordinate of the breakpoint
+	alignment_t& mate1 = chimeric_alignment->second[MATE1];
+	alignment_t& mate2 = chimeric_alignment->second[MATE2];
+	position_t mate1_breakpoint = (mate1.strand == FORWARD) ? mate1.end : mate1.start;
+	position_t mate2_breakpoint = (mate2.strand == FORWARD) ? mate2.end : mate2.start;
+	if (mate1.contig > mate2.contig || mate1.contig == mate2.contig && mate1_breakpoint > mate2_breakpoint)
+		swap(mate1, mate2);
+
+	// expand the size of the anchor
+	if (fusion.direction1 == DOWNSTREAM && (mate1.start < fusion.anchor_start1 || fusion.anchor_start1 == 0)) {
+		fusion.anchor_start1 = mate1.start;
+	} else if (fusion.direction1 == UPSTREAM && (mate1.end > fusion.anchor_start1 || fusion.anchor_start1 == 0)) {
+		fusion.anchor_start1 = mate1.end;
+	}
+	if (fusion.direction2 == DOWNSTREAM && (mate2.start < fusion.anchor_start2 || fusion.anchor_start2 == 0)) {
+		fusion.anchor_start2 = mate2.start;
+	} else if (fusion.direction2 == UPSTREAM && (mate2.end > fusion.anchor_start2 || fusion.anchor_start2 == 0)) {
+		fusion.anchor_start2 = mate2.end;
+	}
+	return true;
+}
+
+unsigned int find_fusions(chimeric_alignments_t& chimeric_alignments, fusions_t& fusions, const exon_annotation_index_t& exon_annotation_index, const int max_mate_gap, const unsigned int subsampling_threshold) {
+
+	unordered_map< tuple<unsigned int/*gene1->id*/,unsigned int/*gene2->id*/,direction_t/*1*/,direction_t/*2*/>, discordant_mates_of_gene_pair_t > discordant_mates_by_gene_pair; // contains the discordant mates for each pair of genes
+
+	bool subsampled_fusions = false;
+	unordered_map<fusion_t*,chimeric_alignments_t::iterator> filter_determining_reads;
+
+	// when a fusion has more supporting reads than the subsampling threshold, the reads with the lowest ranks are kept
+	// => process reads in the order of their ranks
+	vector< pair<unsigned long long int/*rank*/,chimeric_alignments_t::iterator> > chimeric_alignments_by_rank;
+	chimeric_alignments_by_rank.reserve(chimeric_alignments.size());
+	for (chimeric_alignments_t::iterator chimeric_alignment = chimeric_alignments.begin(); chimeric_alignment != chimeric_alignments.end(); ++chimeric_alignment)
+		chimeric_alignments_by_rank.push_back(make_pair(get_subsampling_rank(chimeric_alignment->first), chimeric_alignment));
+	sort(chimeric_alignments_by_rank.begin(), chimeric_alignments_by_rank.end(),
+	     [](const pair<unsigned long long int,chimeric_alignments_t::iterator>& x, const pair<unsigned long long int,chimeric_alignments_t::iterator>& y) {
+	     	return x.first < y.first || x.first == y.first && x.second->first < y.second->first;
+	     });
+
+	for (auto ranked_chimeric_alignment = chimeric_alignments_by_rank.begin(); ranked_chimeric_alignment != chimeric_alignments_by_rank.end(); ++ranked_chimeric_alignment) {
+		chimeric_alignments_t::iterator chimeric_alignment = ranked_chimeric_alignment->second;
 
 		contig_t contig1, contig2;
 		position_t breakpoint1, breakpoint2;
@@ -259,8 +470,7 @@ unsigned int find_fusions(chimeric_alignments_t& chimeric_alignments, fusions_t&
 					}
 					fusion.exonic1 = exonic1 || fusion.exonic1; fusion.exonic2 = exonic2 || fusion.exonic2;
 
-					if (is_new_fusion.second || chimeric_alignment->second.filter == FILTER_none || fusion.filter == FILTER_duplicates)
-						fusion.filter = chimeric_alignment->second.filter;
+					assign_filter_to_fusion(fusion, is_new_fusion.second, chimeric_alignment, filter_determining_reads);
 
 					if (fusion.split_reads1 >= subsampling_threshold && !swapped ||
 					    fusion.split_reads2 >= subsampling_threshold &&  swapped ||
@@ -341,8 +551,7 @@ unsigned int find_fusions(chimeric_alignments_t& chimeric_alignments, fusions_t&
 					}
 					fusion.exonic1 = exonic1 || fusion.exonic1; fusion.exonic2 = exonic2 || fusion.exonic2;
 
-					if (is_new_fusion.second || chimeric_alignment->second.filter == FILTER_none || fusion.filter == FILTER_duplicates)
-						fusion.filter = chimeric_alignment->second.filter;
+					assign_filter_to_fusion(fusion, is_new_fusion.second, chimeric_alignment, filter_determining_reads);
 
 					// expand the size of the anchor
 					if (fusion.direction1 == DOWNSTREAM && (anchor_start1 < fusion.anchor_start1 || fusion.anchor_start1 == 0)) {
@@ -358,84 +567,143 @@ unsigned int find_fusions(chimeric_alignments_t& chimeric_alignments, fusions_t&
 
 					// store the discordant mates in a hashmap for fast lookup
 					// we will need this later to find all the discordant mates supporting a given fusion
-					discordant_mates_by_gene_pair[make_tuple((**gene1).id, (**gene2).id, direction1, direction2)].push_back(make_tuple(breakpoint1, breakpoint2, chimeric_alignment));
+					vector<discordant_mate_t>& discordant_mates = discordant_mates_by_gene_pair[make_tuple((**gene1).id, (**gene2).id, direction1, direction2)].by_rank;
+					discordant_mates.push_back(make_tuple(breakpoint1, breakpoint2, chimeric_alignment, discordant_mates.size()));
 				}
 			}
 		}
 	}
 
-	// for each fusion, count the supporting discordant mates
+	// for each fusion, determine the range of breakpoints of matching discordant mates
 	for (fusions_t::iterator fusion = fusions.begin(); fusion != fusions.end(); ++fusion) {
 
 		if (fusion->second.filter != FILTER_none)
 			continue; // don't look for discordant mates, if the fusion has been filtered
+		count_work_of_fusion(fusion->second);
 
 		// get list of discordant mates supporting a fusion between the given gene pair
 		direction_t direction1 = fusion->second.direction1;
 		direction_t direction2 = fusion->second.direction2;
 		auto discordant_mates = discordant_mates_by_gene_pair.find(make_tuple(fusion->second.gene1->id, fusion->second.gene2->id, direction1, direction2));
-		if (discordant_mates != discordant_mates_by_gene_pair.end()) {
-
-			// if the precise breakpoint is known (i.e., there are split reads), the discordant mate must not run over the breakpoint (at most 2bp)
-			// if the precise breakpoint is not known (i.e., there are only discordant mates), we are more permissive (max_mate_gap)
-			int max_overlap_with_breakpoint = (fusion->second.split_read1_list.size() + fusion->second.split_read2_list.size() > 0) ? 2 : max_mate_gap;
-			position_t fusion_breakpoint1 = (fusion->second.direction1 == DOWNSTREAM) ? fusion->second.breakpoint1 + max_overlap_with_breakpoint : fusion->second.breakpoint1 - max_overlap_with_breakpoint;
-			position_t fusion_breakpoint2 = (fusion->second.direction2 == DOWNSTREAM) ? fusion->second.breakpoint2 + max_overlap_with_breakpoint : fusion->second.breakpoint2 - max_overlap_with_breakpoint;
-
-			for (auto discordant_mate = discordant_mates->second.begin(); discordant_mate != discordant_mates->second.end(); ++discordant_mate) {
-
-				// mate breakpoints must match fusion breakpoints
-				if (((fusion->second.direction1 == DOWNSTREAM && get<0>(*discordant_mate) /*mate1 breakpoint*/ <= fusion_breakpoint1) ||
-				     (fusion->second.direction1 == UPSTREAM   && get<0>(*discordant_mate) /*mate1 breakpoint*/ >= fusion_breakpoint1)) &&
-				    ((fusion->second.direction2 == DOWNSTREAM && get<1>(*discordant_mate) /*mate2 breakpoint*/ <= fusion_breakpoint2) ||
-				     (fusion->second.direction2 == UPSTREAM   && get<1>(*discordant_mate) /*mate2 breakpoint*/ >= fusion_breakpoint2)) &&
-				    (!fusion->second.is_intragenic() ||
-				     abs(fusion->second.breakpoint1 - get<0>(*discordant_mate) /*mate1 breakpoint*/) <= max_mate_gap &&
-				     abs(fusion->second.breakpoint2 - get<1>(*discordant_mate) /*mate2 breakpoint*/) <= max_mate_gap)) {
-
-					// ignore further discordant mates if we already have a lot of supporting reads,
-					// because runtime and memory increase quadratically with the number of discordant mates
-					if (get<2>(*discordant_mate)->second.filter != FILTER_none && fusion->second.discordant_mate_list.size() >= subsampling_threshold) {
-						subsampled_fusions = true;
-						continue; // ignore discarded read, but continue looking for non-discarded reads
-					}
-					if (fusion->second.discordant_mates >= subsampling_threshold) {
-						subsampled_fusions = true;
-						break; // abort and go to next fusion - we already have enough discordant mates for this one
-					}
+		if (discordant_mates == discordant_mates_by_gene_pair.end())
+			continue;
+
+		discordant_mate_window_t window;
+		window.fusion = &fusion->second;
+
+		// mate breakpoints must match fusion breakpoints
+		// if the precise breakpoint is known (i.e., there are split reads), the discordant mate must not run over the breakpoint (at most 2bp)
+		// if the precise breakpoint is not known (i.e., there are only discordant mates), we are more permissive (max_mate_gap)
+		window.max_overlap_with_breakpoint = (fusion->second.split_read1_list.size() + fusion->second.split_read2_list.size() > 0) ? 2 : max_mate_gap;
+		window.min_breakpoint1 = window.min_breakpoint2 = INT_MIN;
+		window.max_breakpoint1 = window.max_breakpoint2 = INT_MAX;
+		if (fusion->second.direction1 == DOWNSTREAM)
+			window.max_breakpoint1 = fusion->second.breakpoint1 + window.max_overlap_with_breakpoint;
+		else
+			window.min_breakpoint1 = fusion->second.breakpoint1 - window.max_overlap_with_breakpoint;
+		if (fusion->second.direction2 == DOWNSTREAM)
+			window.max_breakpoint2 = fusion->second.breakpoint2 + window.max_overlap_with_breakpoint;
+		else
+			window.min_breakpoint2 = fusion->second.breakpoint2 - window.max_overlap_with_breakpoint;
+
+		// in case of intragenic events, the mates must additionally be near the breakpoints
+		window.intragenic = fusion->second.is_intragenic();
+		if (window.intragenic) {
+			window.min_breakpoint1 = max(window.min_breakpoint1, fusion->second.breakpoint1 - max_mate_gap);
+			window.max_breakpoint1 = min(window.max_breakpoint1, fusion->second.breakpoint1 + max_mate_gap);
+			window.min_breakpoint2 = max(window.min_breakpoint2, fusion->second.breakpoint2 - max_mate_gap);
+			window.max_breakpoint2 = min(window.max_breakpoint2, fusion->second.breakpoint2 + max_mate_gap);
+		}
 
-					// count the discordant mates as supporting reads
-					fusion->second.discordant_mate_list.push_back(get<2>(*discordant_mate));
-					if (get<2>(*discordant_mate)->second.filter == FILTER_none)
-						fusion->second.discordant_mates++;
+		discordant_mates->second.windows.push_back(window);
+	}
 
-					// make sure mate1 points to the mate with the lower coordinate
-					// this ensures that the coordinate of the correct mate is compared against the coordinate of the breakpoint
-					alignment_t& mate1 = get<2>(*discordant_mate)->second[MATE1];
-					alignment_t& mate2 = get<2>(*discordant_mate)->second[MATE2];
-					position_t mate1_breakpoint = (mate1.strand == FORWARD) ? mate1.end : mate1.start;
-					position_t mate2_breakpoint = (mate2.strand == FORWARD) ? mate2.end : mate2.start;
-					if (mate1.contig > mate2.contig || mate1.contig == mate2.contig && mate1_breakpoint > mate2_breakpoint)
-						swap(mate1, mate2);
+	// for each gene pair, sweep over the windows of the fusions and the discordant mates sorted by the breakpoint of mate1
+	// the mates which are within the current window with respect to mate1 are kept active in a tournament tree,
+	// from which the mates within the range of mate2 breakpoints are retrieved in the order of their ranks,
+	// because subsampling requires the mates to be processed in the order in which they were added
+	active_discordant_mates_t active_discordant_mates;
+	vector<discordant_mate_t> by_breakpoint1;
+	vector<discordant_mate_t> by_breakpoint2;
+	vector<unsigned int> position_by_rank; // position of a mate in <by_breakpoint2>
+	for (auto discordant_mates = discordant_mates_by_gene_pair.begin(); discordant_mates != discordant_mates_by_gene_pair.end(); ++discordant_mates) {
+
+		vector<discordant_mate_window_t>& windows = discordant_mates->second.windows;
+		if (windows.empty())
+			continue;
+		sort(windows.begin(), windows.end());
+
+		// sort the mates by the breakpoints of mate1 and mate2 (the mates were added in the order of their ranks)
+		const vector<discordant_mate_t>& by_rank = discordant_mates->second.by_rank;
+		by_breakpoint1 = by_rank;
+		by_breakpoint2 = by_rank;
+		sort(by_breakpoint1.begin(), by_breakpoint1.end(), sort_discordant_mates_by_breakpoint1);
+		sort(by_breakpoint2.begin(), by_breakpoint2.end(), sort_discordant_mates_by_breakpoint2);
+		position_by_rank.resize(by_breakpoint2.size());
+		for (unsigned int position = 0; position < by_breakpoint2.size(); ++position)
+			position_by_rank[get<3>(by_breakpoint2[position])] = position;
+		active_discordant_mates.resize(by_breakpoint2.size());
+
+		unsigned int first_active = 0; // mates in the range [first_active, last_active) of <by_breakpoint1> are active
+		unsigned int last_active = 0;
+		for (auto window = windows.begin(); window != windows.end(); ++window) {
+
+			// start over, when the ends of the windows do not grow monotonically anymore
+			if (window != windows.begin() && !window->same_group(*(window-1))) {
+				active_discordant_mates.resize(by_breakpoint2.size());
+				first_active = last_active = 0;
+			}
 
-					// expand the size of the anchor
-					if (fusion->second.direction1 == DOWNSTREAM && (mate1.start < fusion->second.anchor_start1 || fusion->second.anchor_start1 == 0)) {
-						fusion->second.anchor_start1 = mate1.start;
-					} else if (fusion->second.direction1 == UPSTREAM && (mate1.end > fusion->second.anchor_start1 || fusion->second.anchor_start1 == 0)) {
-						fusion->second.anchor_start1 = mate1.end;
-					}
-					if (fusion->second.direction2 == DOWNSTREAM && (mate2.start < fusion->second.anchor_start2 || fusion->second.anchor_start2 == 0)) {
-						fusion->second.anchor_start2 = mate2.start;
-					} else if (fusion->second.direction2 == UPSTREAM && (mate2.end > fusion->second.anchor_start2 || fusion->second.anchor_start2 == 0)) {
-						fusion->second.anchor_start2 = mate2.end;
+			// slide the range of active mates along the breakpoints of mate1
+			for (; first_active < by_breakpoint1.size() && get<0>(by_breakpoint1[first_active]) < window->min_breakpoint1; ++first_active)
+				if (first_active < last_active)
+					active_discordant_mates.set(position_by_rank[get<3>(by_breakpoint1[first_active])], active_discordant_mates_t::INACTIVE);
+			if (last_active < first_active)
+				last_active = first_active;
+			for (; last_active < by_breakpoint1.size() && get<0>(by_breakpoint1[last_active]) <= window->max_breakpoint1; ++last_active)
+				active_discordant_mates.set(position_by_rank[get<3>(by_breakpoint1[last_active])], get<3>(by_breakpoint1[last_active]));
+
+			// count the matching discordant mates as supporting reads of the fusion in the order of their ranks
+			fusion_t& fusion = *window->fusion;
+			const unsigned int first_candidate = lower_bound(by_breakpoint2.begin(), by_breakpoint2.end(), window->min_breakpoint2, discordant_mate_is_before_breakpoint2) - by_breakpoint2.begin();
+			const unsigned int last_candidate = upper_bound(by_breakpoint2.begin(), by_breakpoint2.end(), window->max_breakpoint2, breakpoint2_is_before_discordant_mate) - by_breakpoint2.begin();
+			const unsigned int matching_discordant_mates = active_discordant_mates.count(first_candidate, last_candidate);
+			if ((unsigned long long int) matching_discordant_mates * DENSE_DISCORDANT_MATES >= by_rank.size()) {
+
+				// when a large fraction of the mates matches, going through the mates by rank is cheaper than retrieving them from the tree
+				unsigned int found_discordant_mates = 0;
+				for (auto discordant_mate = by_rank.begin(); discordant_mate != by_rank.end() && found_discordant_mates < matching_discordant_mates; ++discordant_mate) {
+					count_operation(OPERATION_discordant_mate_scans);
+					if (get<0>(*discordant_mate) >= window->min_breakpoint1 && get<0>(*discordant_mate) <= window->max_breakpoint1 &&
+					    get<1>(*discordant_mate) >= window->min_breakpoint2 && get<1>(*discordant_mate) <= window->max_breakpoint2) {
+						found_discordant_mates++;
+						if (!add_discordant_mate(fusion, get<2>(*discordant_mate), subsampling_threshold, subsampled_fusions))
+							break;
 					}
 				}
+
+			} else {
+
+				active_discordant_mates.find(first_candidate, last_candidate);
+				unsigned int position;
+				while (active_discordant_mates.next(position)) {
+					count_operation(OPERATION_discordant_mate_scans);
+					if (!add_discordant_mate(fusion, get<2>(by_breakpoint2[position]), subsampling_threshold, subsampled_fusions))
+						break;
+				}
 			}
 		}
 	}
 
+	// sort supporting reads by name, like they would be without ranking
+	for (fusions_t::iterator fusion = fusions.begin(); fusion != fusions.end(); ++fusion) {
+		sort(fusion->second.split_read1_list.begin(), fusion->second.split_read1_list.end(), sort_chimeric_alignments_by_name);
+		sort(fusion->second.split_read2_list.begin(), fusion->second.split_read2_list.end(), sort_chimeric_alignments_by_name);
+		sort(fusion->second.discordant_mate_list.begin(), fusion->second.discordant_mate_list.end(), sort_chimeric_alignments_by_name);
+	}
+
 	if (subsampled_fusions)
-		cerr << "WARNING: some fusions were subsampled, because they have more than " << subsampling_threshold << " supporting reads" << endl;
+		print_warning("some fusions were subsampled, because they have more than " + to_string(static_cast<long long unsigned int>(subsampling_threshold)) + " supporting reads");
 
 	unsigned int remaining = 0;
 	for (fusions_t::iterator fusion = fusions.begin(); fusion != fusions.end(); ++fusion) {
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "common.hpp"
+#include "operation_counters.hpp"
+
+using namespace std;
+
+#ifdef OPERATION_COUNTERS
+
+struct operation_counter_set_t {
+	mutex counts_mutex;
+	unsigned long long int counts[OPERATIONS_COUNT];
+	unsigned int max_align_depth;
+	unordered_map<string,unsigned long long int> work_by_gene;
+	unordered_map<string,unsigned long long int> work_by_fusion;
+	operation_counter_set_t(): max_align_depth(0) {
+		for (unsigned int operation = 0; operation < OPERATIONS_COUNT; ++operation)
+			counts[operation] = 0;
+	}
+};
+
+// counters of the operations which are not done on behalf of a sample, such as loading the references
+operation_counter_set_t process_counter_set;
+
+thread_local thread_operation_counts_t thread_operation_counts;
+
+operation_counter_set_t& get_counter_set() {
+	return (thread_operation_counts.counter_set == NULL) ? process_counter_set : *thread_operation_counts.counter_set;
+}
+
+thread_operation_counts_t::thread_operation_counts_t(): align_depth(0), max_align_depth(0), counter_set(NULL) {
+	for (unsigned int operation = 0; operation < OPERATIONS_COUNT; ++operation)
+		counts[operation] = flushed_counts[operation] = 0;
+}
+
+thread_operation_counts_t::~thread_operation_counts_t() {
+	flush();
+}
+
+unsigned long long int thread_operation_counts_t::sum() const {
+	unsigned long long int result = 0;
+	for (unsigned int operation = 0; operation < OPERATIONS_COUNT; ++operation)
+		result += counts[operation];
+	return result;
+}
+
+// add the counts since the last flush to the counter set of the thread
+void thread_operation_counts_t::flush() {
+	operation_counter_set_t& set = get_counter_set();
+	lock_guard<mutex> lock(set.counts_mutex);
+	for (unsigned int operation = 0; operation < OPERATIONS_COUNT; ++operation) {
+		set.counts[operation] += counts[operation] - flushed_counts[operation];
+		flushed_counts[operation] = counts[operation];
+	}
+	set.max_align_depth = max(set.max_align_depth, max_align_depth);
+	max_align_depth = align_depth;
+}
+
+// dummy genes have no name, so they are labeled with their coordinates
+string get_work_label(const gene_t gene) {
+	if (gene->is_dummy)
+		return "intergenic:" + to_string(static_cast<long long int>(gene->start)) + "-" + to_string(static_cast<long long int>(gene->end));
+	else
+		return gene->name;
+}
+
+fusion_work_t::~fusion_work_t() {
+	const unsigned long long int operations = thread_operation_counts.sum() - operations_before;
+	if (operations == 0)
+		return;
+	const string gene1 = get_work_label(fusion.gene1);
+	const string gene2 = get_work_label(fusion.gene2);
+	operation_counter_set_t& set = get_counter_set();
+	lock_guard<mutex> lock(set.counts_mutex);
+	set.work_by_fusion[gene1 + "--" + gene2] += operations;
+	set.work_by_gene[gene1] += operations;
+	if (fusion.gene1 != fusion.gene2)
+		set.work_by_gene[gene2] += operations;
+}
+
+sample_operation_counters_t::sample_operation_counters_t(): counter_set(new operation_counter_set_t), previous_counter_set(thread_operation_counts.counter_set) {
+	thread_operation_counts.flush(); // the operations so far belong to the previous counter set
+	thread_operation_counts.counter_set = counter_set;
+}
+
+sample_operation_counters_t::~sample_operation_counters_t() {
+	thread_operation_counts.flush();
+	thread_operation_counts.counter_set = previous_counter_set;
+	delete counter_set;
+}
+
+void get_operation_counts(operation_counts_t& counts) {
+	thread_operation_counts.flush();
+	operation_counter_set_t& set = get_counter_set();
+	lock_guard<mutex> lock(set.counts_mutex);
+	counts.assign(set.counts, set.counts + OPERATIONS_COUNT);
+}
+
+unsigned int get_max_align_depth() {
+	thread_operation_counts.flush();
+	operation_counter_set_t& set = get_counter_set();
+	lock_guard<mutex> lock(set.counts_mutex);
+	return set.max_align_depth;
+}
+
+bool sort_work_descending(const pair<string,unsigned long long int>& x, const pair<string,unsigned long long int>& y) {
+	return x.second > y.second || x.second == y.second && x.first < y.first;
+}
+
+void get_top_work(const unordered_map<string,unsigned long long int>& work, const unsigned int top_n, work_ranking_t& top) {
+	top.assign(work.begin(), work.end());
+	const unsigned int n = min(top_n, (unsigned int) top.size());
+	partial_sort(top.begin(), top.begin() + n, top.end(), sort_work_descending);
+	top.resize(n);
+}
+
+void get_top_work(const unsigned int top_n, work_ranking_t& top_genes, work_ranking_t& top_fusions) {
+	operation_counter_set_t& set = get_counter_set();
+	lock_guard<mutex> lock(set.counts_mutex);
+	get_top_work(set.work_by_gene, top_n, top_genes);
+	get_top_work(set.work_by_fusion, top_n, top_fusions);
+}
+
+#else
+
+void get_operation_counts(operation_counts_t& counts) {
+	counts.clear();
+}
+
+unsigned int get_max_align_depth() {
+	return 0;
+}
+
+void get_top_work(const unsigned int top_n, work_ranking_t& top_genes, work_ranking_t& top_fusions) {
+	top_genes.clear();
+	top_fusions.clear();
+}
+
+#endif /* OPERATION_COUNTERS */
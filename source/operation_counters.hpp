@@ -0,0 +1,137 @@
+#ifndef OPERATION_COUNTERS_H
+#define OPERATION_COUNTERS_H 1
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "common.hpp"
+#include "sample_log.hpp"
+
+using namespace std;
+
+// counters of the operations in hot paths, which help find out why a sample takes unusually long to process
+// they are only compiled in when OPERATION_COUNTERS is defined (see 'make profile'), otherwise the macros expand to nothing
+// the counts are written to the metrics file (see parameter -J) for every step, along with the genes and fusions which consumed the most work
+
+enum operation_t {
+	OPERATION_annotation_lookups,
+	OPERATION_align_calls,
+	OPERATION_kmer_hits,
+	OPERATION_homolog_evaluations,
+	OPERATION_discordant_mate_scans,
+	OPERATION_pileup_positions,
+	OPERATION_blacklist_range_scans,
+	OPERATIONS_COUNT
+};
+const char* const OPERATIONS[OPERATIONS_COUNT] = {
+	"annotation_lookups",
+	"align_calls",
+	"kmer_hits",
+	"homolog_evaluations",
+	"discordant_mate_scans",
+	"pileup_positions",
+	"blacklist_range_scans"
+};
+
+typedef vector<unsigned long long int> operation_counts_t;
+typedef vector< pair<string,unsigned long long int> > work_ranking_t;
+
+#ifdef OPERATION_COUNTERS
+
+// the operations of a sample (or of the process outside of samples), including the threads started on behalf of the sample
+// samples processed concurrently in batch mode have separate counters
+struct operation_counter_set_t;
+
+// every thread counts in its own counters, which are added to the counters of its sample when the thread ends
+// or when the counts are queried, so the hot paths do not synchronize with other threads
+struct thread_operation_counts_t {
+	unsigned long long int counts[OPERATIONS_COUNT]; // only ever increase, so that differences measure work
+	unsigned long long int flushed_counts[OPERATIONS_COUNT]; // the part of the counts which was added to the counter set already
+	unsigned int align_depth;
+	unsigned int max_align_depth;
+	operation_counter_set_t* counter_set; // NULL means the counters of the process
+	thread_operation_counts_t();
+	~thread_operation_counts_t();
+	unsigned long long int sum() const;
+	void flush();
+};
+extern thread_local thread_operation_counts_t thread_operation_counts;
+
+// tracks the recursion depth of align() while in scope
+struct align_depth_guard_t {
+	align_depth_guard_t() {
+		if (++thread_operation_counts.align_depth > thread_operation_counts.max_align_depth)
+			thread_operation_counts.max_align_depth = thread_operation_counts.align_depth;
+	}
+	~align_depth_guard_t() { --thread_operation_counts.align_depth; }
+};
+
+// attributes all operations counted by the current thread while in scope to the given fusion and its genes
+class fusion_work_t {
+	private:
+		const fusion_t& fusion;
+		const unsigned long long int operations_before;
+	public:
+		fusion_work_t(const fusion_t& fusion): fusion(fusion), operations_before(thread_operation_counts.sum()) {}
+		~fusion_work_t();
+};
+
+// counts the operations of the current thread in separate counters while in scope
+class sample_operation_counters_t {
+	private:
+		operation_counter_set_t* counter_set;
+		operation_counter_set_t* previous_counter_set;
+	public:
+		sample_operation_counters_t();
+		~sample_operation_counters_t();
+};
+
+// starts a thread which writes its warnings to the log of the calling thread's sample
+// and counts its operations in the counters of the sample
+template <class F, class... Args> thread start_thread(F function, Args... arguments) {
+	ostream* log = sample_log;
+	operation_counter_set_t* counter_set = thread_operation_counts.counter_set;
+	std::function<void()> task = bind(function, arguments...);
+	return thread([log, counter_set, task]() {
+		sample_log = log;
+		thread_operation_counts.counter_set = counter_set;
+		task();
+	});
+}
+
+#define count_operation(operation) ++thread_operation_counts.counts[operation]
+#define count_operations(operation,count) thread_operation_counts.counts[operation] += (count)
+#define track_align_depth() align_depth_guard_t align_depth_guard
+#define count_work_of_fusion(fusion) fusion_work_t fusion_work(fusion)
+#define count_operations_of_sample() sample_operation_counters_t sample_operation_counters
+
+#else
+
+// starts a thread which writes its warnings to the log of the calling thread's sample
+template <class F, class... Args> thread start_thread(F function, Args... arguments) {
+	ostream* log = sample_log;
+	std::function<void()> task = bind(function, arguments...);
+	return thread([log, task]() {
+		sample_log = log;
+		task();
+	});
+}
+
+#define count_operation(operation)
+#define count_operations(operation,count)
+#define track_align_depth()
+#define count_work_of_fusion(fusion)
+#define count_operations_of_sample()
+
+#endif /* OPERATION_COUNTERS */
+
+// counts of the calling thread's sample (including the threads it started); empty, unless the counters are compiled in
+void get_operation_counts(operation_counts_t& counts);
+unsigned int get_max_align_depth();
+
+// the genes and fusions of the calling thread's sample which consumed the most operations, in descending order
+void get_top_work(const unsigned int top_n, work_ranking_t& top_genes, work_ranking_t& top_fusions);
+
+#endif /* OPERATION_COUNTERS_H */
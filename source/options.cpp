@@ -1,15 +1,19 @@
 #include <algorithm>
 #include <cstring>
+#include <fstream>
 #include <iostream>
 #include <libgen.h>
+#include <set>
 #include <string>
 #include <sstream>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <unordered_map>
+#include <vector>
 #include "common.hpp"
 #include "annotation.hpp"
+#include "read_stats.hpp"
 #include "options.hpp"
 
 using namespace std;
@@ -94,6 +98,9 @@ options_t get_default_options() {
 	options.min_spliced_events = 4;
 	options.mismatch_pvalue_cutoff = 0.01;
 	options.subsampling_threshold = 300;
+	options.coverage_resolution = DEFAULT_COVERAGE_RESOLUTION;
+	options.threads = 1;
+	options.breakpoint_coverage = false;
 	options.high_expression_quantile = 0.998;
 	options.exonic_fraction = 0.33;
 	options.external_duplicate_marking = false;
@@ -101,6 +108,9 @@ options_t get_default_options() {
 	options.max_itd_length = 100;
 	options.min_itd_allele_fraction = 0.07;
 	options.min_itd_support = 10;
+	options.batch_workers = 1;
+	options.memory_quota = 0;
+	options.collation_memory_limit = 0;
 
 	return options;
 }
@@ -127,6 +137,9 @@ void print_usage() {
 	     << "              [-t tags.tsv] [-p protein_domains.gff3] [-d structural_variants_from_WGS.tsv] \\" << endl
 	     << "              -o fusions.tsv [-O fusions.discarded.tsv] \\" << endl
 	     << "              [OPTIONS]" << endl
+	     << "   or: arriba -B manifest.tsv \\" << endl
+	     << "              -g annotation.gtf -a assembly.fa [-b blacklists.tsv] [-k known_fusions.tsv] \\" << endl
+	     << "              [-t tags.tsv] [-p protein_domains.gff3] [OPTIONS]" << endl
 	     << endl
 	     << wrap_help("-c FILE", "File in SAM/BAM/CRAM format with chimeric alignments as "
 	                  "generated by STAR (Chimeric.out.sam). This parameter is only required, "
@@ -142,6 +155,11 @@ void print_usage() {
 	     << wrap_help("-a FILE", "FastA file with genome sequence (assembly). "
 	                  "The file may be gzip-compressed. An index with the file extension .fai "
 	                  "must exist only if CRAM files are processed.")
+	     << wrap_help("-y ASSEMBLY_CACHE", "Cache file for the sequences of the assembly (see parameter -a). "
+	                  "If the cache is missing or outdated, it is created from the FastA file. Otherwise, the cache "
+	                  "is mapped into memory instead of reading the FastA file, which is faster and lets concurrent "
+	                  "processes of Arriba using the same cache share the memory occupied by the assembly. "
+	                  "The directory of the cache must be writable.")
 	     << wrap_help("-b FILE", "File containing blacklisted events (recurrent artifacts "
 	                  "and transcripts observed in healthy tissue).")
 	     << wrap_help("-k FILE", "File containing known/recurrent fusions. Some cancer "
@@ -151,6 +169,28 @@ void print_usage() {
 	                  "separated by tabs.")
 	     << wrap_help("-o FILE", "Output file with fusions that have passed all filters.")
 	     << wrap_help("-O FILE", "Output file with fusions that were discarded due to filtering.")
+	     << wrap_help("-J FILE", "Output file in JSON format with the wall time, the CPU time, and "
+	                  "the change of resident memory of every step of the pipeline as well as the "
+	                  "number of reads and fusions removed by every filter. CPU time and memory are "
+	                  "measured for the whole process, i.e., they include concurrently processed "
+	                  "samples in batch mode.")
+	     << wrap_help("-B FILE", "Batch mode: process all samples listed in the given tab-separated "
+	                  "manifest in one run. The references are loaded only once and shared by all "
+	                  "samples. Each line describes one sample with the following columns: "
+	                  "alignments (like -x), output file (like -o) and optionally discarded "
+	                  "output file (like -O), chimeric alignments (like -c), and structural "
+	                  "variants from WGS (like -d), and metrics (like -J). Empty columns are treated "
+	                  "like omitted options. Lines starting with # are ignored. This option cannot "
+	                  "be combined with the options -x, -c, -o, -O, -d, and -J.")
+	     << wrap_help("-P SOCKET", "Server mode: load the references once and then run jobs "
+	                  "received over the given Unix domain socket until the server is terminated. "
+	                  "A job is submitted as a single line with the options of the job, at least "
+	                  "-x and -o. The log of the job is sent back over the connection. Options which "
+	                  "determine the references (-a, -g, -G, -b, -k, -t, -p, -i) cannot be "
+	                  "specified by a job.")
+	     << wrap_help("-q MEMORY_QUOTA", "Memory quota in GB for server mode (see parameter -P). "
+	                  "New jobs are only started while the memory used by the server and its jobs "
+	                  "is below the quota. A value of 0 means no quota. Default: " + to_string(static_cast<long double>(default_options.memory_quota)))
 	     << wrap_help("-t FILE", "Tab-separated file containing fusions to annotate with tags "
 	                  "in the 'tags' column. The first two columns specify the genes; the third "
 	                  "column specifies the tag. The file may be gzip-compressed.")
@@ -222,8 +262,28 @@ void print_usage() {
 	     << wrap_help("-U MAX_READS", "Subsample fusions with more than the given number of "
 	                  "supporting reads. This improves performance without compromising sensitivity, "
 	                  "as long as the threshold is high. Counting of supporting reads beyond "
-	                  "the threshold is inaccurate, obviously. "
+	                  "the threshold is inaccurate, obviously. The reads to keep are selected by a "
+	                  "hash of the read name, such that the subsample does not depend on the order "
+	                  "of the reads in the input. "
 	                  "Default: " + to_string(static_cast<long long unsigned int>(default_options.subsampling_threshold)))
+	     << wrap_help("-w COVERAGE_RESOLUTION", "Size of the windows in bp in which the coverage is "
+	                  "computed. Smaller windows locate the coverage around breakpoints more precisely, "
+	                  "larger windows use less memory. Default: " + to_string(static_cast<long long int>(default_options.coverage_resolution)))
+	     << wrap_help("-j THREADS", "Number of threads to use for the steps which can be "
+	                  "parallelized. The results do not depend on the number of threads. "
+	                  "Default: " + to_string(static_cast<long long unsigned int>(default_options.threads)))
+	     << wrap_help("-n WORKERS", "Number of samples to process concurrently in batch mode "
+	                  "(see parameter -B) or number of jobs to run concurrently in server mode "
+	                  "(see parameter -P). Each sample additionally uses the number of threads "
+	                  "given by -j. The results do not depend on the number of workers. "
+	                  "Default: " + to_string(static_cast<long long unsigned int>(default_options.batch_workers)))
+	     << wrap_help("-W COLLATION_MEMORY_LIMIT", "Memory limit in GB above which mates that are "
+	                  "waiting for their partner while reading alignments are moved to a temporary "
+	                  "file in the directory given by the environment variable TMPDIR (default: /tmp) "
+	                  "and paired later. Only these mates are moved. The extracted chimeric "
+	                  "alignments stay in memory, so this is not a limit on the total memory "
+	                  "consumption. This slows down processing, but does not change the results. "
+	                  "A value of 0 means no limit. Default: " + to_string(static_cast<long double>(default_options.collation_memory_limit)))
 	     << wrap_help("-Q QUANTILE", "Highly expressed genes are prone to produce artifacts "
 	                  "during library preparation. Genes with an expression above the given quantile "
 	                  "are eligible for filtering by the 'in_vitro' filter. "
@@ -257,6 +317,10 @@ void print_usage() {
 	     << wrap_help("-I", "If assembly of the fusion transcript sequence from the supporting "
 	                  "reads is incomplete (denoted as '...'), fill the gaps using the assembly "
 	                  "sequence wherever possible.")
+	     << wrap_help("-r", "Compute the coverage around breakpoints at base resolution by "
+	                  "querying the index of the file passed via -x, rather than computing the coverage "
+	                  "of the whole genome in windows. This requires a coordinate-sorted and indexed "
+	                  "BAM/CRAM file.")
 	     << wrap_help("-h", "Print help and exit.")
 	     << "         Code repository: " << CODE_REPOSITORY << endl
 	     << "    Get help/report bugs: " << HELP_CONTACT << endl
@@ -264,8 +328,56 @@ void print_usage() {
 	     << "             Please cite: " << CITATION << endl << endl;
 }
 
-options_t parse_arguments(int argc, char **argv) {
-	options_t options = get_default_options();
+// read the samples to process in batch mode from a tab-separated manifest
+// the columns correspond to the options -x, -o, -O, -c, -d, and -J; empty or missing columns mean the option is not given
+void parse_batch_manifest(const string& manifest_file, vector<batch_sample_t>& samples) {
+	ifstream manifest(manifest_file);
+	set<string> output_files;
+	string line;
+	unsigned int line_number = 0;
+	while (getline(manifest, line)) {
+		++line_number;
+		if (line.empty() || line[0] == '#')
+			continue; // skip empty lines and comments
+
+		// split line into columns
+		vector<string> columns;
+		istringstream iss(line);
+		string column;
+		while (getline(iss, column, '\t'))
+			columns.push_back(column);
+		columns.resize(6);
+		batch_sample_t sample;
+		sample.rna_bam_file = columns[0];
+		sample.output_file = columns[1];
+		sample.discarded_output_file = columns[2];
+		sample.chimeric_bam_file = columns[3];
+		sample.genomic_breakpoints_file = columns[4];
+		sample.metrics_file = columns[5];
+
+		// validate sample the same way as the corresponding options
+		const string location = " (line " + to_string(static_cast<long long unsigned int>(line_number)) + " of manifest)";
+		crash(sample.rna_bam_file.empty(), "missing alignments in 1st column" + location);
+		crash(access(sample.rna_bam_file.c_str(), R_OK), "file not found/readable: " + sample.rna_bam_file + location);
+		crash(!output_directory_exists(sample.output_file), "parent directory of output file '" + sample.output_file + "' does not exist" + location);
+		crash(!sample.discarded_output_file.empty() && !output_directory_exists(sample.discarded_output_file), "parent directory of output file '" + sample.discarded_output_file + "' does not exist" + location);
+		crash(!sample.chimeric_bam_file.empty() && access(sample.chimeric_bam_file.c_str(), R_OK), "file not found/readable: " + sample.chimeric_bam_file + location);
+		crash(!sample.genomic_breakpoints_file.empty() && access(sample.genomic_breakpoints_file.c_str(), R_OK), "file not found/readable: " + sample.genomic_breakpoints_file + location);
+		crash(!sample.metrics_file.empty() && !output_directory_exists(sample.metrics_file), "parent directory of output file '" + sample.metrics_file + "' does not exist" + location);
+
+		// samples must not overwrite each other's output
+		crash(!output_files.insert(sample.output_file).second, "output file '" + sample.output_file + "' is used by multiple samples" + location);
+		crash(!sample.discarded_output_file.empty() && !output_files.insert(sample.discarded_output_file).second, "output file '" + sample.discarded_output_file + "' is used by multiple samples" + location);
+		crash(!sample.metrics_file.empty() && !output_files.insert(sample.metrics_file).second, "output file '" + sample.metrics_file + "' is used by multiple samples" + location);
+
+		samples.push_back(sample);
+	}
+	crash(samples.empty(), "manifest does not list any samples: " + manifest_file);
+}
+
+// parse the given arguments on top of the given options
+// this is used for the command-line as well as for the jobs of server mode
+void parse_options(int argc, char **argv, options_t& options) {
 
 	// throw error when first argument is not prefixed with a dash
 	// for some reason getopt does not detect this error and simply skips the argument
@@ -276,7 +388,7 @@ options_t parse_arguments(int argc, char **argv) {
 	int c;
 	string junction_suffix(".junction");
 	unordered_map<char,unsigned int> duplicate_arguments;
-	const string valid_arguments = "c:x:d:g:G:o:O:t:p:a:b:k:s:i:v:f:E:S:m:L:H:D:R:A:M:K:V:F:U:Q:e:T:C:l:z:Z:uXIh";
+	const string valid_arguments = "c:x:d:g:G:o:O:t:p:a:b:k:s:i:v:f:E:S:m:L:H:D:R:A:M:K:V:F:U:w:j:Q:e:T:C:l:z:Z:B:n:P:q:y:W:J:uXIrh";
 	while ((c = getopt(argc, argv, valid_arguments.c_str())) != -1) {
 
 		// throw error if the same argument is specified more than once
@@ -320,6 +432,10 @@ options_t parse_arguments(int argc, char **argv) {
 				options.discarded_output_file = optarg;
 				crash(!output_directory_exists(options.discarded_output_file), "parent directory of output file '" + options.discarded_output_file + "' does not exist");
 				break;
+			case 'J':
+				options.metrics_file = optarg;
+				crash(!output_directory_exists(options.metrics_file), "parent directory of output file '" + options.metrics_file + "' does not exist");
+				break;
 			case 't':
 				options.tags_file = optarg;
 				crash(access(options.tags_file.c_str(), R_OK), "file not found/readable: " + options.tags_file);
@@ -336,6 +452,9 @@ options_t parse_arguments(int argc, char **argv) {
 				if (options.rna_bam_file.size() >= 5 && options.rna_bam_file.substr(options.rna_bam_file.size()-5) == ".cram")
 					crash(access((options.assembly_file + ".fai").c_str(), R_OK), "index file not found/readable: " + options.assembly_file + ".fai");
 				break;
+			case 'y':
+				options.assembly_cache_file = optarg;
+				break;
 			case 'b':
 				options.blacklist_file = optarg;
 				crash(access(options.blacklist_file.c_str(), R_OK), "file not found/readable: " + options.blacklist_file);
@@ -419,6 +538,32 @@ options_t parse_arguments(int argc, char **argv) {
 			case 'U':
 				crash(!validate_int(optarg, options.subsampling_threshold, 1, SHRT_MAX), "argument to -" + ((char) c) + " must be an integer between 1 and " + to_string(SHRT_MAX));
 				break;
+			case 'w':
+				crash(!validate_int(optarg, options.coverage_resolution, 1, 1000), "argument to -" + ((char) c) + " must be an integer between 1 and 1000");
+				break;
+			case 'r':
+				options.breakpoint_coverage = true;
+				break;
+			case 'j':
+				crash(!validate_int(optarg, options.threads, 1, 1024), "argument to -" + ((char) c) + " must be an integer between 1 and 1024");
+				break;
+			case 'B':
+				options.batch_manifest_file = optarg;
+				crash(access(options.batch_manifest_file.c_str(), R_OK), "file not found/readable: " + options.batch_manifest_file);
+				break;
+			case 'P':
+				options.server_socket = optarg;
+				crash(!output_directory_exists(options.server_socket), "parent directory of socket '" + options.server_socket + "' does not exist");
+				break;
+			case 'q':
+				crash(!validate_float(optarg, options.memory_quota, 0), "argument to -" + ((char) c) + " must be a non-negative number (0 = no limit)");
+				break;
+			case 'W':
+				crash(!validate_float(optarg, options.collation_memory_limit, 0), "argument to -" + ((char) c) + " must be a non-negative number (0 = no limit)");
+				break;
+			case 'n':
+				crash(!validate_int(optarg, options.batch_workers, 1, 1024), "argument to -" + ((char) c) + " must be an integer between 1 and 1024");
+				break;
 			case 'Q':
 				crash(!validate_float(optarg, options.high_expression_quantile, 0, 1), "argument to -" + ((char) c) + " must be between 0 and 1");
 				break;
@@ -462,18 +607,79 @@ options_t parse_arguments(int argc, char **argv) {
 		crash(optind < argc && (string(argv[optind]).empty() || argv[optind][0] != '-'), "option -" + ((char) c) + " has too many arguments (arguments with blanks must be wrapped in quotes)");
 
 	}
+}
+
+options_t parse_arguments(int argc, char **argv) {
+	options_t options = get_default_options();
+	parse_options(argc, argv, options);
 
 	// check for mandatory arguments
 	if (argc == 1) {
 		print_usage();
 		crash(true, "no arguments given");
 	}
-	crash(options.rna_bam_file.empty(), "missing mandatory option -x");
+	const bool sample_options_given = !options.rna_bam_file.empty() || !options.chimeric_bam_file.empty() || !options.output_file.empty() || !options.discarded_output_file.empty() || !options.genomic_breakpoints_file.empty() || !options.metrics_file.empty();
+	if (!options.server_socket.empty()) {
+		crash(!options.batch_manifest_file.empty(), "options -B and -P are mutually exclusive");
+		crash(sample_options_given, "options -x, -c, -o, -O, -d, and -J must be specified by the jobs when option -P is used");
+	} else if (!options.batch_manifest_file.empty()) {
+		crash(sample_options_given, "options -x, -c, -o, -O, -d, and -J must be specified in the manifest when option -B is used");
+		parse_batch_manifest(options.batch_manifest_file, options.batch_samples);
+	} else {
+		crash(options.rna_bam_file.empty(), "missing mandatory option -x");
+		crash(options.output_file.empty(), "missing mandatory option -o");
+	}
+	crash(options.memory_quota > 0 && options.server_socket.empty(), "option -q requires option -P");
 	crash(options.gene_annotation_file.empty(), "missing mandatory option -g");
-	crash(options.output_file.empty(), "missing mandatory option -o");
 	crash(options.assembly_file.empty(), "missing mandatory option -a");
 	crash(options.filters["blacklist"] && options.blacklist_file.empty(), "filter 'blacklist' enabled, but missing option -b (use '-f blacklist' if you want to disable the blacklist)");
 
 	return options;
 }
 
+options_t parse_job_arguments(const string& arguments, const options_t& server_options) {
+
+	// split arguments at blanks and convert them to the format of the command-line
+	vector<string> tokens(1, "arriba");
+	istringstream iss(arguments);
+	string token;
+	while (iss >> token)
+		tokens.push_back(token);
+	vector<char*> argv;
+	for (auto token = tokens.begin(); token != tokens.end(); ++token)
+		argv.push_back(&(*token)[0]);
+	argv.push_back(NULL);
+
+	// the options of the job are applied on top of the options of the server
+	options_t options = server_options;
+	#ifdef __APPLE__
+		optreset = 1;
+		optind = 1;
+	#else
+		optind = 0; // reinitialize getopt
+	#endif
+	parse_options(tokens.size(), &argv[0], options);
+
+	// check for mandatory arguments
+	crash(options.rna_bam_file.empty(), "missing mandatory option -x");
+	crash(options.output_file.empty(), "missing mandatory option -o");
+
+	// options which determine the loaded references cannot be changed by a job
+	crash(options.assembly_file != server_options.assembly_file ||
+	      options.assembly_cache_file != server_options.assembly_cache_file ||
+	      options.gene_annotation_file != server_options.gene_annotation_file ||
+	      options.gtf_features != server_options.gtf_features ||
+	      options.blacklist_file != server_options.blacklist_file ||
+	      options.known_fusions_file != server_options.known_fusions_file ||
+	      options.tags_file != server_options.tags_file ||
+	      options.protein_domains_file != server_options.protein_domains_file ||
+	      options.interesting_contigs != server_options.interesting_contigs ||
+	      options.filters.at("uninteresting_contigs") != server_options.filters.at("uninteresting_contigs") ||
+	      options.batch_manifest_file != server_options.batch_manifest_file ||
+	      options.server_socket != server_options.server_socket ||
+	      options.memory_quota != server_options.memory_quota ||
+	      options.batch_workers != server_options.batch_workers,
+	      "options -a, -y, -g, -G, -b, -k, -t, -p, -i, -B, -P, -q, -n, and '-f uninteresting_contigs' cannot be specified by a job");
+
+	return options;
+}
@@ -5,6 +5,7 @@
 #include <climits>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 using namespace std;
 
@@ -22,6 +23,16 @@ bool validate_int(const char* optarg, int& value, const int min_value = INT_MIN,
 bool validate_int(const char* optarg, unsigned int& value, const unsigned int min_value = 0, const unsigned int max_value = INT_MAX);
 bool validate_float(const char* optarg, float& value, const float min_value = FLT_MIN, const float max_value = FLT_MAX);
 
+// per-sample input and output files listed in the manifest of batch mode
+struct batch_sample_t {
+	string chimeric_bam_file;
+	string rna_bam_file;
+	string output_file;
+	string discarded_output_file;
+	string genomic_breakpoints_file;
+	string metrics_file;
+};
+
 struct options_t {
 	string chimeric_bam_file;
 	string rna_bam_file;
@@ -32,7 +43,9 @@ struct options_t {
 	string known_fusions_file;
 	string output_file;
 	string discarded_output_file;
+	string metrics_file;
 	string assembly_file;
+	string assembly_cache_file;
 	string blacklist_file;
 	string interesting_contigs;
 	string viral_contigs;
@@ -54,6 +67,9 @@ struct options_t {
 	unsigned int min_spliced_events;
 	float mismatch_pvalue_cutoff;
 	unsigned int subsampling_threshold;
+	int coverage_resolution;
+	unsigned int threads;
+	bool breakpoint_coverage;
 	float high_expression_quantile;
 	float exonic_fraction;
 	bool external_duplicate_marking;
@@ -63,8 +79,16 @@ struct options_t {
 	unsigned int max_itd_length;
 	float min_itd_allele_fraction;
 	unsigned int min_itd_support;
+	string batch_manifest_file;
+	vector<batch_sample_t> batch_samples;
+	unsigned int batch_workers;
+	string server_socket;
+	float memory_quota;
+	float collation_memory_limit;
 };
 
 options_t parse_arguments(int argc, char **argv);
 
+options_t parse_job_arguments(const string& arguments, const options_t& server_options);
+
 #endif /* OPTIONS_H */
@@ -7,6 +7,7 @@
 #include <map>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 #include "sam.h"
@@ -20,7 +21,7 @@
 
 using namespace std;
 
-typedef map< position_t, map<string/*base*/,unsigned int/*frequency*/> > pileup_t;
+const unsigned int OUTPUT_BATCH_SIZE = 10000; // number of fusions formatted in parallel before they are written to the output file
 
 void pileup_chimeric_alignments(vector<chimeric_alignments_t::iterator>& chimeric_alignments, const unsigned int mate, const bool reverse_complement, const direction_t direction, const position_t breakpoint, pileup_t& pileup) {
 
@@ -43,7 +44,7 @@ void pileup_chimeric_alignments(vector<chimeric_alignments_t::iterator>& chimeri
 				if (read.start != breakpoint && read.end != breakpoint)
 					continue; // ignore split reads with slightly different breakpoints due to alternative alignments, since they would mess up the pileup
 
-		string read_sequence = (mate == SUPPLEMENTARY) ? (**chimeric_alignment).second[SPLIT_READ].sequence : read.sequence;
+		string read_sequence = (mate == SUPPLEMENTARY) ? (**chimeric_alignment).second[SPLIT_READ].sequence.str() : read.sequence.str();
 		if (reverse_complement)
 			read_sequence = dna_to_reverse_complement(read_sequence);
 
@@ -54,7 +55,7 @@ void pileup_chimeric_alignments(vector<chimeric_alignments_t::iterator>& chimeri
 		for (unsigned int cigar_element = 0; cigar_element < read.cigar.size(); cigar_element++) {
 			switch (read.cigar.operation(cigar_element)) {
 				case BAM_CINS:
-					pileup[reference_offset][read_sequence.substr(read_offset, read.cigar.op_length(cigar_element)+1)]++;
+					pileup.add(reference_offset, read_sequence.substr(read_offset, read.cigar.op_length(cigar_element)+1));
 					read_offset += read.cigar.op_length(cigar_element) + 1; // +1, because we take one base from the next element
 					++reference_offset; // +1, because we take one base from the next element
 					subtract_from_next_element = 1; // because we took one base from the next element
@@ -67,7 +68,7 @@ void pileup_chimeric_alignments(vector<chimeric_alignments_t::iterator>& chimeri
 					break;
 				case BAM_CDEL:
 					for (position_t base = 0; base < (int) read.cigar.op_length(cigar_element) - subtract_from_next_element; ++base, ++reference_offset)
-						pileup[reference_offset]["-"]++; // indicate deletion by dash
+						pileup.add(reference_offset, '-'); // indicate deletion by dash
 					subtract_from_next_element = 0;
 					break;
 				case BAM_CHARD_CLIP:
@@ -88,7 +89,10 @@ void pileup_chimeric_alignments(vector<chimeric_alignments_t::iterator>& chimeri
 				case BAM_CEQUAL:
 				case BAM_CDIFF:
 					for (position_t base = 0; base < (int) read.cigar.op_length(cigar_element) - subtract_from_next_element; ++base, ++read_offset, ++reference_offset)
-						pileup[reference_offset][read_sequence.substr(read_offset,1)]++;
+						if (read_offset < (position_t) read_sequence.size())
+							pileup.add(reference_offset, read_sequence[read_offset]);
+						else // the CIGAR string runs past the end of the read => add an empty allele (or throw) like substr() does
+							pileup.add(reference_offset, read_sequence.substr(read_offset, 1));
 					subtract_from_next_element = 0;
 					break;
 			}
@@ -99,33 +103,30 @@ void pileup_chimeric_alignments(vector<chimeric_alignments_t::iterator>& chimeri
 	for (auto intron = introns.begin(); intron != introns.end(); ++intron) {
 		position_t intron_start = get<0>(intron->first);
 		position_t intron_end = get<1>(intron->first);
-		pileup[intron_start][">"] += intron->second; // intron start is represented as ">"
-		pileup[intron_end]["<"] += intron->second; // intron end is represented as "<"
+		pileup.add(intron_start, '>', intron->second); // intron start is represented as ">"
+		pileup.add(intron_end, '<', intron->second); // intron end is represented as "<"
 		for (auto i = intron_start+1; i < intron_end; ++i)
-			pileup[i]["_"]+= intron->second; // intron is represented as "_"
+			pileup.add(i, '_', intron->second); // intron is represented as "_"
 	}
 }
 
 void get_sequence_from_pileup(const pileup_t& pileup, const position_t breakpoint, const direction_t direction, const gene_t gene, const assembly_t& assembly, string& sequence, vector<position_t>& positions, string& clipped_sequence) {
 
+	pileup_t::covered_positions_t covered_positions;
+	pileup.get_covered_positions(covered_positions);
+
 	// determine peak coverage
 	unsigned int peak_coverage = 0;
-	for (pileup_t::const_iterator position = pileup.begin(); position != pileup.end(); ++position) {
-		unsigned int coverage = 0;
-		for (auto base = position->second.begin(); base != position->second.end(); ++base)
-			coverage += base->second;
-		if (coverage > peak_coverage)
-			peak_coverage = coverage;
-	}
+	for (pileup_t::covered_positions_t::const_iterator position = covered_positions.begin(); position != covered_positions.end(); ++position)
+		if (position->second->coverage > peak_coverage)
+			peak_coverage = position->second->coverage;
 
 	// ignore low-coverage regions distal to the breakpoint, because they probably belong to other transcript isoforms
 	const float low_coverage_fraction = 0.10; // consider less than this fraction of the peak coverage as low
-	pileup_t::const_iterator start_sufficient_coverage = pileup.begin();
-	pileup_t::const_iterator end_sufficient_coverage = pileup.end();
-	for (pileup_t::const_iterator position = pileup.begin(); position != pileup.end(); ++position) {
-		unsigned int coverage = 0;
-		for (auto base = position->second.begin(); base != position->second.end(); ++base)
-			coverage += base->second;
+	pileup_t::covered_positions_t::const_iterator start_sufficient_coverage = covered_positions.begin();
+	pileup_t::covered_positions_t::const_iterator end_sufficient_coverage = covered_positions.end();
+	for (pileup_t::covered_positions_t::const_iterator position = covered_positions.begin(); position != covered_positions.end(); ++position) {
+		unsigned int coverage = position->second->coverage;
 		if (direction == DOWNSTREAM) {
 			if (coverage < peak_coverage * low_coverage_fraction)
 				start_sufficient_coverage = position;
@@ -136,13 +137,14 @@ void get_sequence_from_pileup(const pileup_t& pileup, const position_t breakpoin
 				end_sufficient_coverage = position;
 		}
 	}
-	if (end_sufficient_coverage != pileup.end())
+	if (end_sufficient_coverage != covered_positions.end())
 		++end_sufficient_coverage;
 
 	// for each position, find the most frequent allele in the pileup
 	bool intron_open = false; // keep track of whether the current position is in an intron
 	bool intron_closed = true; // keep track of whether the current position is in an intron
-	for (pileup_t::const_iterator position = start_sufficient_coverage; position != end_sufficient_coverage; ++position) {
+	pileup_t::alleles_t alleles;
+	for (pileup_t::covered_positions_t::const_iterator position = start_sufficient_coverage; position != end_sufficient_coverage; ++position) {
 
 		if (position != start_sufficient_coverage && prev(position)->first < position->first - 1 && !intron_open) {
 			sequence += "..."; // indicate uncovered stretches with an ellipsis
@@ -156,16 +158,17 @@ void get_sequence_from_pileup(const pileup_t& pileup, const position_t breakpoin
 			reference_base = contig_sequence->second[position->first];
 
 		// find most frequent allele at current position and compute coverage
-		auto most_frequent_base = position->second.end();
+		pileup.get_alleles(position->first, *position->second, alleles);
+		auto most_frequent_base = alleles.end();
 		unsigned int coverage = 0;
-		for (auto base = position->second.begin(); base != position->second.end(); ++base) {
-			bool base_is_intron = base->first == "_" || base->first == ">" || base->first == "<";
-			if (most_frequent_base == position->second.end() ||
+		for (auto base = alleles.begin(); base != alleles.end(); ++base) {
+			bool base_is_intron = *base->first == "_" || *base->first == ">" || *base->first == "<";
+			if (most_frequent_base == alleles.end() ||
 			    base->second > most_frequent_base->second ||
 			    (base->second == most_frequent_base->second &&
-			     ((base->first == reference_base && most_frequent_base->first != "_" && most_frequent_base->first != ">" && most_frequent_base->first != "<") ||
-			      (base->first == "<" && most_frequent_base->first != "_" && most_frequent_base->first != ">") ||
-			      (base->first == "_" || base->first == ">"))))
+			     ((*base->first == reference_base && *most_frequent_base->first != "_" && *most_frequent_base->first != ">" && *most_frequent_base->first != "<") ||
+			      (*base->first == "<" && *most_frequent_base->first != "_" && *most_frequent_base->first != ">") ||
+			      (*base->first == "_" || *base->first == ">"))))
 				most_frequent_base = base;
 			if (!base_is_intron)
 				coverage += base->second;
@@ -174,9 +177,9 @@ void get_sequence_from_pileup(const pileup_t& pileup, const position_t breakpoin
 		// we trust the base, if it has a frequency of >= 75%
 		// or if it is an intron with a frequency higher than the coverage
 		// or if the base matches the reference
-		string most_frequent_base2 = ((most_frequent_base->first == "_" || most_frequent_base->first == ">" || most_frequent_base->first == "<") && most_frequent_base->second >= coverage ||
+		string most_frequent_base2 = ((*most_frequent_base->first == "_" || *most_frequent_base->first == ">" || *most_frequent_base->first == "<") && most_frequent_base->second >= coverage ||
 		                              most_frequent_base->second >= 0.75 * coverage ||
-		                              most_frequent_base->first == reference_base) ? most_frequent_base->first : "?";
+		                              *most_frequent_base->first == reference_base) ? *most_frequent_base->first : "?";
 
 
 		if (most_frequent_base2 == "_") { // in the middle of an intron
@@ -495,7 +498,7 @@ struct sort_fusions_by_rank_of_best_t {
 	}
 };
 
-string gene_to_name(const gene_t gene, const contig_t contig, const position_t breakpoint, gene_annotation_index_t& gene_annotation_index) {
+string gene_to_name(const gene_t gene, const contig_t contig, const position_t breakpoint, const gene_annotation_index_t& gene_annotation_index) {
 	// if the gene is not a dummy gene (intergenic region), simply return the name of the gene
 	if (!gene->is_dummy) {
 		return gene->name;
@@ -504,8 +507,8 @@ string gene_to_name(const gene_t gene, const contig_t contig, const position_t b
 		string result;
 
 		// lookup position in gene annotation index
-		gene_contig_annotation_index_t::iterator index_hit2 = gene_annotation_index[contig].lower_bound(breakpoint);
-		gene_contig_annotation_index_t::reverse_iterator index_hit1(index_hit2);
+		gene_contig_annotation_index_t::const_iterator index_hit2 = gene_annotation_index[contig].lower_bound(breakpoint);
+		gene_contig_annotation_index_t::const_reverse_iterator index_hit1(index_hit2);
 
 		// go upstream until we find a non-dummy gene
 		while (index_hit1 != gene_annotation_index[contig].rend() && (index_hit1->second.empty() || (**(index_hit1->second.begin())).is_dummy))
@@ -513,7 +516,7 @@ string gene_to_name(const gene_t gene, const contig_t contig, const position_t b
 
 		// append upstream flanking genes with distances to gene name
 		if (index_hit1 != gene_annotation_index[contig].rend()) {
-			for (gene_set_t::iterator gene = index_hit1->second.begin(); gene != index_hit1->second.end(); gene = upper_bound(index_hit1->second.begin(), index_hit1->second.end(), *gene)) {
+			for (gene_set_t::const_iterator gene = index_hit1->second.begin(); gene != index_hit1->second.end(); gene = upper_bound(index_hit1->second.begin(), index_hit1->second.end(), *gene)) {
 				if (!(**gene).is_dummy) {
 					if (!result.empty())
 						result += ",";
@@ -528,7 +531,7 @@ string gene_to_name(const gene_t gene, const contig_t contig, const position_t b
 
 		// append downstream flanking genes with distances to gene name
 		if (index_hit2 != gene_annotation_index[contig].end()) {
-			for (gene_set_t::iterator gene = index_hit2->second.begin(); gene != index_hit2->second.end(); gene = upper_bound(index_hit2->second.begin(), index_hit2->second.end(), *gene)) {
+			for (gene_set_t::const_iterator gene = index_hit2->second.begin(); gene != index_hit2->second.end(); gene = upper_bound(index_hit2->second.begin(), index_hit2->second.end(), *gene)) {
 				if (!(**gene).is_dummy) {
 					if (!result.empty())
 						result += ",";
@@ -1039,7 +1042,198 @@ void fill_gaps_in_fusion_transcript_sequence(string& transcript_sequence, vector
 	}
 }
 
-void write_fusions_to_file(fusions_t& fusions, const string& output_file, const coverage_t& coverage, const assembly_t& assembly, gene_annotation_index_t& gene_annotation_index, exon_annotation_index_t& exon_annotation_index, vector<string> original_contig_names, const tags_t& tags, const protein_domain_annotation_index_t& protein_domain_annotation_index, const int max_mate_gap, const unsigned int max_itd_length, const bool print_extra_info, const bool fill_sequence_gaps, const bool write_discarded_fusions) {
+// compute the columns of a fusion and format them as a line of the output file
+void format_fusion(fusion_t& fusion, const coverage_t& coverage, const assembly_t& assembly, const gene_annotation_index_t& gene_annotation_index, const exon_annotation_index_t& exon_annotation_index, const vector<string>& original_contig_names, const tags_t& tags, const protein_domain_annotation_index_t& protein_domain_annotation_index, const int max_mate_gap, const unsigned int max_itd_length, const bool print_extra_info, const bool fill_sequence_gaps, string& line) {
+
+	ostringstream out;
+
+	// describe site of breakpoint
+	string site_5 = get_fusion_site(fusion.gene1, fusion.spliced1, fusion.exonic1, fusion.contig1, fusion.breakpoint1, exon_annotation_index);
+	string site_3 = get_fusion_site(fusion.gene2, fusion.spliced2, fusion.exonic2, fusion.contig2, fusion.breakpoint2, exon_annotation_index);
+	
+	// assign confidence scores
+	string confidence;
+	switch (fusion.confidence) {
+		case CONFIDENCE_LOW:
+			confidence = "low";
+			break;
+		case CONFIDENCE_MEDIUM:
+			confidence = "medium";
+			break;
+		case CONFIDENCE_HIGH:
+			confidence = "high";
+			break;
+	}
+
+	// the 5' gene should always come first => swap columns, if necessary
+	gene_t gene_5 = fusion.gene1; gene_t gene_3 = fusion.gene2;
+	contig_t contig_5 = fusion.contig1; contig_t contig_3 = fusion.contig2;
+	position_t breakpoint_5 = fusion.breakpoint1; position_t breakpoint_3 = fusion.breakpoint2;
+	direction_t direction_5 = fusion.direction1; direction_t direction_3 = fusion.direction2;
+	unsigned int split_reads_5 = fusion.split_reads1; unsigned int split_reads_3 = fusion.split_reads2;
+	strand_t strand_5 = fusion.predicted_strand1; strand_t strand_3 = fusion.predicted_strand2;
+	position_t closest_genomic_breakpoint_5 = fusion.closest_genomic_breakpoint1; position_t closest_genomic_breakpoint_3 = fusion.closest_genomic_breakpoint2;
+	if (fusion.transcript_start == TRANSCRIPT_START_GENE2) {
+		swap(gene_5, gene_3);
+		swap(direction_5, direction_3);
+		swap(contig_5, contig_3);
+		swap(breakpoint_5, breakpoint_3);
+		swap(site_5, site_3);
+		swap(split_reads_5, split_reads_3);
+		swap(strand_5, strand_3);
+		swap(closest_genomic_breakpoint_5, closest_genomic_breakpoint_3);
+	}
+
+	int coverage_5 = coverage.get_coverage(contig_5, breakpoint_5, (direction_5 == UPSTREAM) ? DOWNSTREAM : UPSTREAM);
+	int coverage_3 = coverage.get_coverage(contig_3, breakpoint_3, (direction_3 == UPSTREAM) ? DOWNSTREAM : UPSTREAM);
+
+	// compute columns that are only printed in the main output file but omitted in the discarded output file
+	string transcript_sequence = ".";
+	vector<transcript_t> transcripts_5;
+	vector<transcript_t> transcripts_3;
+	transcript_t transcript_5 = NULL;
+	transcript_t transcript_3 = NULL;
+	string fusion_peptide_sequence = ".";
+	string reading_frame = ".";
+	if (print_extra_info) {
+
+		// compute fusion transcript sequence
+		vector<position_t> positions;
+		get_fusion_transcript_sequence(fusion, assembly, transcript_sequence, positions);
+		const string transcript_sequence_backup = transcript_sequence;
+		const vector<position_t> positions_backup = positions;
+
+		// compute fusion peptide sequence
+		// we need to try all combinations of the 5' and 3' transcript candidates until we have found one that is in-frame
+		get_transcripts(transcript_sequence, positions, gene_5, strand_5, fusion.predicted_strands_ambiguous, 5, exon_annotation_index, transcripts_5);
+		get_transcripts(transcript_sequence, positions, gene_3, strand_3, fusion.predicted_strands_ambiguous, 3, exon_annotation_index, transcripts_3);
+		for (auto t_5 = transcripts_5.begin(); (transcripts_5.empty() || t_5 != transcripts_5.end()) && reading_frame != "in-frame"; ++t_5) {
+			if (t_5 != transcripts_5.end()) // possibly, we enter this loop when there aren't any 5' transcripts => leave transcript_5 as NULL in this case
+				transcript_5 = *t_5;
+			for (auto t_3 = transcripts_3.begin(); (transcripts_3.empty() || t_3 != transcripts_3.end()) && reading_frame != "in-frame"; ++t_3) {
+				if (t_3 != transcripts_3.end()) // possibly, we enter this loop when there aren't any 3' transcripts => leave transcript_3 as NULL in this case
+					transcript_3 = *t_3;
+				if (fill_sequence_gaps) { // if requested by the user, fill gaps in the transcript (as assembled from the fusion reads) with information from the reference genome
+					transcript_sequence = transcript_sequence_backup; // we may have to do this multiple times (in case of multiple transcripts) => restore the unfilled sequence first
+					positions = positions_backup;
+					fill_gaps_in_fusion_transcript_sequence(transcript_sequence, positions, transcript_5, transcript_3, strand_5, strand_3, fusion.is_internal_tandem_duplication(max_itd_length), assembly);
+				}
+				fusion_peptide_sequence = get_fusion_peptide_sequence(transcript_sequence, positions, gene_5, gene_3, transcript_5, transcript_3, strand_3, exon_annotation_index, assembly);
+				reading_frame = is_in_frame(fusion_peptide_sequence);
+				if (t_3 == transcripts_3.end())
+					break; // we get here when there are no 3' transcripts at all, but we entered the loop nonetheless
+			}
+			if (t_5 == transcripts_5.end() || transcripts_3.empty())
+				break; // we get here when there are no 5' transcripts at all, but we entered the loop nonetheless
+		}
+
+		if (reading_frame == "stop-codon") // discard peptide sequence when there is a stop codon prior to the fusion junction
+			fusion_peptide_sequence = ".";
+	}
+
+	// write line to output file
+	out << gene_to_name(gene_5, contig_5, breakpoint_5, gene_annotation_index) << "\t" << gene_to_name(gene_3, contig_3, breakpoint_3, gene_annotation_index) << "\t"
+	    << get_fusion_strand(strand_5, gene_5, fusion.predicted_strands_ambiguous) << "\t" << get_fusion_strand(strand_3, gene_3, fusion.predicted_strands_ambiguous) << "\t"
+	    << original_contig_names[contig_5] << ":" << (breakpoint_5+1) << "\t" << original_contig_names[contig_3] << ":" << (breakpoint_3+1) << "\t"
+	    << site_5 << "\t" << site_3 << "\t"
+	    << get_fusion_type(fusion, max_itd_length) << "\t" << split_reads_5 << "\t" << split_reads_3 << "\t" << fusion.discordant_mates << "\t"
+	    << ((coverage_5 >= 0) ? to_string(static_cast<long long int>(coverage_5)) : ".") << "\t" << ((coverage_3 >= 0) ? to_string(static_cast<long long int>(coverage_3)) : ".") << "\t"
+	    << confidence << "\t"
+	    << reading_frame;
+
+	out << "\t";
+	if (!tags.rules.empty())
+		out << annotate_tags(fusion, tags, max_mate_gap);
+	else
+		out << ".";
+
+	out << "\t";
+	if (!protein_domain_annotation_index.empty()) {
+		string protein_domains_5 = annotate_retained_protein_domains(contig_5, breakpoint_5, strand_5, fusion.predicted_strands_ambiguous, gene_5, direction_5, protein_domain_annotation_index);
+		string protein_domains_3 = annotate_retained_protein_domains(contig_3, breakpoint_3, strand_3, fusion.predicted_strands_ambiguous, gene_3, direction_3, protein_domain_annotation_index);
+		if (!protein_domains_5.empty() || ! protein_domains_3.empty()) {
+			out << protein_domains_5 << "|" << protein_domains_3;
+		} else {
+			out << ".";
+		}
+	} else {
+		out << ".";
+	}
+
+	// convert closest genomic breakpoints to strings of the format <chr>:<position>(<distance to transcriptomic breakpoint>)
+	out << "\t";
+	if (closest_genomic_breakpoint_5 >= 0)
+		out << original_contig_names[contig_5] + ":" + to_string(static_cast<long long int>(closest_genomic_breakpoint_5+1)) + "(" + to_string(static_cast<long long int>(abs(breakpoint_5 - closest_genomic_breakpoint_5))) + ")";
+	else
+		out << ".";
+	out << "\t";
+	if (closest_genomic_breakpoint_3 >= 0)
+		out << original_contig_names[contig_3] + ":" + to_string(static_cast<long long int>(closest_genomic_breakpoint_3+1)) + "(" + to_string(static_cast<long long int>(abs(breakpoint_3 - closest_genomic_breakpoint_3))) + ")";
+	else
+		out << ".";
+
+	// count the number of reads discarded by a given filter
+	map<string,unsigned int> filters;
+	if (fusion.filter != FILTER_none)
+		filters[FILTERS[fusion.filter]] = 0;
+	vector<chimeric_alignments_t::iterator> all_supporting_reads;
+	all_supporting_reads.insert(all_supporting_reads.end(), fusion.split_read1_list.begin(), fusion.split_read1_list.end());
+	all_supporting_reads.insert(all_supporting_reads.end(), fusion.split_read2_list.begin(), fusion.split_read2_list.end());
+	all_supporting_reads.insert(all_supporting_reads.end(), fusion.discordant_mate_list.begin(), fusion.discordant_mate_list.end());
+	for (auto chimeric_alignment = all_supporting_reads.begin(); chimeric_alignment != all_supporting_reads.end(); ++chimeric_alignment)
+		if ((**chimeric_alignment).second.filter != FILTER_none)
+			filters[FILTERS[(**chimeric_alignment).second.filter]]++;
+
+	// print gene IDs and transcript IDs
+	out << "\t" << ((gene_5->is_dummy) ? "." : gene_5->gene_id)
+	    << "\t" << ((gene_3->is_dummy) ? "." : gene_3->gene_id);
+	out << "\t" << ((transcript_5 == NULL) ? "." : transcript_5->name)
+	    << "\t" << ((transcript_3 == NULL) ? "." : transcript_3->name);
+
+	out << "\t" << ((direction_5 == UPSTREAM) ? "upstream" : "downstream") << "\t" << ((direction_3 == UPSTREAM) ? "upstream" : "downstream");
+
+	// output filters
+	out << "\t";
+	if (filters.empty()) {
+		out << ".";
+	} else {
+		for (auto filter = filters.begin(); filter != filters.end(); ++filter) {
+			if (filter != filters.begin())
+				out << ",";
+			out << filter->first;
+			if (filter->second != 0)
+				out << "(" << filter->second << ")";
+		}
+	}
+
+	// print transcript and peptide sequences
+	out << "\t" << transcript_sequence << "\t" << fusion_peptide_sequence;
+
+	// print identifiers of supporting reads
+	out << "\t";
+	if (print_extra_info && !all_supporting_reads.empty()) {
+		for (auto read = all_supporting_reads.begin(); read != all_supporting_reads.end(); ++read) {
+			if (read != all_supporting_reads.begin())
+				out << ",";
+			out << strip_hi_tag_from_read_name((**read).first);
+		}
+	} else {
+		out << ".";
+	}
+
+	out << endl;
+	line = out.str();
+}
+
+// the fusions <first_fusion>, <first_fusion> + <fusion_step>, ... are formatted, such that several threads can work in parallel
+void format_fusions(const vector<fusion_t*>::const_iterator fusions_begin, const vector<fusion_t*>::const_iterator fusions_end, const unsigned int first_fusion, const unsigned int fusion_step, const coverage_t& coverage, const assembly_t& assembly, const gene_annotation_index_t& gene_annotation_index, const exon_annotation_index_t& exon_annotation_index, const vector<string>& original_contig_names, const tags_t& tags, const protein_domain_annotation_index_t& protein_domain_annotation_index, const int max_mate_gap, const unsigned int max_itd_length, const bool print_extra_info, const bool fill_sequence_gaps, vector<string>& lines) {
+	for (unsigned int fusion = first_fusion; fusion < lines.size(); fusion += fusion_step) {
+		count_work_of_fusion(**(fusions_begin + fusion));
+		format_fusion(**(fusions_begin + fusion), coverage, assembly, gene_annotation_index, exon_annotation_index, original_contig_names, tags, protein_domain_annotation_index, max_mate_gap, max_itd_length, print_extra_info, fill_sequence_gaps, lines[fusion]);
+	}
+}
+
+void write_fusions_to_file(fusions_t& fusions, const string& output_file, const coverage_t& coverage, const assembly_t& assembly, const gene_annotation_index_t& gene_annotation_index, const exon_annotation_index_t& exon_annotation_index, vector<string> original_contig_names, const tags_t& tags, const protein_domain_annotation_index_t& protein_domain_annotation_index, const int max_mate_gap, const unsigned int max_itd_length, const bool print_extra_info, const bool fill_sequence_gaps, const bool write_discarded_fusions, const unsigned int threads) {
 
 	// make a vector of pointers to all fusions
 	// the vector will hold the fusions in sorted order
@@ -1076,185 +1270,23 @@ void write_fusions_to_file(fusions_t& fusions, const string& output_file, const
 	ofstream out(output_file);
 	crash(!out.is_open(), "failed to open output file");
 	out << "#gene1\tgene2\tstrand1(gene/fusion)\tstrand2(gene/fusion)\tbreakpoint1\tbreakpoint2\tsite1\tsite2\ttype\tsplit_reads1\tsplit_reads2\tdiscordant_mates\tcoverage1\tcoverage2\tconfidence\treading_frame\ttags\tretained_protein_domains\tclosest_genomic_breakpoint1\tclosest_genomic_breakpoint2\tgene_id1\tgene_id2\ttranscript_id1\ttranscript_id2\tdirection1\tdirection2\tfilters\tfusion_transcript\tpeptide_sequence\tread_identifiers" << endl;
-	for (auto fusion = sorted_fusions.begin(); fusion != sorted_fusions.end(); ++fusion) {
-
-		// describe site of breakpoint
-		string site_5 = get_fusion_site((**fusion).gene1, (**fusion).spliced1, (**fusion).exonic1, (**fusion).contig1, (**fusion).breakpoint1, exon_annotation_index);
-		string site_3 = get_fusion_site((**fusion).gene2, (**fusion).spliced2, (**fusion).exonic2, (**fusion).contig2, (**fusion).breakpoint2, exon_annotation_index);
-		
-		// assign confidence scores
-		string confidence;
-		switch ((**fusion).confidence) {
-			case CONFIDENCE_LOW:
-				confidence = "low";
-				break;
-			case CONFIDENCE_MEDIUM:
-				confidence = "medium";
-				break;
-			case CONFIDENCE_HIGH:
-				confidence = "high";
-				break;
-		}
-
-		// the 5' gene should always come first => swap columns, if necessary
-		gene_t gene_5 = (**fusion).gene1; gene_t gene_3 = (**fusion).gene2;
-		contig_t contig_5 = (**fusion).contig1; contig_t contig_3 = (**fusion).contig2;
-		position_t breakpoint_5 = (**fusion).breakpoint1; position_t breakpoint_3 = (**fusion).breakpoint2;
-		direction_t direction_5 = (**fusion).direction1; direction_t direction_3 = (**fusion).direction2;
-		unsigned int split_reads_5 = (**fusion).split_reads1; unsigned int split_reads_3 = (**fusion).split_reads2;
-		strand_t strand_5 = (**fusion).predicted_strand1; strand_t strand_3 = (**fusion).predicted_strand2;
-		position_t closest_genomic_breakpoint_5 = (**fusion).closest_genomic_breakpoint1; position_t closest_genomic_breakpoint_3 = (**fusion).closest_genomic_breakpoint2;
-		if ((**fusion).transcript_start == TRANSCRIPT_START_GENE2) {
-			swap(gene_5, gene_3);
-			swap(direction_5, direction_3);
-			swap(contig_5, contig_3);
-			swap(breakpoint_5, breakpoint_3);
-			swap(site_5, site_3);
-			swap(split_reads_5, split_reads_3);
-			swap(strand_5, strand_3);
-			swap(closest_genomic_breakpoint_5, closest_genomic_breakpoint_3);
-		}
-
-		int coverage_5 = coverage.get_coverage(contig_5, breakpoint_5, (direction_5 == UPSTREAM) ? DOWNSTREAM : UPSTREAM);
-		int coverage_3 = coverage.get_coverage(contig_3, breakpoint_3, (direction_3 == UPSTREAM) ? DOWNSTREAM : UPSTREAM);
-
-		// compute columns that are only printed in the main output file but omitted in the discarded output file
-		string transcript_sequence = ".";
-		vector<transcript_t> transcripts_5;
-		vector<transcript_t> transcripts_3;
-		transcript_t transcript_5 = NULL;
-		transcript_t transcript_3 = NULL;
-		string fusion_peptide_sequence = ".";
-		string reading_frame = ".";
-		if (print_extra_info) {
-
-			// compute fusion transcript sequence
-			vector<position_t> positions;
-			get_fusion_transcript_sequence(**fusion, assembly, transcript_sequence, positions);
-			const string transcript_sequence_backup = transcript_sequence;
-			const vector<position_t> positions_backup = positions;
-
-			// compute fusion peptide sequence
-			// we need to try all combinations of the 5' and 3' transcript candidates until we have found one that is in-frame
-			get_transcripts(transcript_sequence, positions, gene_5, strand_5, (**fusion).predicted_strands_ambiguous, 5, exon_annotation_index, transcripts_5);
-			get_transcripts(transcript_sequence, positions, gene_3, strand_3, (**fusion).predicted_strands_ambiguous, 3, exon_annotation_index, transcripts_3);
-			for (auto t_5 = transcripts_5.begin(); (transcripts_5.empty() || t_5 != transcripts_5.end()) && reading_frame != "in-frame"; ++t_5) {
-				if (t_5 != transcripts_5.end()) // possibly, we enter this loop when there aren't any 5' transcripts => leave transcript_5 as NULL in this case
-					transcript_5 = *t_5;
-				for (auto t_3 = transcripts_3.begin(); (transcripts_3.empty() || t_3 != transcripts_3.end()) && reading_frame != "in-frame"; ++t_3) {
-					if (t_3 != transcripts_3.end()) // possibly, we enter this loop when there aren't any 3' transcripts => leave transcript_3 as NULL in this case
-						transcript_3 = *t_3;
-					if (fill_sequence_gaps) { // if requested by the user, fill gaps in the transcript (as assembled from the fusion reads) with information from the reference genome
-						transcript_sequence = transcript_sequence_backup; // we may have to do this multiple times (in case of multiple transcripts) => restore the unfilled sequence first
-						positions = positions_backup;
-						fill_gaps_in_fusion_transcript_sequence(transcript_sequence, positions, transcript_5, transcript_3, strand_5, strand_3, (**fusion).is_internal_tandem_duplication(max_itd_length), assembly);
-					}
-					fusion_peptide_sequence = get_fusion_peptide_sequence(transcript_sequence, positions, gene_5, gene_3, transcript_5, transcript_3, strand_3, exon_annotation_index, assembly);
-					reading_frame = is_in_frame(fusion_peptide_sequence);
-					if (t_3 == transcripts_3.end())
-						break; // we get here when there are no 3' transcripts at all, but we entered the loop nonetheless
-				}
-				if (t_5 == transcripts_5.end() || transcripts_3.empty())
-					break; // we get here when there are no 5' transcripts at all, but we entered the loop nonetheless
-			}
-
-			if (reading_frame == "stop-codon") // discard peptide sequence when there is a stop codon prior to the fusion junction
-				fusion_peptide_sequence = ".";
-		}
-
-		// write line to output file
-		out << gene_to_name(gene_5, contig_5, breakpoint_5, gene_annotation_index) << "\t" << gene_to_name(gene_3, contig_3, breakpoint_3, gene_annotation_index) << "\t"
-		    << get_fusion_strand(strand_5, gene_5, (**fusion).predicted_strands_ambiguous) << "\t" << get_fusion_strand(strand_3, gene_3, (**fusion).predicted_strands_ambiguous) << "\t"
-		    << original_contig_names[contig_5] << ":" << (breakpoint_5+1) << "\t" << original_contig_names[contig_3] << ":" << (breakpoint_3+1) << "\t"
-		    << site_5 << "\t" << site_3 << "\t"
-		    << get_fusion_type(**fusion, max_itd_length) << "\t" << split_reads_5 << "\t" << split_reads_3 << "\t" << (**fusion).discordant_mates << "\t"
-		    << ((coverage_5 >= 0) ? to_string(static_cast<long long int>(coverage_5)) : ".") << "\t" << ((coverage_3 >= 0) ? to_string(static_cast<long long int>(coverage_3)) : ".") << "\t"
-		    << confidence << "\t"
-		    << reading_frame;
-
-		out << "\t";
-		if (!tags.empty())
-			out << annotate_tags(**fusion, tags, max_mate_gap);
-		else
-			out << ".";
-
-		out << "\t";
-		if (!protein_domain_annotation_index.empty()) {
-			string protein_domains_5 = annotate_retained_protein_domains(contig_5, breakpoint_5, strand_5, (**fusion).predicted_strands_ambiguous, gene_5, direction_5, protein_domain_annotation_index);
-			string protein_domains_3 = annotate_retained_protein_domains(contig_3, breakpoint_3, strand_3, (**fusion).predicted_strands_ambiguous, gene_3, direction_3, protein_domain_annotation_index);
-			if (!protein_domains_5.empty() || ! protein_domains_3.empty()) {
-				out << protein_domains_5 << "|" << protein_domains_3;
-			} else {
-				out << ".";
-			}
-		} else {
-			out << ".";
-		}
-
-		// convert closest genomic breakpoints to strings of the format <chr>:<position>(<distance to transcriptomic breakpoint>)
-		out << "\t";
-		if (closest_genomic_breakpoint_5 >= 0)
-			out << original_contig_names[contig_5] + ":" + to_string(static_cast<long long int>(closest_genomic_breakpoint_5+1)) + "(" + to_string(static_cast<long long int>(abs(breakpoint_5 - closest_genomic_breakpoint_5))) + ")";
-		else
-			out << ".";
-		out << "\t";
-		if (closest_genomic_breakpoint_3 >= 0)
-			out << original_contig_names[contig_3] + ":" + to_string(static_cast<long long int>(closest_genomic_breakpoint_3+1)) + "(" + to_string(static_cast<long long int>(abs(breakpoint_3 - closest_genomic_breakpoint_3))) + ")";
-		else
-			out << ".";
 
-		// count the number of reads discarded by a given filter
-		map<string,unsigned int> filters;
-		if ((**fusion).filter != FILTER_none)
-			filters[FILTERS[(**fusion).filter]] = 0;
-		vector<chimeric_alignments_t::iterator> all_supporting_reads;
-		all_supporting_reads.insert(all_supporting_reads.end(), (**fusion).split_read1_list.begin(), (**fusion).split_read1_list.end());
-		all_supporting_reads.insert(all_supporting_reads.end(), (**fusion).split_read2_list.begin(), (**fusion).split_read2_list.end());
-		all_supporting_reads.insert(all_supporting_reads.end(), (**fusion).discordant_mate_list.begin(), (**fusion).discordant_mate_list.end());
-		for (auto chimeric_alignment = all_supporting_reads.begin(); chimeric_alignment != all_supporting_reads.end(); ++chimeric_alignment)
-			if ((**chimeric_alignment).second.filter != FILTER_none)
-				filters[FILTERS[(**chimeric_alignment).second.filter]]++;
-
-		// print gene IDs and transcript IDs
-		out << "\t" << ((gene_5->is_dummy) ? "." : gene_5->gene_id)
-		    << "\t" << ((gene_3->is_dummy) ? "." : gene_3->gene_id);
-		out << "\t" << ((transcript_5 == NULL) ? "." : transcript_5->name)
-		    << "\t" << ((transcript_3 == NULL) ? "." : transcript_3->name);
-
-		out << "\t" << ((direction_5 == UPSTREAM) ? "upstream" : "downstream") << "\t" << ((direction_3 == UPSTREAM) ? "upstream" : "downstream");
-
-		// output filters
-		out << "\t";
-		if (filters.empty()) {
-			out << ".";
-		} else {
-			for (auto filter = filters.begin(); filter != filters.end(); ++filter) {
-				if (filter != filters.begin())
-					out << ",";
-				out << filter->first;
-				if (filter->second != 0)
-					out << "(" << filter->second << ")";
-			}
-		}
-
-		// print transcript and peptide sequences
-		out << "\t" << transcript_sequence << "\t" << fusion_peptide_sequence;
-
-		// print identifiers of supporting reads
-		out << "\t";
-		if (print_extra_info && !all_supporting_reads.empty()) {
-			for (auto read = all_supporting_reads.begin(); read != all_supporting_reads.end(); ++read) {
-				if (read != all_supporting_reads.begin())
-					out << ",";
-				out << strip_hi_tag_from_read_name((**read).first);
-			}
-		} else {
-			out << ".";
-		}
-
-		out << endl;
+	// the lines are formatted in parallel and written in sorted order
+	// fusions are processed in batches to limit the memory consumed by the formatted lines
+	for (vector<fusion_t*>::const_iterator batch_begin = sorted_fusions.begin(); batch_begin != sorted_fusions.end();) {
+		vector<fusion_t*>::const_iterator batch_end = (sorted_fusions.end() - batch_begin > OUTPUT_BATCH_SIZE) ? batch_begin + OUTPUT_BATCH_SIZE : sorted_fusions.end();
+		vector<string> lines(batch_end - batch_begin);
+		vector<thread> workers;
+		for (unsigned int worker_id = 1; worker_id < threads; ++worker_id)
+			workers.push_back(start_thread(format_fusions, batch_begin, batch_end, worker_id, threads, cref(coverage), cref(assembly), cref(gene_annotation_index), cref(exon_annotation_index), cref(original_contig_names), cref(tags), cref(protein_domain_annotation_index), max_mate_gap, max_itd_length, print_extra_info, fill_sequence_gaps, ref(lines)));
+		format_fusions(batch_begin, batch_end, 0, threads, coverage, assembly, gene_annotation_index, exon_annotation_index, original_contig_names, tags, protein_domain_annotation_index, max_mate_gap, max_itd_length, print_extra_info, fill_sequence_gaps, lines);
+		for (auto worker = workers.begin(); worker != workers.end(); ++worker)
+			worker->join();
+		for (auto line = lines.begin(); line != lines.end(); ++line)
+			out << *line;
+		batch_begin = batch_end;
 	}
+
 	out.close();
 	crash(out.bad(), "failed to write to file");
 }
-
@@ -1,8 +1,10 @@
 #ifndef OUTPUT_FUSIONS_H
 #define OUTPUT_FUSIONS_H 1
 
+#include <map>
 #include <string>
 #include <vector>
+#include "common.hpp"
 #include "annotation.hpp"
 #include "annotate_tags.hpp"
 #include "annotate_protein_domains.hpp"
@@ -10,6 +12,106 @@
 
 using namespace std;
 
-void write_fusions_to_file(fusions_t& fusions, const string& output_file, const coverage_t& coverage, const assembly_t& assembly, gene_annotation_index_t& gene_annotation_index, exon_annotation_index_t& exon_annotation_index, vector<string> original_contig_names, const tags_t& tags, const protein_domain_annotation_index_t& protein_domain_annotation_index, const int max_mate_gap, const unsigned max_itd_length, const bool print_extra_info, const bool fill_sequence_gaps, const bool write_discarded_fusions);
+// alleles which have a dedicated counter in the pileup, in lexicographical order
+// deletions are represented as "-", intron starts as ">", intron ends as "<", and introns as "_"
+const unsigned int PILEUP_FIXED_ALLELES = 9;
+const string PILEUP_FIXED_ALLELE_NAMES[PILEUP_FIXED_ALLELES] = { "-", "<", ">", "A", "C", "G", "N", "T", "_" };
+
+inline int get_pileup_fixed_allele(const char allele) {
+	switch (allele) {
+		case '-': return 0;
+		case '<': return 1;
+		case '>': return 2;
+		case 'A': return 3;
+		case 'C': return 4;
+		case 'G': return 5;
+		case 'N': return 6;
+		case 'T': return 7;
+		case '_': return 8;
+		default: return -1;
+	}
+}
+
+const position_t PILEUP_BLOCK_SIZE = 256; // number of positions per block of the pileup
+
+// pileup of the reads around a breakpoint
+// the frequencies of bases, deletions, and introns are counted in dense blocks of columns,
+// insertions and unusual bases are rare and thus kept in a side table
+class pileup_t {
+	public:
+		struct column_t {
+			unsigned int frequency[PILEUP_FIXED_ALLELES];
+			unsigned int coverage; // sum of the frequencies of all alleles, including those in the side table
+			bool has_other_alleles;
+		};
+		typedef vector< pair<position_t,const column_t*> > covered_positions_t;
+		typedef vector< pair<const string*/*allele*/,unsigned int/*frequency*/> > alleles_t;
+	private:
+		map< position_t/*start of block*/, vector<column_t> > blocks;
+		map< position_t, map<string/*allele*/,unsigned int/*frequency*/> > other_alleles;
+		column_t& get_column(const position_t position) {
+			const position_t block_start = position - (position % PILEUP_BLOCK_SIZE + PILEUP_BLOCK_SIZE) % PILEUP_BLOCK_SIZE;
+			vector<column_t>& block = blocks[block_start];
+			if (block.empty())
+				block.resize(PILEUP_BLOCK_SIZE); // initializes all counters with 0
+			return block[position - block_start];
+		};
+	public:
+		void add(const position_t position, const char allele, const unsigned int frequency = 1) {
+			count_operation(OPERATION_pileup_positions);
+			column_t& column = get_column(position);
+			const int fixed_allele = get_pileup_fixed_allele(allele);
+			if (fixed_allele >= 0) {
+				column.frequency[fixed_allele] += frequency;
+			} else {
+				other_alleles[position][string(1, allele)] += frequency;
+				column.has_other_alleles = true;
+			}
+			column.coverage += frequency;
+		};
+		void add(const position_t position, const string& allele, const unsigned int frequency = 1) {
+			if (allele.size() == 1) {
+				add(position, allele[0], frequency);
+			} else { // insertion
+				count_operation(OPERATION_pileup_positions);
+				column_t& column = get_column(position);
+				other_alleles[position][allele] += frequency;
+				column.has_other_alleles = true;
+				column.coverage += frequency;
+			}
+		};
+		// get the positions with coverage in ascending order
+		void get_covered_positions(covered_positions_t& covered_positions) const {
+			for (auto block = blocks.begin(); block != blocks.end(); ++block)
+				for (position_t offset = 0; offset < PILEUP_BLOCK_SIZE; ++offset)
+					if (block->second[offset].coverage > 0)
+						covered_positions.push_back(make_pair(block->first + offset, &block->second[offset]));
+		};
+		// get the alleles at a given position in lexicographical order
+		void get_alleles(const position_t position, const column_t& column, alleles_t& alleles) const {
+			alleles.clear();
+			map<string,unsigned int>::const_iterator other_allele, other_alleles_end;
+			if (column.has_other_alleles) {
+				const map<string,unsigned int>& other_alleles_at_position = other_alleles.at(position);
+				other_allele = other_alleles_at_position.begin();
+				other_alleles_end = other_alleles_at_position.end();
+			}
+			for (unsigned int fixed_allele = 0; fixed_allele < PILEUP_FIXED_ALLELES; ++fixed_allele) {
+				if (column.frequency[fixed_allele] > 0) {
+					if (column.has_other_alleles)
+						for (; other_allele != other_alleles_end && other_allele->first < PILEUP_FIXED_ALLELE_NAMES[fixed_allele]; ++other_allele)
+							alleles.push_back(make_pair(&other_allele->first, other_allele->second));
+					alleles.push_back(make_pair(&PILEUP_FIXED_ALLELE_NAMES[fixed_allele], column.frequency[fixed_allele]));
+				}
+			}
+			if (column.has_other_alleles)
+				for (; other_allele != other_alleles_end; ++other_allele)
+					alleles.push_back(make_pair(&other_allele->first, other_allele->second));
+		};
+};
+
+void pileup_chimeric_alignments(vector<chimeric_alignments_t::iterator>& chimeric_alignments, const unsigned int mate, const bool reverse_complement, const direction_t direction, const position_t breakpoint, pileup_t& pileup);
+
+void write_fusions_to_file(fusions_t& fusions, const string& output_file, const coverage_t& coverage, const assembly_t& assembly, const gene_annotation_index_t& gene_annotation_index, const exon_annotation_index_t& exon_annotation_index, vector<string> original_contig_names, const tags_t& tags, const protein_domain_annotation_index_t& protein_domain_annotation_index, const int max_mate_gap, const unsigned max_itd_length, const bool print_extra_info, const bool fill_sequence_gaps, const bool write_discarded_fusions, const unsigned int threads);
 
 #endif /* OUTPUT_FUSIONS_H */
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "cram.h"
+#include "sam.h"
+#include "common.hpp"
+#include "read_stats.hpp"
+#include "read_breakpoint_coverage.hpp"
+
+using namespace std;
+
+const int BREAKPOINT_COVERAGE_RESOLUTION = 1; // compute coverage at base resolution
+const position_t BREAKPOINT_FLANK = 250; // compute coverage in this range around breakpoints (must cover the scan range of the 'no_coverage' filter)
+
+struct region_t {
+	contig_t contig;
+	position_t start;
+	position_t end; // exclusive
+	bool operator<(const region_t& x) const { return contig < x.contig || contig == x.contig && start < x.start; }
+};
+
+// add a region around the given breakpoint, which spans all positions at which the coverage might be queried
+void add_breakpoint_region(const contig_t contig, const position_t breakpoint, const position_t anchor_start, const assembly_t& assembly, vector<region_t>& regions) {
+	assembly_t::const_iterator sequence = assembly.find(contig);
+	if (sequence == assembly.end() || breakpoint < 0)
+		return; // no coverage is computed for contigs without sequence anyway
+	region_t region;
+	region.contig = contig;
+	region.start = max(0, ((anchor_start != 0) ? min(breakpoint, anchor_start) : breakpoint) - BREAKPOINT_FLANK);
+	region.end = min((position_t) sequence->second.size(), ((anchor_start != 0) ? max(breakpoint, anchor_start) : breakpoint) + BREAKPOINT_FLANK + 1);
+	if (region.start < region.end)
+		regions.push_back(region);
+}
+
+// compute the coverage of all regions from <first_region> to <last_region> (exclusive)
+// every thread opens the BAM file separately, because htslib file handles must not be shared between threads
+void read_coverage_of_regions(const vector<region_t>::const_iterator first_region, const vector<region_t>::const_iterator last_region, const string& bam_file_path, const string& assembly_file_path, const contigs_t& contigs, const assembly_t& assembly, const chimeric_alignments_t& chimeric_alignments, const bool external_duplicate_marking, coverage_t& coverage) {
+
+	// open BAM file and index
+	samFile* bam_file = sam_open(bam_file_path.c_str(), "rb");
+	crash(bam_file == NULL, "failed to open SAM file");
+	if (bam_file->is_cram) {
+		cram_set_option(bam_file->fp.cram, CRAM_OPT_REFERENCE, assembly_file_path.c_str());
+		// the coverage is computed from the CIGAR strings alone, so there is no need to decode read sequences,
+		// which saves the decoder from reconstructing them from the reference;
+		// the mate fields must be decoded, because the decoder derives the flag BAM_FMUNMAP from them
+		cram_set_option(bam_file->fp.cram, CRAM_OPT_REQUIRED_FIELDS, SAM_QNAME | SAM_FLAG | SAM_RNAME | SAM_POS | SAM_CIGAR | SAM_RNEXT | SAM_PNEXT | SAM_TLEN | SAM_AUX);
+		cram_set_option(bam_file->fp.cram, CRAM_OPT_DECODE_MD, 0);
+	}
+	bam_hdr_t* bam_header = sam_hdr_read(bam_file);
+	crash(bam_header == NULL, "failed to read SAM header");
+	hts_idx_t* bam_index = sam_index_load(bam_file, bam_file_path.c_str());
+	crash(bam_index == NULL, "failed to load index of '" + bam_file_path + "' (computing the coverage around breakpoints requires a coordinate-sorted and indexed BAM/CRAM file)");
+
+	// make a map contig -> tid, because the contig IDs in the BAM file need not necessarily match the contig IDs in the GTF file
+	vector<int> contig_to_tid(contigs.size(), -1);
+	for (int target = 0; target < bam_header->n_targets; ++target) {
+		contigs_t::const_iterator contig = contigs.find(removeChr(bam_header->target_name[target]));
+		if (contig != contigs.end())
+			contig_to_tid[contig->second] = target;
+	}
+
+	coverage.resize(contigs, assembly);
+	bam1_t* bam_record = bam_init1();
+	crash(bam_record == NULL, "failed to allocate memory");
+	unordered_map<string,bam1_t*> collated_bam_records; // holds the first mate until we have found the second
+	string read_name;
+	for (vector<region_t>::const_iterator region = first_region; region != last_region; ++region) {
+
+		if (contig_to_tid[region->contig] < 0)
+			continue; // contig does not exist in BAM file
+
+		hts_itr_t* bam_iterator = sam_itr_queryi(bam_index, contig_to_tid[region->contig], region->start, region->end);
+		crash(bam_iterator == NULL, "failed to query index of '" + bam_file_path + "'");
+		int sam_itr_next_status;
+		while ((sam_itr_next_status = sam_itr_next(bam_file, bam_iterator, bam_record)) >= 0) {
+
+			// ignore the same alignments as when the coverage is computed genome-wide
+			if ((bam_record->core.flag & BAM_FUNMAP) || (bam_record->core.flag & BAM_FPAIRED) && (bam_record->core.flag & BAM_FMUNMAP) ||
+			    (bam_record->core.flag & BAM_FSUPPLEMENTARY) ||
+			    external_duplicate_marking && (bam_record->core.flag & BAM_FDUP))
+				continue;
+			int64_t hit_index = 1;
+			uint8_t* hi_tag = bam_aux_get(bam_record, "HI");
+			if (hi_tag != NULL)
+				hit_index = bam_aux2i(hi_tag);
+			else if (bam_record->core.flag & BAM_FSECONDARY)
+				continue; // multi-mapping alignments cannot be segregated without HI tag
+			read_name = (char*) bam_get_qname(bam_record);
+			read_name += "," + to_string(hit_index); // append HI tag to name to enable segregation of multi-mapping reads
+
+			// fix contig number to match ours
+			bam_record->core.tid = region->contig;
+
+			// chimeric reads were loaded while reading the alignments => ignore them when looking for fragment starts/ends
+			bool is_chimeric = chimeric_alignments.find(read_name) != chimeric_alignments.end();
+
+			if (!(bam_record->core.flag & BAM_FPAIRED)) { // single-end data
+				coverage.add_fragment(bam_record, NULL, is_chimeric, region->start, region->end);
+			} else if (!(bam_record->core.flag & BAM_FPROPER_PAIR)) { // compute coverage of discordant mates individually
+				coverage.add_fragment(bam_record, NULL, true, region->start, region->end);
+			} else { // wait until we have read both mates
+				pair<unordered_map<string,bam1_t*>::iterator,bool> previously_seen_mate = collated_bam_records.insert(pair<string,bam1_t*>(read_name, bam_record));
+				if (previously_seen_mate.second) { // this is the first mate with the given read name, which we encounter
+					bam_record = bam_init1(); // allocate memory for the next record
+					crash(bam_record == NULL, "failed to allocate memory");
+				} else {
+					coverage.add_fragment(bam_record, previously_seen_mate.first->second, is_chimeric, region->start, region->end);
+					bam_destroy1(previously_seen_mate.first->second);
+					collated_bam_records.erase(previously_seen_mate.first);
+				}
+			}
+		}
+		crash(sam_itr_next_status < -1, "failed to load alignments");
+		hts_itr_destroy(bam_iterator);
+
+		// add mates whose partner does not overlap with the region
+		for (unordered_map<string,bam1_t*>::iterator mate = collated_bam_records.begin(); mate != collated_bam_records.end(); ++mate) {
+			coverage.add_fragment(mate->second, NULL, chimeric_alignments.find(mate->first) != chimeric_alignments.end(), region->start, region->end);
+			bam_destroy1(mate->second);
+		}
+		collated_bam_records.clear();
+	}
+
+	// close BAM file
+	bam_destroy1(bam_record);
+	hts_idx_destroy(bam_index);
+	bam_hdr_destroy(bam_header);
+	sam_close(bam_file);
+
+	coverage.finalize();
+}
+
+// compute the coverage around the breakpoints of all fusions at base resolution by querying the index of the BAM file
+// this replaces the genome-wide coverage, which is computed in windows while reading the alignments
+unsigned int read_breakpoint_coverage(const fusions_t& fusions, const string& bam_file_path, const string& assembly_file_path, const contigs_t& contigs, const assembly_t& assembly, const chimeric_alignments_t& chimeric_alignments, const bool external_duplicate_marking, const unsigned int threads, coverage_t& coverage) {
+
+	// collect regions around breakpoints
+	vector<region_t> regions;
+	for (fusions_t::const_iterator fusion = fusions.begin(); fusion != fusions.end(); ++fusion) {
+		add_breakpoint_region(fusion->second.contig1, fusion->second.breakpoint1, fusion->second.anchor_start1, assembly, regions);
+		add_breakpoint_region(fusion->second.contig2, fusion->second.breakpoint2, fusion->second.anchor_start2, assembly, regions);
+	}
+
+	// merge overlapping regions, such that no read is counted twice
+	sort(regions.begin(), regions.end());
+	vector<region_t> merged_regions;
+	for (vector<region_t>::iterator region = regions.begin(); region != regions.end(); ++region) {
+		if (!merged_regions.empty() && merged_regions.back().contig == region->contig && merged_regions.back().end >= region->start)
+			merged_regions.back().end = max(merged_regions.back().end, region->end);
+		else
+			merged_regions.push_back(*region);
+	}
+
+	// split the regions into batches of neighboring regions and process each batch in a separate thread
+	vector<coverage_t> coverage_by_thread(threads, coverage_t(BREAKPOINT_COVERAGE_RESOLUTION));
+	vector<thread> workers;
+	unsigned int batch_size = (merged_regions.size() + threads - 1) / threads;
+	for (unsigned int worker_id = 0; worker_id < threads; ++worker_id) {
+		vector<region_t>::const_iterator first_region = merged_regions.begin() + min((size_t) worker_id * batch_size, merged_regions.size());
+		vector<region_t>::const_iterator last_region = merged_regions.begin() + min((size_t) (worker_id + 1) * batch_size, merged_regions.size());
+		workers.push_back(start_thread(read_coverage_of_regions, first_region, last_region, cref(bam_file_path), cref(assembly_file_path), cref(contigs), cref(assembly), cref(chimeric_alignments), external_duplicate_marking, ref(coverage_by_thread[worker_id])));
+	}
+	for (auto worker = workers.begin(); worker != workers.end(); ++worker)
+		worker->join();
+
+	// replace genome-wide coverage with the coverage around breakpoints
+	coverage = coverage_t(BREAKPOINT_COVERAGE_RESOLUTION);
+	coverage.resize(contigs, assembly);
+	for (auto thread_coverage = coverage_by_thread.begin(); thread_coverage != coverage_by_thread.end(); ++thread_coverage)
+		coverage.add(*thread_coverage);
+
+	return merged_regions.size();
+}
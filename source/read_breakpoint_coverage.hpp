@@ -0,0 +1,12 @@
+#ifndef READ_BREAKPOINT_COVERAGE_H
+#define READ_BREAKPOINT_COVERAGE_H 1
+
+#include <string>
+#include "common.hpp"
+#include "read_stats.hpp"
+
+using namespace std;
+
+unsigned int read_breakpoint_coverage(const fusions_t& fusions, const string& bam_file_path, const string& assembly_file_path, const contigs_t& contigs, const assembly_t& assembly, const chimeric_alignments_t& chimeric_alignments, const bool external_duplicate_marking, const unsigned int threads, coverage_t& coverage);
+
+#endif /* READ_BREAKPOINT_COVERAGE_H */
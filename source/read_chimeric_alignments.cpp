@@ -1,8 +1,15 @@
 #include <algorithm>
+#include <cerrno>
 #include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <queue>
 #include <string>
 #include <vector>
+#include <unistd.h>
 #include "cram.h"
 #include "htrie_map.h"
 #include "sam.h"
@@ -10,12 +17,163 @@
 #include "common.hpp"
 #include "read_chimeric_alignments.hpp"
 #include "read_stats.hpp"
+#include "sample_log.hpp"
 
 using namespace std;
 
 typedef tsl::htrie_map<char,bam1_t*> collated_bam_records_t;
 typedef vector<contig_t> tid_to_contig_t;
 
+const unsigned int MEMORY_CHECK_INTERVAL = 100000; // check memory consumption every time this many mates have been collated
+const unsigned int SPILLED_RUNS_PER_MERGE = 16; // merge this many temporary files of the same level, so as not to run out of file handles
+
+// the file is deleted as soon as it is closed
+FILE* create_temporary_file() {
+	const char* temporary_directory = getenv("TMPDIR");
+	string temporary_file_path = string((temporary_directory != NULL && *temporary_directory != '\0') ? temporary_directory : "/tmp") + "/arriba.XXXXXX";
+	int file_descriptor = mkstemp(&temporary_file_path[0]);
+	crash(file_descriptor < 0, "failed to create temporary file '" + temporary_file_path + "': " + strerror(errno));
+	unlink(temporary_file_path.c_str());
+	FILE* temporary_file = fdopen(file_descriptor, "w+b");
+	crash(temporary_file == NULL, "failed to open temporary file: " + strerror(errno));
+	return temporary_file;
+}
+
+void write_spilled_bam_record(FILE* spilled_run, const string& read_name, const bam1_t* bam_record) {
+	uint32_t read_name_length = read_name.size();
+	uint32_t data_length = bam_record->l_data;
+	crash(fwrite(&read_name_length, sizeof(read_name_length), 1, spilled_run) != 1 ||
+	      fwrite(read_name.c_str(), 1, read_name_length, spilled_run) != read_name_length ||
+	      fwrite(&bam_record->core, sizeof(bam1_core_t), 1, spilled_run) != 1 ||
+	      fwrite(&data_length, sizeof(data_length), 1, spilled_run) != 1 ||
+	      fwrite(bam_record->data, 1, data_length, spilled_run) != data_length,
+	      "failed to write to temporary file: " + strerror(errno));
+}
+
+// temporary file with mates which are waiting for their partners, sorted by read name
+struct spilled_run_t {
+	FILE* file;
+	unsigned int level; // how often the mates have been merged, i.e., runs of the same level have a similar size
+};
+typedef vector<spilled_run_t> spilled_runs_t; // ordered by the time of writing, i.e., earlier runs hold earlier mates
+
+// write the mates which are waiting for their partners to a temporary file sorted by read name and free their memory
+void spill_collated_bam_records(collated_bam_records_t& collated_bam_records, spilled_runs_t& spilled_runs) {
+	vector< pair<string,bam1_t*> > sorted_bam_records;
+	sorted_bam_records.reserve(collated_bam_records.size());
+	for (collated_bam_records_t::iterator bam_record = collated_bam_records.begin(); bam_record != collated_bam_records.end(); ++bam_record)
+		sorted_bam_records.push_back(make_pair(bam_record.key(), bam_record.value()));
+	collated_bam_records.clear();
+	sort(sorted_bam_records.begin(), sorted_bam_records.end());
+
+	FILE* spilled_run = create_temporary_file();
+	for (auto bam_record = sorted_bam_records.begin(); bam_record != sorted_bam_records.end(); ++bam_record) {
+		write_spilled_bam_record(spilled_run, bam_record->first, bam_record->second);
+		bam_destroy1(bam_record->second);
+	}
+	crash(fflush(spilled_run) != 0, "failed to write to temporary file: " + strerror(errno));
+	spilled_run_t new_run = { spilled_run, 0 };
+	spilled_runs.push_back(new_run);
+}
+
+struct spilled_bam_record_t {
+	string read_name;
+	bam1_t* bam_record;
+	unsigned int run; // runs are numbered in the order in which they were written, i.e., lower runs hold earlier mates
+};
+
+bool read_spilled_bam_record(FILE* spilled_run, spilled_bam_record_t& spilled_bam_record) {
+	uint32_t read_name_length, data_length;
+	if (fread(&read_name_length, sizeof(read_name_length), 1, spilled_run) != 1)
+		return false; // end of run
+	spilled_bam_record.read_name.resize(read_name_length);
+	spilled_bam_record.bam_record = bam_init1();
+	crash(spilled_bam_record.bam_record == NULL, "failed to allocate memory");
+	crash(fread(&spilled_bam_record.read_name[0], 1, read_name_length, spilled_run) != read_name_length ||
+	      fread(&spilled_bam_record.bam_record->core, sizeof(bam1_core_t), 1, spilled_run) != 1 ||
+	      fread(&data_length, sizeof(data_length), 1, spilled_run) != 1,
+	      "failed to read from temporary file");
+	spilled_bam_record.bam_record->data = (uint8_t*) malloc(data_length);
+	crash(spilled_bam_record.bam_record->data == NULL, "failed to allocate memory");
+	spilled_bam_record.bam_record->l_data = spilled_bam_record.bam_record->m_data = data_length;
+	crash(fread(spilled_bam_record.bam_record->data, 1, data_length, spilled_run) != data_length, "failed to read from temporary file");
+	return true;
+}
+
+// merge the sorted runs from the given one onwards and process mates with the same read name as pairs
+// mates without a partner are either written to a new run, which replaces the merged runs, if their partner might still come,
+// or discarded at the end of the BAM file, just like mates without a partner which are still in memory at the end of the BAM file
+void merge_spilled_bam_records(spilled_runs_t& spilled_runs, const unsigned int first_run, const function<void(const string&,bam1_t*,bam1_t*)>& process_mates, const bool keep_mates_without_partner) {
+
+	auto later_bam_record = [](const spilled_bam_record_t& x, const spilled_bam_record_t& y) {
+		return x.read_name > y.read_name || x.read_name == y.read_name && x.run > y.run;
+	};
+	priority_queue< spilled_bam_record_t, vector<spilled_bam_record_t>, decltype(later_bam_record) > next_bam_records(later_bam_record);
+	unsigned int merged_level = 0;
+	for (unsigned int run = first_run; run < spilled_runs.size(); ++run) {
+		merged_level = max(merged_level, spilled_runs[run].level + 1);
+		rewind(spilled_runs[run].file);
+		spilled_bam_record_t spilled_bam_record;
+		spilled_bam_record.run = run;
+		if (read_spilled_bam_record(spilled_runs[run].file, spilled_bam_record))
+			next_bam_records.push(spilled_bam_record);
+	}
+
+	FILE* merged_run = (keep_mates_without_partner) ? create_temporary_file() : NULL;
+	spilled_bam_record_t previously_seen_mate;
+	previously_seen_mate.bam_record = NULL;
+	while (!next_bam_records.empty()) {
+
+		// get next mate and replace it with the next one from the same run
+		spilled_bam_record_t mate = next_bam_records.top();
+		next_bam_records.pop();
+		spilled_bam_record_t next_bam_record;
+		next_bam_record.run = mate.run;
+		if (read_spilled_bam_record(spilled_runs[mate.run].file, next_bam_record))
+			next_bam_records.push(next_bam_record);
+
+		if (previously_seen_mate.bam_record != NULL && previously_seen_mate.read_name == mate.read_name) {
+			process_mates(mate.read_name, mate.bam_record, previously_seen_mate.bam_record);
+			bam_destroy1(mate.bam_record);
+			bam_destroy1(previously_seen_mate.bam_record);
+			previously_seen_mate.bam_record = NULL;
+		} else {
+			if (previously_seen_mate.bam_record != NULL) { // mate without partner
+				if (merged_run != NULL)
+					write_spilled_bam_record(merged_run, previously_seen_mate.read_name, previously_seen_mate.bam_record);
+				bam_destroy1(previously_seen_mate.bam_record);
+			}
+			previously_seen_mate = mate;
+		}
+	}
+	if (previously_seen_mate.bam_record != NULL) {
+		if (merged_run != NULL)
+			write_spilled_bam_record(merged_run, previously_seen_mate.read_name, previously_seen_mate.bam_record);
+		bam_destroy1(previously_seen_mate.bam_record);
+	}
+
+	for (auto spilled_run = spilled_runs.begin() + first_run; spilled_run != spilled_runs.end(); ++spilled_run)
+		fclose(spilled_run->file);
+	spilled_runs.resize(first_run);
+	if (merged_run != NULL) {
+		crash(fflush(merged_run) != 0, "failed to write to temporary file: " + strerror(errno));
+		spilled_run_t new_run = { merged_run, merged_level };
+		spilled_runs.push_back(new_run);
+	}
+}
+
+// merge the most recent runs whenever there are enough of them with the same level, such that the runs form levels of
+// increasing size (like the digits of a counter) and every mate is rewritten only a logarithmic number of times
+// the merged runs are always the most recent ones, so the runs remain ordered by the time of writing
+void merge_spilled_runs_of_same_level(spilled_runs_t& spilled_runs, const function<void(const string&,bam1_t*,bam1_t*)>& process_mates) {
+	while (spilled_runs.size() >= SPILLED_RUNS_PER_MERGE) {
+		const unsigned int first_run = spilled_runs.size() - SPILLED_RUNS_PER_MERGE;
+		if (spilled_runs[first_run].level != spilled_runs.back().level)
+			break; // levels never increase towards the end, so equal levels at both ends of the range mean that all levels are equal
+		merge_spilled_bam_records(spilled_runs, first_run, process_mates, true);
+	}
+}
+
 bool find_spanning_intron(const bam1_t* bam_record, const position_t gene1_end, const position_t gene2_start, unsigned int& cigar_op, position_t& read_pos) {
 
 	if (bam_record->core.n_cigar < 3)
@@ -44,6 +202,15 @@ inline strand_t get_strand(const bam1_t* bam_record) {
 	return (bam_record->core.flag & BAM_FREVERSE) ? REVERSE : FORWARD;
 }
 
+// checks only the raw CIGAR string, so it is cheap enough to triage every record
+inline bool is_clipped(const bam1_t* bam_record) {
+	if (bam_record->core.n_cigar == 0)
+		return false;
+	const uint32_t first_cigar_op = bam_cigar_op(bam_get_cigar(bam_record)[0]);
+	const uint32_t last_cigar_op = bam_cigar_op(bam_get_cigar(bam_record)[bam_record->core.n_cigar-1]);
+	return first_cigar_op == BAM_CSOFT_CLIP || first_cigar_op == BAM_CHARD_CLIP || last_cigar_op == BAM_CSOFT_CLIP || last_cigar_op == BAM_CHARD_CLIP;
+}
+
 const unsigned char CLIP_NONE = 0;
 const unsigned char CLIP_START = 1;
 const unsigned char CLIP_END = 2;
@@ -59,9 +226,7 @@ void add_chimeric_alignment(mates_t& mates, const bam1_t* bam_record, const bool
 	alignment.contig = bam_record->core.tid;
 	alignment.supplementary = is_supplementary;
 	if (!is_supplementary) { // only keep sequence in memory, if this is not the supplementary alignment (because then it's already stored in the split-read)
-		alignment.sequence.resize(bam_record->core.l_qseq);
-		for (int i = 0; i < bam_record->core.l_qseq; ++i)
-			alignment.sequence[i] = seq_nt16_str[bam_seqi(bam_get_seq(bam_record), i)];
+		alignment.sequence.assign(bam_get_seq(bam_record), bam_record->core.l_qseq);
 	}
 
 	// read-through alignments need to be split into a split-read and a supplementary alignment
@@ -88,22 +253,74 @@ void add_chimeric_alignment(mates_t& mates, const bam1_t* bam_record, const bool
 	}
 }
 
-bool extract_read_through_alignment(chimeric_alignments_t& chimeric_alignments, const string& read_name, bam1_t* forward_mate, bam1_t* reverse_mate, const gene_annotation_index_t& gene_annotation_index, const bool separate_chimeric_bam_file) {
+// lookup table which divides the genome into blocks and assigns to each block the region of the gene annotation index
+// (i.e., the set of overlapping genes) which covers the entire block
+// this allows to check whether two positions overlap with the same genes with a single array lookup
+// most mates map within the same gene, so the expensive queries of the gene annotation index can be skipped for them
+class gene_neighborhoods_t {
+	private:
+		static const unsigned int BLOCK_SIZE_BITS = 12; // blocks of 4 kbp
+		static const unsigned int MIXED = UINT_MAX; // block overlaps with several regions of the gene annotation index
+		vector< vector<unsigned int> > neighborhoods; // contig -> block -> ID of region in gene annotation index
+	public:
+		gene_neighborhoods_t(const gene_annotation_index_t& gene_annotation_index) {
+			neighborhoods.resize(gene_annotation_index.size());
+			for (contig_t contig = 0; contig < gene_annotation_index.size(); ++contig) {
+				if (gene_annotation_index[contig].empty())
+					continue;
+
+				// the regions of the index are keyed by their end => a position belongs to the first region ending at or after it
+				// positions after the last region belong to the pseudo-region with the ID equal to the number of regions
+				vector<unsigned int>& contig_neighborhoods = neighborhoods[contig];
+				contig_neighborhoods.resize((gene_annotation_index[contig].rbegin()->first >> BLOCK_SIZE_BITS) + 1);
+				gene_contig_annotation_index_t::const_iterator region = gene_annotation_index[contig].begin();
+				unsigned int region_id = 0;
+				for (unsigned int block = 0; block < contig_neighborhoods.size(); ++block) {
+					const position_t block_start = block << BLOCK_SIZE_BITS;
+					const position_t block_end = block_start + (1 << BLOCK_SIZE_BITS) - 1;
+					while (region != gene_annotation_index[contig].end() && region->first < block_start) {
+						++region;
+						++region_id;
+					}
+					contig_neighborhoods[block] = (region == gene_annotation_index[contig].end() || region->first >= block_end) ? region_id : MIXED;
+				}
+			}
+		}
+		// returns true, if the two positions are guaranteed to be in the same region of the gene annotation index
+		// false means that the gene annotation index must be queried to find out
+		inline bool same_genes(const contig_t contig, const position_t position1, const position_t position2) const {
+			if (contig >= neighborhoods.size() || neighborhoods[contig].empty())
+				return true; // there are no genes on this contig
+			const unsigned int block1 = position1 >> BLOCK_SIZE_BITS;
+			const unsigned int block2 = position2 >> BLOCK_SIZE_BITS;
+			if (block1 >= neighborhoods[contig].size() && block2 >= neighborhoods[contig].size())
+				return true; // both positions are after the last gene
+			if (block1 >= neighborhoods[contig].size() || block2 >= neighborhoods[contig].size())
+				return false;
+			return neighborhoods[contig][block1] != MIXED && neighborhoods[contig][block1] == neighborhoods[contig][block2];
+		}
+};
+
+bool extract_read_through_alignment(chimeric_alignments_t& chimeric_alignments, const string& read_name, bam1_t* forward_mate, bam1_t* reverse_mate, const gene_annotation_index_t& gene_annotation_index, const gene_neighborhoods_t& gene_neighborhoods, const bool separate_chimeric_bam_file) {
 
 	// find out which read is on the forward strand and which on the reverse
 	if (get_strand(forward_mate) == REVERSE)
 		swap(forward_mate, reverse_mate);
 
+	// determine the outer ends of the mates
+	const contig_t forward_contig = (forward_mate != NULL) ? forward_mate->core.tid : reverse_mate->core.tid;
+	const position_t forward_position = (forward_mate != NULL) ? forward_mate->core.pos : reverse_mate->core.pos;
+	const contig_t reverse_contig = (reverse_mate != NULL) ? reverse_mate->core.tid : forward_mate->core.tid;
+	const position_t reverse_position = (reverse_mate != NULL) ? bam_endpos(reverse_mate) : bam_endpos(forward_mate);
+
+	// ends which overlap with the same genes cannot be a read-through fusion
+	if (forward_contig == reverse_contig && gene_neighborhoods.same_genes(forward_contig, forward_position, reverse_position))
+		return false;
+
 	// check if one mate maps inside the gene and the other outside
 	gene_set_t forward_mate_genes, reverse_mate_genes;
-	if (forward_mate != NULL)
-		get_annotation_by_coordinate(forward_mate->core.tid, forward_mate->core.pos, forward_mate->core.pos, forward_mate_genes, gene_annotation_index);
-	else
-		get_annotation_by_coordinate(reverse_mate->core.tid, reverse_mate->core.pos, reverse_mate->core.pos, forward_mate_genes, gene_annotation_index);
-	if (reverse_mate != NULL)
-		get_annotation_by_coordinate(reverse_mate->core.tid, bam_endpos(reverse_mate), bam_endpos(reverse_mate), reverse_mate_genes, gene_annotation_index);
-	else
-		get_annotation_by_coordinate(forward_mate->core.tid, bam_endpos(forward_mate), bam_endpos(forward_mate), reverse_mate_genes, gene_annotation_index);
+	get_annotation_by_coordinate(forward_contig, forward_position, forward_position, forward_mate_genes, gene_annotation_index);
+	get_annotation_by_coordinate(reverse_contig, reverse_position, reverse_position, reverse_mate_genes, gene_annotation_index);
 	gene_set_t common_genes;
 	combine_annotations(forward_mate_genes, reverse_mate_genes, common_genes, false);
 	if (common_genes.empty() && !(forward_mate_genes.empty() && reverse_mate_genes.empty())) { // mate1 and mate2 map to different genes => potential read-through fusion
@@ -208,6 +425,65 @@ bool clipped_sequence_is_adapter(const bam1_t* mate1, const bam1_t* mate2) {
 	return false;
 }
 
+// find the positions in the window, at which the clipped sequence shares a k-mer of the given length with the assembly
+// the k-mers of the window are indexed in a small hash table, which is looked up with the k-mers of the clipped sequence
+void find_tandem_alignment_candidates(const string& clipped_sequence, const contig_sequence_t& contig_sequence, const int window_start, const int window_end, const unsigned int seed_length, vector<bool>& candidate_positions) {
+
+	// the sequence of the window must accommodate the clipped sequence at the last position
+	const int sequence_end = window_end + clipped_sequence.size() - 1;
+
+	// encode bases as 2-bit integers
+	// in the rare case of ambiguous bases, all positions are candidates, since the k-mers would not be comparable
+	const unsigned int kmer_mask = (1 << (2 * seed_length)) - 1;
+	auto encode = [](const char base) -> int {
+		switch (base) {
+			case 'A': return 0;
+			case 'C': return 1;
+			case 'G': return 2;
+			case 'T': return 3;
+			default: return -1;
+		}
+	};
+
+	// index the k-mers of the window
+	// kmer_heads[k-mer] is the last position of the k-mer in the window, kmer_links[position] the previous one
+	vector<int> kmer_heads(kmer_mask + 1, -1);
+	vector<int> kmer_links(sequence_end - window_start + 1, -1);
+	unsigned int kmer = 0;
+	for (int position = window_start; position <= sequence_end; ++position) {
+		int base = encode(contig_sequence[position]);
+		if (base < 0) {
+			candidate_positions.assign(candidate_positions.size(), true);
+			return;
+		}
+		kmer = ((kmer << 2) | base) & kmer_mask;
+		if (position - window_start + 1 >= (int) seed_length) {
+			const int kmer_start = position - seed_length + 1;
+			kmer_links[kmer_start - window_start] = kmer_heads[kmer];
+			kmer_heads[kmer] = kmer_start;
+		}
+	}
+
+	// look up the k-mers of the clipped sequence and convert hits to alignment positions
+	kmer = 0;
+	for (unsigned int read_pos = 0; read_pos < clipped_sequence.size(); ++read_pos) {
+		int base = encode(clipped_sequence[read_pos]);
+		if (base < 0) {
+			candidate_positions.assign(candidate_positions.size(), true);
+			return;
+		}
+		kmer = ((kmer << 2) | base) & kmer_mask;
+		if (read_pos + 1 >= seed_length) {
+			const int kmer_start = read_pos - seed_length + 1;
+			for (int hit = kmer_heads[kmer]; hit >= 0; hit = kmer_links[hit - window_start]) {
+				const int alignment_position = hit - kmer_start;
+				if (alignment_position >= window_start && alignment_position <= window_end)
+					candidate_positions[alignment_position - window_start] = true;
+			}
+		}
+	}
+}
+
 // STAR is bad at aligning internal tandem duplications
 // => if we see a clipped read, check manually if it can be aligned as a tandem duplication
 bool is_tandem_duplication(const bam1_t* bam_record, const assembly_t& assembly, const unsigned int max_itd_length, alignment_t& tandem_alignment) {
@@ -256,7 +532,7 @@ bool is_tandem_duplication(const bam1_t* bam_record, const assembly_t& assembly,
 	// make sure assembly sequence is available
 	if (assembly.find(bam_record->core.tid) == assembly.end())
 		return false; // contig sequence unavailable and thus no way to make an alignment
-	const string& contig_sequence = assembly.at(bam_record->core.tid);
+	const contig_sequence_t& contig_sequence = assembly.at(bam_record->core.tid);
 	if (alignment_window_end + max_duplication_length + clipped_sequence_length + 1 >= contig_sequence.size() ||
 	    alignment_window_start <= (int) (max_duplication_length + clipped_sequence_length + 1))
 		return false; // ignore alignments close to contig boundaries to avoid array out-of-bounds errors
@@ -278,9 +554,20 @@ bool is_tandem_duplication(const bam1_t* bam_record, const assembly_t& assembly,
 	if (1.0 * extended_matches / clipped_sequence_length >= min_extended_align_fraction)
 		return false; // the split read can simply be extended linearly, no need to try a tandem alignment
 
-	// try to align clipped sequence in a window of size <max_duplication_length>
+	// find candidate positions for the tandem alignment via exact seeds
+	// an alignment which passes the criteria below has at least <min_alignment_length>-<max_non_template_bases> matches
+	// interrupted by at most <max_mismatches> mismatches (or all bases align, which requires <min_clipped_length> bases),
+	// so it must contain a stretch of at least <seed_length> bases which match exactly
+	const unsigned int seed_length = 5;
+	vector<bool> candidate_positions(alignment_window_end - alignment_window_start + 1, false);
+	find_tandem_alignment_candidates(clipped_sequence, contig_sequence, alignment_window_start, alignment_window_end, seed_length, candidate_positions);
+
+	// try to align clipped sequence at the candidate positions in a window of size <max_duplication_length>
 	for (int contig_pos = alignment_window_start; contig_pos <= alignment_window_end; ++contig_pos) {
 
+		if (!candidate_positions[contig_pos - alignment_window_start])
+			continue; // alignment at this position cannot pass the criteria
+
 		// align at given position and abort when too many mismatches have been encountered
 		unsigned int matches = 0;
 		unsigned int mismatches = 0;
@@ -310,9 +597,7 @@ bool is_tandem_duplication(const bam1_t* bam_record, const assembly_t& assembly,
 			                                 clipped_start  && get_strand(bam_record) == FORWARD ||
 			                                 !clipped_start && get_strand(bam_record) == REVERSE;
 			if (!tandem_alignment.supplementary) { // only keep sequence in memory, if this is not the supplementary alignment (because then it's already stored in the split-read)
-				tandem_alignment.sequence.resize(bam_record->core.l_qseq);
-				for (int i = 0; i < bam_record->core.l_qseq; ++i)
-					tandem_alignment.sequence[i] = seq_nt16_str[bam_seqi(bam_get_seq(bam_record), i)];
+				tandem_alignment.sequence.assign(bam_get_seq(bam_record), bam_record->core.l_qseq);
 			}
 			// construct CIGAR string
 			uint32_t clip_left = (clipped_start) ? 0 : bam_record->core.l_qseq - clipped_sequence_length;
@@ -485,17 +770,16 @@ bool is_pristine_alignment(const bam1_t* bam_record) {
 			return false;
 	}
 
-	// get sequence of read as string to look for tandem repeats
-	string sequence;
-	sequence.resize(bam_record->core.l_qseq);
-	for (int i = 0; i < bam_record->core.l_qseq; ++i)
-		sequence[i] = seq_nt16_str[bam_seqi(bam_get_seq(bam_record), i)];
+	// look for tandem repeats directly in the 4-bit encoded sequence, there is no need to convert it to a string
+	// (the encoding maps each base to a distinct value, so comparing encoded bases is the same as comparing letters)
+	const uint8_t* sequence = bam_get_seq(bam_record);
+	const unsigned int sequence_length = bam_record->core.l_qseq;
 
 	// walk over sequence looking for tandem repeats of dimers or triplets
-	for (unsigned int i = 2, repeat = 0, count = 1; i + 2 < sequence.size(); i += 2) {
-		if (sequence[i] == sequence[repeat] && sequence[i+1] == sequence[repeat+1]) { // tandem repeat of dimers
+	for (unsigned int i = 2, repeat = 0, count = 1; i + 2 < sequence_length; i += 2) {
+		if (bam_seqi(sequence, i) == bam_seqi(sequence, repeat) && bam_seqi(sequence, i+1) == bam_seqi(sequence, repeat+1)) { // tandem repeat of dimers
 			count++;
-		} else if (sequence[i+1] == sequence[repeat+1] && sequence[i+2] == sequence[repeat+2]) { // tandem repeat of triplets
+		} else if (bam_seqi(sequence, i+1) == bam_seqi(sequence, repeat+1) && bam_seqi(sequence, i+2) == bam_seqi(sequence, repeat+2)) { // tandem repeat of triplets
 			count++;
 			i++;
 		} else { // series of tandem repeats is broken => start over with sequence at current position
@@ -510,13 +794,18 @@ bool is_pristine_alignment(const bam1_t* bam_record) {
 	return true;
 }
 
-unsigned int read_chimeric_alignments(const string& bam_file_path, const assembly_t& assembly, const string& assembly_file_path, chimeric_alignments_t& chimeric_alignments, unsigned long int& mapped_reads, vector<unsigned long int>& mapped_viral_reads_by_contig, coverage_t& coverage, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs, const string& viral_contigs, const gene_annotation_index_t& gene_annotation_index, const bool separate_chimeric_bam_file, const bool is_rna_bam_file, const bool external_duplicate_marking, const unsigned int max_itd_length) {
+unsigned int read_chimeric_alignments(const string& bam_file_path, const assembly_t& assembly, const string& assembly_file_path, chimeric_alignments_t& chimeric_alignments, unsigned long int& mapped_reads, vector<unsigned long int>& mapped_viral_reads_by_contig, coverage_t& coverage, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs, const string& viral_contigs, const gene_annotation_index_t& gene_annotation_index, const bool separate_chimeric_bam_file, const bool is_rna_bam_file, const bool external_duplicate_marking, const unsigned int max_itd_length, const float collation_memory_limit_gb) {
 
 	// open BAM file
 	samFile* bam_file = sam_open(bam_file_path.c_str(), "rb");
 	crash(bam_file == NULL, "failed to open SAM file");
-	if (bam_file->is_cram)
+	if (bam_file->is_cram) {
 		cram_set_option(bam_file->fp.cram, CRAM_OPT_REFERENCE, assembly_file_path.c_str());
+		// skip decoding of data series we don't need (most notably base qualities) and don't generate MD/NM tags;
+		// the mate fields must be decoded, because the decoder derives the flags BAM_FMUNMAP/BAM_FMREVERSE from them
+		cram_set_option(bam_file->fp.cram, CRAM_OPT_REQUIRED_FIELDS, SAM_QNAME | SAM_FLAG | SAM_RNAME | SAM_POS | SAM_CIGAR | SAM_RNEXT | SAM_PNEXT | SAM_TLEN | SAM_SEQ | SAM_AUX);
+		cram_set_option(bam_file->fp.cram, CRAM_OPT_DECODE_MD, 0);
+	}
 	bam_hdr_t* bam_header = sam_hdr_read(bam_file);
 	crash(bam_header == NULL, "failed to read SAM header");
 
@@ -550,6 +839,9 @@ unsigned int read_chimeric_alignments(const string& bam_file_path, const assembl
 		viral_contigs_bool[contig->second] = is_interesting_contig(contig->first, viral_contigs);
 	mapped_viral_reads_by_contig.resize(contigs.size());
 
+	// make lookup table to quickly discard mates which are not read-through alignments
+	const gene_neighborhoods_t gene_neighborhoods(gene_annotation_index);
+
 	// read BAM records
 	bam1_t* bam_record = bam_init1();
 	crash(bam_record == NULL, "failed to allocate memory.");
@@ -559,6 +851,75 @@ unsigned int read_chimeric_alignments(const string& bam_file_path, const assembl
 	unsigned int malformed_count = 0;
 	string read_name;
 	int sam_read1_status;
+	const unsigned long long int collation_memory_limit = collation_memory_limit_gb * 1024*1024*1024;
+	unsigned int collated_records_since_memory_check = 0;
+	spilled_runs_t spilled_runs;
+	unsigned int spilled_batches = 0;
+	unsigned long long int memory_usage_after_spilling = 0;
+
+	// extract chimeric alignments from a single-end read or from a pair of mates
+	auto process_mates = [&](const string& read_name, bam1_t* bam_record, bam1_t* previously_seen_mate) {
+		if (separate_chimeric_bam_file && !is_rna_bam_file) { // this is Chimeric.out.sam => load everything
+
+			mates_t& mates = chimeric_alignments[read_name];
+			add_chimeric_alignment(mates, bam_record);
+			if (previously_seen_mate != NULL)
+				add_chimeric_alignment(mates, previously_seen_mate);
+			no_chimeric_reads = false;
+
+		} else { // this is Aligned.out.bam => load only discordant mates and split reads, and only when there is no Chimeric.out.sam
+
+			// the vast majority of fragments are concordant mates without clipped segments,
+			// which can neither be split reads nor ITDs => skip the checks for those, including the costly look-up of the SA tag
+			// (single-end reads are exempt, because they are accepted as split reads no matter which end is clipped)
+			const bool is_clipped_fragment = !(bam_record->core.flag & BAM_FPAIRED) || is_clipped(bam_record) || previously_seen_mate != NULL && is_clipped(previously_seen_mate);
+
+			// STAR is bad at aligning internal tandem duplications (ITD)
+			// it often does not align them at all or maps the clipped segment to a different chromosome with poor alignment quality
+			// => for every clipped alignment, check if it can be aligned as an ITD
+			bool is_tandem_alignment = false;
+			alignment_t tandem_alignment;
+			if (is_clipped_fragment && !clipped_sequence_is_adapter(bam_record, previously_seen_mate) &&
+		           (previously_seen_mate == NULL || get_strand(bam_record) != get_strand(previously_seen_mate)) && // strands must be different, so we can distinguish mate1 from mate2
+		           (is_tandem_duplication(bam_record, assembly, max_itd_length, tandem_alignment) || // is it a tandem duplication that STAR failed to align?
+		            is_tandem_duplication(previously_seen_mate, assembly, max_itd_length, tandem_alignment))) {
+				if (is_rna_bam_file) {
+					mates_t& mates = chimeric_alignments[read_name + "ITD"]; // imitate a multimapping alignment by adding another alignment for the ITD
+					add_chimeric_alignment(mates, bam_record, get_strand(bam_record) == tandem_alignment.strand && !tandem_alignment.supplementary);
+					if (previously_seen_mate != NULL)
+						add_chimeric_alignment(mates, previously_seen_mate, get_strand(previously_seen_mate) == tandem_alignment.strand && !tandem_alignment.supplementary);
+					mates.push_back(tandem_alignment);
+				}
+				is_tandem_alignment = true;
+			}
+
+			// we extract two types of alignments here: chimeric alignments (having an SA tag) and read-through alignments (crossing gene boundaries)
+			bool is_read_through_alignment = false;
+			if (is_clipped_fragment &&
+			    (bam_aux_get(bam_record, "SA") != NULL && is_clipped_at_correct_end(bam_record) || // split-read with SA tag
+			     previously_seen_mate != NULL && bam_aux_get(previously_seen_mate, "SA") != NULL && is_clipped_at_correct_end(previously_seen_mate))) { // split-read with SA tag
+				if (!separate_chimeric_bam_file) {
+					mates_t& mates = chimeric_alignments[read_name];
+					add_chimeric_alignment(mates, bam_record);
+					if (previously_seen_mate != NULL)
+						add_chimeric_alignment(mates, previously_seen_mate);
+					no_chimeric_reads = false;
+				}
+			} else if (!is_tandem_alignment) { // could be a read-through alignment
+				is_read_through_alignment = extract_read_through_alignment(chimeric_alignments, read_name, bam_record, previously_seen_mate, gene_annotation_index, gene_neighborhoods, separate_chimeric_bam_file);
+
+				// count mapped reads on viral contigs to detect viral infection
+				if (viral_contigs_bool[bam_record->core.tid])
+					for (bam1_t* mate = bam_record; mate != NULL; mate = (mate == previously_seen_mate) ? NULL : previously_seen_mate)
+						if (is_pristine_alignment(mate)) // only count perfectly matching alignments to ignore alignment artifacts
+							mapped_viral_reads_by_contig[mate->core.tid]++;
+			}
+
+			if (!external_duplicate_marking || !(bam_record->core.flag & BAM_FDUP))
+				coverage.add_fragment(bam_record, previously_seen_mate, is_read_through_alignment);
+		}
+	};
+
 	while ((sam_read1_status = sam_read1(bam_file, bam_header, bam_record)) >= 0) {
 
 		if (is_rna_bam_file)
@@ -638,67 +999,36 @@ unsigned int read_chimeric_alignments(const string& bam_file_path, const assembl
 			bam_record = bam_init1(); // allocate memory for the next record
 			crash(bam_record == NULL, "failed to allocate memory");
 
-		} else { // single-end data or we have already read the first mate previously
-
-			if (separate_chimeric_bam_file && !is_rna_bam_file) { // this is Chimeric.out.sam => load everything
-
-				mates_t& mates = chimeric_alignments[read_name];
-				add_chimeric_alignment(mates, bam_record);
-				if (previously_seen_mate != NULL)
-					add_chimeric_alignment(mates, previously_seen_mate);
-				no_chimeric_reads = false;
-
-			} else { // this is Aligned.out.bam => load only discordant mates and split reads, and only when there is no Chimeric.out.sam
-
-				// STAR is bad at aligning internal tandem duplications (ITD)
-				// it often does not align them at all or maps the clipped segment to a different chromosome with poor alignment quality
-				// => for every clipped alignment, check if it can be aligned as an ITD
-				bool is_tandem_alignment = false;
-				alignment_t tandem_alignment;
-				if (!clipped_sequence_is_adapter(bam_record, previously_seen_mate) &&
-			           (previously_seen_mate == NULL || get_strand(bam_record) != get_strand(previously_seen_mate)) && // strands must be different, so we can distinguish mate1 from mate2
-			           (is_tandem_duplication(bam_record, assembly, max_itd_length, tandem_alignment) || // is it a tandem duplication that STAR failed to align?
-			            is_tandem_duplication(previously_seen_mate, assembly, max_itd_length, tandem_alignment))) {
-					if (is_rna_bam_file) {
-						mates_t& mates = chimeric_alignments[read_name + "ITD"]; // imitate a multimapping alignment by adding another alignment for the ITD
-						add_chimeric_alignment(mates, bam_record, get_strand(bam_record) == tandem_alignment.strand && !tandem_alignment.supplementary);
-						if (previously_seen_mate != NULL)
-							add_chimeric_alignment(mates, previously_seen_mate, get_strand(previously_seen_mate) == tandem_alignment.strand && !tandem_alignment.supplementary);
-						mates.push_back(tandem_alignment);
-					}
-					is_tandem_alignment = true;
+			// move the mates which are waiting for their partners to a temporary file, when memory becomes scarce
+			// spilling does not reduce the resident memory, because the freed memory is kept by the allocator for reuse,
+			// so we only spill again when the memory has grown beyond what it was after the last spill
+			if (collation_memory_limit > 0 && ++collated_records_since_memory_check >= MEMORY_CHECK_INTERVAL) {
+				collated_records_since_memory_check = 0;
+				const unsigned long long int memory_usage = get_memory_usage(getpid());
+				if (memory_usage > collation_memory_limit && memory_usage > memory_usage_after_spilling && !collated_bam_records.empty()) {
+					spill_collated_bam_records(collated_bam_records, spilled_runs);
+					spilled_batches++;
+					merge_spilled_runs_of_same_level(spilled_runs, process_mates);
+					memory_usage_after_spilling = get_memory_usage(getpid());
 				}
+			}
 
-				// we extract two types of alignments here: chimeric alignments (having an SA tag) and read-through alignments (crossing gene boundaries)
-				bool is_read_through_alignment = false;
-				if (bam_aux_get(bam_record, "SA") != NULL && is_clipped_at_correct_end(bam_record) || // split-read with SA tag
-				    previously_seen_mate != NULL && bam_aux_get(previously_seen_mate, "SA") != NULL && is_clipped_at_correct_end(previously_seen_mate)) { // split-read with SA tag
-					if (!separate_chimeric_bam_file) {
-						mates_t& mates = chimeric_alignments[read_name];
-						add_chimeric_alignment(mates, bam_record);
-						if (previously_seen_mate != NULL)
-							add_chimeric_alignment(mates, previously_seen_mate);
-						no_chimeric_reads = false;
-					}
-				} else if (!is_tandem_alignment) { // could be a read-through alignment
-					is_read_through_alignment = extract_read_through_alignment(chimeric_alignments, read_name, bam_record, previously_seen_mate, gene_annotation_index, separate_chimeric_bam_file);
-
-					// count mapped reads on viral contigs to detect viral infection
-					if (viral_contigs_bool[bam_record->core.tid])
-						for (bam1_t* mate = bam_record; mate != NULL; mate = (mate == previously_seen_mate) ? NULL : previously_seen_mate)
-							if (is_pristine_alignment(mate)) // only count perfectly matching alignments to ignore alignment artifacts
-								mapped_viral_reads_by_contig[mate->core.tid]++;
-				}
+		} else { // single-end data or we have already read the first mate previously
 
-				if (!external_duplicate_marking || !(bam_record->core.flag & BAM_FDUP))
-					coverage.add_fragment(bam_record, previously_seen_mate, is_read_through_alignment);
-			}
+			process_mates(read_name, bam_record, previously_seen_mate);
 
 			if (previously_seen_mate != NULL)
 				bam_destroy1(previously_seen_mate);
 		}
 	}
 
+	// find the partners of the mates which were moved to temporary files
+	if (!spilled_runs.empty()) {
+		print_warning("collation memory limit exceeded, " + to_string(static_cast<long long unsigned int>(spilled_batches)) + " batches of mates were moved to temporary files");
+		spill_collated_bam_records(collated_bam_records, spilled_runs);
+		merge_spilled_bam_records(spilled_runs, 0, process_mates, false);
+	}
+
 	crash(sam_read1_status < -1, "failed to load alignments");
 
 	// close BAM file
@@ -711,14 +1041,14 @@ unsigned int read_chimeric_alignments(const string& bam_file_path, const assembl
 	// sanity check: remove malformed alignments
 	malformed_count += remove_malformed_alignments(chimeric_alignments);
 	if (malformed_count > 0)
-		cerr << "WARNING: " << malformed_count << " SAM records were malformed and ignored" << endl;
+		print_warning(to_string(static_cast<long long unsigned int>(malformed_count)) + " SAM records were malformed and ignored");
 	// sanity check: there should be at least 1 chimeric read, or else Arriba is probably not being used properly
 	if (separate_chimeric_bam_file && !is_rna_bam_file || // this is Chimeric.out.sam
 	    !separate_chimeric_bam_file) // this is Aligned.out.bam and STAR was run with --chimOutType WithinBAM
 		crash(no_chimeric_reads, "no split reads or discordant mates found (STAR must either be run with '--chimOutType WithinBAM' or the file 'Chimeric.out.sam' must be passed to Arriba via the argument -c)");
 	// sanity check: multi-mapping chimeric reads should have the HI tag
 	if (missing_hi_tag > 0)
-		cerr << "WARNING: " << missing_hi_tag << " secondary alignments lack the 'HI' tag and were ignored (STAR must be run with '--outSAMattributes HI' for Arriba to make use of multi-mapping reads for fusion detection)" << endl;
+		print_warning(to_string(static_cast<long long unsigned int>(missing_hi_tag)) + " secondary alignments lack the 'HI' tag and were ignored (STAR must be run with '--outSAMattributes HI' for Arriba to make use of multi-mapping reads for fusion detection)");
 
 	return chimeric_alignments.size();
 }
@@ -1,16 +1,18 @@
 #include <climits>
 #include <cmath>
 #include <iostream>
-#include <list>
+#include <map>
+#include <thread>
 #include <vector>
 #include "sam.h"
 #include "common.hpp"
+#include "sample_log.hpp"
 #include "annotation.hpp"
 #include "read_stats.hpp"
 
 bool estimate_fragment_length(const chimeric_alignments_t& chimeric_alignments, float& mate_gap_mean, float& mate_gap_stddev, float& read_length_mean, const gene_annotation_index_t& gene_annotation_index, const exon_annotation_index_t& exon_annotation_index) {
 
-	list<int> mate_gaps;
+	map<int,unsigned int> mate_gaps; // histogram of distances between mates
 	unsigned int mate_gap_count = 0;
 	read_length_mean = 0;
 	unsigned int read_length_count = 0;
@@ -36,7 +38,7 @@ bool estimate_fragment_length(const chimeric_alignments_t& chimeric_alignments,
 				distance = -forward_mate->sequence.length();
 			if (distance < (int) -reverse_mate->sequence.length())
 				distance = -reverse_mate->sequence.length();
-			mate_gaps.push_back(distance);
+			mate_gaps[distance]++;
 			mate_gap_count++;
 			if (mate_gap_count > 100000)
 				break; // the sample size should be big enough
@@ -44,7 +46,7 @@ bool estimate_fragment_length(const chimeric_alignments_t& chimeric_alignments,
 	}
 
 	if (mate_gap_count < 10000) {
-		cerr << "WARNING: not enough chimeric reads to estimate mate gap distribution, using default values" << endl;
+		print_warning("not enough chimeric reads to estimate mate gap distribution, using default values");
 		return false;
 	}
 
@@ -53,38 +55,41 @@ bool estimate_fragment_length(const chimeric_alignments_t& chimeric_alignments,
 	bool no_more_outliers = false;
 	while (true) {
 		// calculate mean
-		mate_gap_mean = 0;
-		for (list<int>::iterator i = mate_gaps.begin(); i != mate_gaps.end(); i++)
-			mate_gap_mean += *i;
-		mate_gap_mean /= mate_gap_count;
+		// (the sum is accumulated exactly, so that the result does not depend on the order of summation)
+		long long int mate_gap_sum = 0;
+		for (map<int,unsigned int>::iterator i = mate_gaps.begin(); i != mate_gaps.end(); ++i)
+			mate_gap_sum += (long long int) i->first * i->second;
+		mate_gap_mean = (double) mate_gap_sum / mate_gap_count;
 
 		// calculate standard deviation
-		mate_gap_stddev = 0;
-		for (list<int>::iterator i = mate_gaps.begin(); i != mate_gaps.end(); i++)
-			mate_gap_stddev += (*i - mate_gap_mean) * (*i - mate_gap_mean);
-		mate_gap_stddev = sqrt(1.0/(mate_gap_count-1) * mate_gap_stddev);
+		double mate_gap_squared_deviations = 0;
+		for (map<int,unsigned int>::iterator i = mate_gaps.begin(); i != mate_gaps.end(); ++i)
+			mate_gap_squared_deviations += (i->first - (double) mate_gap_mean) * (i->first - (double) mate_gap_mean) * i->second;
+		mate_gap_stddev = sqrt(1.0/(mate_gap_count-1) * mate_gap_squared_deviations);
 
 		// due to alternative splicing the mate gap distribution is not distributed normally
 		// there are usually many outliers which inflate the standard deviation
 		// => remove outliers until the distribution resembles a normal distribution
 		//    (i.e., 68.3% are inside the range: mean +/- 1*stddev)
 		unsigned int within_range = 0;
-		for (list<int>::iterator i = mate_gaps.begin(); i != mate_gaps.end(); ++i)
-			if (*i > mate_gap_mean - mate_gap_stddev || *i < mate_gap_mean + mate_gap_stddev)
-				within_range++;
+		for (map<int,unsigned int>::iterator i = mate_gaps.begin(); i != mate_gaps.end(); ++i)
+			if (i->first > mate_gap_mean - mate_gap_stddev || i->first < mate_gap_mean + mate_gap_stddev)
+				within_range += i->second;
 		if (1.0*within_range/mate_gap_count < 0.683 || no_more_outliers)
 			break; // all outliers have been removed
 
 		// remove outliers, if the mate gap distribution is not yet normally distributed
+		// since the histogram is sorted, the outliers are found at either end
 		no_more_outliers = true;
-		for (list<int>::iterator i = mate_gaps.begin(); i != mate_gaps.end();) {
-			if (*i < mate_gap_mean - 3*mate_gap_stddev || *i > mate_gap_mean + 3*mate_gap_stddev) {
-				i = mate_gaps.erase(i); // remove outlier
-				mate_gap_count--;
-				no_more_outliers = false;
-			} else {
-				++i;
-			}
+		while (!mate_gaps.empty() && mate_gaps.begin()->first < mate_gap_mean - 3*mate_gap_stddev) {
+			mate_gap_count -= mate_gaps.begin()->second;
+			mate_gaps.erase(mate_gaps.begin());
+			no_more_outliers = false;
+		}
+		while (!mate_gaps.empty() && mate_gaps.rbegin()->first > mate_gap_mean + 3*mate_gap_stddev) {
+			mate_gap_count -= mate_gaps.rbegin()->second;
+			mate_gaps.erase(--mate_gaps.end());
+			no_more_outliers = false;
 		}
 	}
 
@@ -142,30 +147,83 @@ strandedness_t detect_strandedness(const chimeric_alignments_t& chimeric_alignme
 		return STRANDEDNESS_NO; // not enough signal => assume no
 }
 
-// initialize data structure to compute coverage for windows of size <COVERAGE_RESOLUTION>
+// initialize data structure to compute coverage for windows of size <resolution>
 void coverage_t::resize(const contigs_t& contigs, const assembly_t& assembly) {
-	fragment_starts.resize(contigs.size());
-	fragment_ends.resize(contigs.size());
-	coverage.resize(contigs.size());
-	for (assembly_t::const_iterator contig = assembly.begin(); contig != assembly.end(); ++contig) {
-		if (!contig->second.empty()) {
-			unsigned int windows = contig->second.size() / COVERAGE_RESOLUTION + 2; //+2 to avoid array-out-of-bounds errors
-			fragment_starts[contig->first].resize(windows);
-			fragment_ends[contig->first].resize(windows);
-			coverage[contig->first].resize(windows);
+	windows.resize(contigs.size());
+	block_index.resize(contigs.size());
+	for (contigs_t::const_iterator contig = contigs.begin(); contig != contigs.end(); ++contig) {
+		assembly_t::const_iterator sequence = assembly.find(contig->second);
+		if (sequence != assembly.end() && !sequence->second.empty() &&
+		    (covered_contigs.empty() || is_interesting_contig(contig->first, covered_contigs))) {
+			windows[contig->second] = sequence->second.size() / resolution + 2; //+2 to avoid array-out-of-bounds errors
+			unsigned int blocks = (windows[contig->second] + COVERAGE_BLOCK_SIZE - 1) / COVERAGE_BLOCK_SIZE;
+			block_index[contig->second].resize((blocks + COVERAGE_PAGE_SIZE - 1) / COVERAGE_PAGE_SIZE);
 		}
 	}
 }
 
+// get the position of the block in <blocks> which holds the given window and allocate the block, if it does not exist yet
+unsigned int coverage_t::get_block_index(const contig_t contig, const unsigned int window) {
+	unsigned int block = window / COVERAGE_BLOCK_SIZE;
+	vector<unsigned int>& page = block_index[contig][block / COVERAGE_PAGE_SIZE];
+	if (page.empty())
+		page.resize(COVERAGE_PAGE_SIZE);
+	unsigned int& index = page[block % COVERAGE_PAGE_SIZE];
+	if (index == 0) {
+		blocks.push_back(coverage_block_t()); // value-initialization zeroes all counters
+		index = blocks.size();
+	}
+	return index - 1;
+}
+
+// increase the coverage of all windows from <first_window> to <last_window> by one
+// only the changes at the boundaries are recorded, the coverage is computed later by finalize()
+void coverage_t::add_coverage(const contig_t contig, const unsigned int first_window, unsigned int last_window) {
+	if (last_window >= windows[contig])
+		last_window = windows[contig] - 1;
+	if (first_window > last_window)
+		return;
+
+	// allocate all blocks spanned by the interval, such that finalize() need not allocate any
+	for (unsigned int block = first_window / COVERAGE_BLOCK_SIZE; block <= last_window / COVERAGE_BLOCK_SIZE; ++block)
+		get_block_index(contig, block * COVERAGE_BLOCK_SIZE);
+	unsigned int first_block = get_block_index(contig, first_window);
+	unsigned int next_block = (last_window + 1 < windows[contig]) ? get_block_index(contig, last_window + 1) : 0;
+	if (coverage_changes.size() < blocks.size())
+		coverage_changes.resize(blocks.size()); // value-initialization zeroes all changes
+
+	coverage_changes[first_block].change[first_window % COVERAGE_BLOCK_SIZE]++;
+	if (last_window + 1 < windows[contig])
+		coverage_changes[next_block].change[(last_window + 1) % COVERAGE_BLOCK_SIZE]--;
+}
+
+// get the block which holds the given window or NULL, if no read has fallen into the block
+const coverage_t::coverage_block_t* coverage_t::find_block(const contig_t contig, const unsigned int window) const {
+	if (contig >= windows.size() || window >= windows[contig])
+		return NULL;
+	unsigned int block = window / COVERAGE_BLOCK_SIZE;
+	const vector<unsigned int>& page = block_index[contig][block / COVERAGE_PAGE_SIZE];
+	if (page.empty())
+		return NULL;
+	unsigned int index = page[block % COVERAGE_PAGE_SIZE];
+	return (index == 0) ? NULL : &blocks[index-1];
+}
+
 // add alignment to coverage
-void coverage_t::add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric) {
+// only windows in the region from <region_start> to <region_end> (exclusive) are considered,
+// such that a fragment which overlaps several (disjoint) regions is not counted redundantly
+void coverage_t::add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric, const position_t region_start, const position_t region_end) {
+
+	// a paired-end read whose mate was not passed (e.g., because it lies outside the region)
+	// must not mark the end of the fragment that is defined by the missing mate
+	bool is_lone_mate = mate2 == NULL && (mate1->core.flag & BAM_FPAIRED);
 
 	// fake paired-end data, if single-end data given, to avoid NULL pointer exceptions
 	if (mate2 == NULL)
 		mate2 = mate1;
 
-	if ((unsigned int) mate1->core.tid >= fragment_starts.size() || fragment_starts[mate1->core.tid].empty() ||
-	    (unsigned int) mate2->core.tid >= fragment_starts.size() || fragment_starts[mate2->core.tid].empty())
+	if ((unsigned int) mate1->core.tid >= windows.size() || windows[mate1->core.tid] == 0 ||
+	    (unsigned int) mate2->core.tid >= windows.size() || windows[mate2->core.tid] == 0)
 		return; // ignore reads on uninteresting contigs
 
 	if (mate1->core.flag & BAM_FPAIRED) { // paired-end data
@@ -181,19 +239,22 @@ void coverage_t::add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric) {
 			is_chimeric = true; // alignment is clipped => likely split-read
 	}
 
+	unsigned int first_region_window = region_start/resolution;
+	unsigned int last_region_window = (region_end-1)/resolution;
+
 	// store start of fragment
-	if (!is_chimeric) { // the 'no_coverage' filter should only consider non-chimeric reads
-		if (!(mate1->core.flag & BAM_FREVERSE) || !(mate1->core.flag & BAM_FPAIRED))
-			fragment_starts[mate1->core.tid][mate1->core.pos/COVERAGE_RESOLUTION] = true;
-		else
-			fragment_starts[mate2->core.tid][mate2->core.pos/COVERAGE_RESOLUTION] = true;
+	if (!is_chimeric && !(is_lone_mate && (mate1->core.flag & BAM_FREVERSE))) { // the 'no_coverage' filter should only consider non-chimeric reads
+		bam1_t* first_mate = (!(mate1->core.flag & BAM_FREVERSE) || !(mate1->core.flag & BAM_FPAIRED)) ? mate1 : mate2;
+		unsigned int window = first_mate->core.pos/resolution;
+		if (window >= first_region_window && window <= last_region_window)
+			get_block(first_mate->core.tid, window).fragment_starts |= ((uint64_t) 1) << (window % COVERAGE_BLOCK_SIZE);
 	}
 
 	// compute coverage from CIGAR string
 	position_t position1 = mate1->core.pos;
 	position_t position2 = mate2->core.pos;
 	position_t position = min(position1, position2);
-	int window = position/COVERAGE_RESOLUTION;
+	int window = position/resolution;
 	unsigned int i1 = 0;
 	unsigned int i2 = 0;
 	while (true) {
@@ -210,14 +271,14 @@ void coverage_t::add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric) {
 			op_length1 = (bam_cigar_type(bam_cigar_op(cigar_op1)) & 2/*consume reference*/) ? bam_cigar_oplen(cigar_op1) : 0;
 		} else { // CIGAR elements of mate1 completely processed
 			op_length1 = 0;
-			window = max(window, position2/COVERAGE_RESOLUTION);
+			window = max(window, position2/resolution);
 		}
 		if (i2 < mate2->core.n_cigar) {
 			cigar_op2 = bam_get_cigar(mate2)[i2];
 			op_length2 = (bam_cigar_type(bam_cigar_op(cigar_op2)) & 2/*consume reference*/) ? bam_cigar_oplen(cigar_op2) : 0;
 		} else { // CIGAR elements of mate2 completely processed
 			op_length2 = 0;
-			window = max(window, position1/COVERAGE_RESOLUTION);
+			window = max(window, position1/resolution);
 		}
 		// pick the mate whose next CIGAR element consumes the least amount of reference
 		contig_t contig;
@@ -244,35 +305,33 @@ void coverage_t::add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric) {
 
 		// increase coverage counter of windows that CIGAR element overlaps with
 		if (bam_cigar_type(bam_cigar_op(cigar_op)) & 1/*consume query*/) {
-			while (window <= position/COVERAGE_RESOLUTION) {
-				if (coverage[contig][window] < USHRT_MAX)
-					if (position - window * COVERAGE_RESOLUTION >= COVERAGE_RESOLUTION/2) // read must overlap at least half of the window
-						coverage[contig][window]++;
-				++window;
-			}
+			if (position >= (resolution+1)/2) // read must overlap at least half of the window
+				add_coverage(contig, max((unsigned int) window, first_region_window), min((unsigned int) (position - (resolution+1)/2) / resolution, last_region_window));
+			window = max(window, position/resolution + 1);
 		} else {
-			window = position/COVERAGE_RESOLUTION;
+			window = position/resolution;
 		}
 
 	}
 
 	// store end of fragment
-	if (!is_chimeric) { // the 'no_coverage' filter should only consider non-chimeric reads
-		if ((mate1->core.flag & BAM_FREVERSE) || !(mate1->core.flag & BAM_FPAIRED))
-			fragment_ends[mate1->core.tid][(position1-1)/COVERAGE_RESOLUTION] = true;
-		else
-			fragment_ends[mate2->core.tid][(position2-1)/COVERAGE_RESOLUTION] = true;
+	if (!is_chimeric && !(is_lone_mate && !(mate1->core.flag & BAM_FREVERSE))) { // the 'no_coverage' filter should only consider non-chimeric reads
+		bool mate1_is_last = (mate1->core.flag & BAM_FREVERSE) || !(mate1->core.flag & BAM_FPAIRED);
+		unsigned int window = ((mate1_is_last ? position1 : position2) - 1)/resolution;
+		if (window >= first_region_window && window <= last_region_window)
+			get_block((mate1_is_last ? mate1 : mate2)->core.tid, window).fragment_ends |= ((uint64_t) 1) << (window % COVERAGE_BLOCK_SIZE);
 	}
 }
 
 // returns true, if a fragment begins at the given position
 bool coverage_t::fragment_starts_here(const contig_t contig, const position_t start, const position_t end) const {
-	if ((unsigned int) contig >= fragment_starts.size())
+	if ((unsigned int) contig >= windows.size())
 		return false;
-	for (int window = start/COVERAGE_RESOLUTION + 1; window <= end/COVERAGE_RESOLUTION; ++window) {
-		if ((unsigned int) window >= fragment_starts[contig].size())
+	for (int window = start/resolution + 1; window <= end/resolution; ++window) {
+		if ((unsigned int) window >= windows[contig])
 			return false;
-		if (fragment_starts[contig][window])
+		const coverage_block_t* block = find_block(contig, window);
+		if (block != NULL && (block->fragment_starts >> (window % COVERAGE_BLOCK_SIZE) & 1))
 			return true;
 	}
 	return false;
@@ -280,28 +339,89 @@ bool coverage_t::fragment_starts_here(const contig_t contig, const position_t st
 
 // returns true, if a fragment ends at the given position
 bool coverage_t::fragment_ends_here(const contig_t contig, const position_t start, const position_t end) const {
-	if ((unsigned int) contig >= fragment_ends.size())
+	if ((unsigned int) contig >= windows.size())
 		return false;
-	for (int window = start/COVERAGE_RESOLUTION; window < end/COVERAGE_RESOLUTION; ++window) {
-		if ((unsigned int) window >= fragment_ends[contig].size())
+	for (int window = start/resolution; window < end/resolution; ++window) {
+		if ((unsigned int) window >= windows[contig])
 			return false;
-		if (fragment_ends[contig][window])
+		const coverage_block_t* block = find_block(contig, window);
+		if (block != NULL && (block->fragment_ends >> (window % COVERAGE_BLOCK_SIZE) & 1))
 			return true;
 	}
 	return false;
 }
 
-// get coverage within a window of <COVERAGE_RESOLUTION> upstream or downstream of given position
+// compute the coverage of all windows from the changes recorded by add_coverage()
+// the contigs <first_contig>, <first_contig> + <contig_step>, ... are processed, such that several threads can work in parallel
+void coverage_t::accumulate_coverage_changes(const contig_t first_contig, const unsigned int contig_step) {
+	for (unsigned int contig = first_contig; contig < block_index.size(); contig += contig_step) {
+		int running_coverage = 0; // prefix sum of coverage changes
+		for (auto page = block_index[contig].begin(); page != block_index[contig].end(); ++page) {
+			for (auto index = page->begin(); index != page->end(); ++index) {
+				if (*index == 0)
+					continue; // running coverage is zero in unallocated blocks, because add_coverage() allocates all blocks of an interval
+				coverage_block_t& block = blocks[*index - 1];
+				coverage_changes_t& changes = coverage_changes[*index - 1];
+				for (unsigned int window = 0; window < COVERAGE_BLOCK_SIZE; ++window) {
+					running_coverage += changes.change[window];
+					block.coverage[window] = min(block.coverage[window] + running_coverage, (int) USHRT_MAX); // saturate like a counter that stops at the maximum
+				}
+			}
+		}
+	}
+}
+
+// add the recorded changes to the coverage and release the memory occupied by the changes
+void coverage_t::finalize(const unsigned int threads) {
+	if (coverage_changes.empty())
+		return; // nothing to do
+	coverage_changes.resize(blocks.size());
+
+	vector<thread> workers;
+	for (unsigned int worker_id = 1; worker_id < threads; ++worker_id)
+		workers.push_back(start_thread(&coverage_t::accumulate_coverage_changes, this, worker_id, threads));
+	accumulate_coverage_changes(0, threads);
+	for (auto worker = workers.begin(); worker != workers.end(); ++worker)
+		worker->join();
+
+	deque<coverage_changes_t>().swap(coverage_changes);
+}
+
+// add the (finalized) coverage of another object computed at the same resolution, e.g., from a different thread
+void coverage_t::add(const coverage_t& other) {
+	for (contig_t contig = 0; contig < other.block_index.size() && contig < block_index.size(); ++contig) {
+		for (unsigned int page = 0; page < other.block_index[contig].size(); ++page) {
+			for (unsigned int block = 0; block < other.block_index[contig][page].size(); ++block) {
+				unsigned int other_index = other.block_index[contig][page][block];
+				if (other_index == 0)
+					continue; // block is empty
+				const coverage_block_t& other_block = other.blocks[other_index - 1];
+				coverage_block_t& this_block = get_block(contig, (page * COVERAGE_PAGE_SIZE + block) * COVERAGE_BLOCK_SIZE);
+				this_block.fragment_starts |= other_block.fragment_starts;
+				this_block.fragment_ends |= other_block.fragment_ends;
+				for (unsigned int window = 0; window < COVERAGE_BLOCK_SIZE; ++window)
+					this_block.coverage[window] = min(this_block.coverage[window] + other_block.coverage[window], (int) USHRT_MAX);
+			}
+		}
+	}
+}
+
+// get coverage of the given window; windows which no read has fallen into have zero coverage
+unsigned short int coverage_t::get_window_coverage(const contig_t contig, const unsigned int window) const {
+	const coverage_block_t* block = find_block(contig, window);
+	return (block == NULL) ? 0 : block->coverage[window % COVERAGE_BLOCK_SIZE];
+}
+
+// get coverage within a window of <resolution> upstream or downstream of given position
 int coverage_t::get_coverage(const contig_t contig, const position_t position, const direction_t direction) const {
-	if ((unsigned int) contig >= coverage.size() || coverage[contig].empty())
+	if ((unsigned int) contig >= windows.size() || windows[contig] == 0)
 		return -1;
 	if (direction == UPSTREAM) {
-		if (position < COVERAGE_RESOLUTION)
+		if (position < resolution)
 			return 0;
 		else
-			return coverage[contig][position/COVERAGE_RESOLUTION-1];
+			return get_window_coverage(contig, position/resolution-1);
 	} else { // direction == DOWNSTREAM
-		return coverage[contig][position/COVERAGE_RESOLUTION+1];
+		return get_window_coverage(contig, position/resolution+1);
 	}
 }
-
@@ -1,6 +1,9 @@
 #ifndef READ_STATS_H
 #define READ_STATS_H 1
 
+#include <climits>
+#include <deque>
+#include <string>
 #include <vector>
 #include "common.hpp"
 #include "annotation.hpp"
@@ -11,19 +14,50 @@ bool estimate_fragment_length(const chimeric_alignments_t& chimeric_alignments,
 
 strandedness_t detect_strandedness(const chimeric_alignments_t& chimeric_alignments, const gene_annotation_index_t& gene_annotation_index, const exon_annotation_index_t& exon_annotation_index);
 
-const int COVERAGE_RESOLUTION = 20; // at what resolution in bp to calculate the coverage
-// for each contig store for every window of <COVERAGE_RESOLUTION> bp whether a read starts/ends here
+const int DEFAULT_COVERAGE_RESOLUTION = 20; // at what resolution in bp to calculate the coverage, unless specified otherwise
+const unsigned int COVERAGE_BLOCK_SIZE = 64; // number of windows per block (must not exceed the number of bits of the bitmasks in coverage_block_t)
+const unsigned int COVERAGE_PAGE_SIZE = 256; // number of blocks per page of the block index
+// for each contig store for every window of <resolution> bp whether a read starts/ends here
 // this information is needed by the 'no_coverage' filter
+// windows are grouped into blocks, which are only allocated once a read falls into them,
+// such that no memory is spent on regions of the genome which are not transcribed;
+// likewise, the index of blocks is split into pages, which are only allocated when needed,
+// such that the index remains small even at base resolution
+// during ingestion, only changes of coverage at the boundaries of aligned segments are recorded;
+// the coverage is computed from these changes in one pass by finalize()
 class coverage_t {
 	public:
-		vector< vector<bool> > fragment_starts; // for each window, store if a fragment starts here
-		vector< vector<bool> > fragment_ends; // for each window, store if a fragment ends here
-		vector< vector<unsigned short int> > coverage; // for each window, store the coverage
+		coverage_t(const int resolution = DEFAULT_COVERAGE_RESOLUTION, const string& covered_contigs = ""): resolution(resolution), covered_contigs(covered_contigs) {};
 		void resize(const contigs_t& contigs, const assembly_t& assembly);
-		void add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric);
+		void add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric, const position_t region_start = 0, const position_t region_end = INT_MAX);
+		void finalize(const unsigned int threads = 1);
+		void add(const coverage_t& other);
 		bool fragment_starts_here(const contig_t contig, const position_t start, const position_t end) const;
 		bool fragment_ends_here(const contig_t contig, const position_t start, const position_t end) const;
 		int get_coverage(const contig_t contig, const position_t position, const direction_t direction) const;
+		int get_resolution() const { return resolution; };
+		unsigned int get_window_count(const contig_t contig) const { return (contig < windows.size()) ? windows[contig] : 0; };
+		unsigned short int get_window_coverage(const contig_t contig, const unsigned int window) const;
+	private:
+		struct coverage_block_t {
+			uint64_t fragment_starts; // for each window, store if a fragment starts here
+			uint64_t fragment_ends; // for each window, store if a fragment ends here
+			unsigned short int coverage[COVERAGE_BLOCK_SIZE]; // for each window, store the coverage
+		};
+		int resolution; // at what resolution in bp to calculate the coverage
+		string covered_contigs; // only compute coverage for these contigs (empty = all contigs)
+		vector<unsigned int> windows; // number of windows of each contig
+		vector< vector< vector<unsigned int> > > block_index; // for each contig and page, position of every block in <blocks> plus one (0 = block not allocated yet)
+		deque<coverage_block_t> blocks; // a deque is used, because references to blocks must remain valid when new blocks are appended
+		struct coverage_changes_t {
+			int change[COVERAGE_BLOCK_SIZE]; // for each window, difference in coverage to the previous window
+		};
+		deque<coverage_changes_t> coverage_changes; // changes of coverage which have not yet been added to <blocks>, same order as <blocks>
+		unsigned int get_block_index(const contig_t contig, const unsigned int window);
+		coverage_block_t& get_block(const contig_t contig, const unsigned int window) { return blocks[get_block_index(contig, window)]; };
+		void add_coverage(const contig_t contig, const unsigned int first_window, unsigned int last_window);
+		void accumulate_coverage_changes(const contig_t first_contig, const unsigned int contig_step);
+		const coverage_block_t* find_block(const contig_t contig, const unsigned int window) const;
 };
 
 #endif /* READ_STATS_H */
@@ -3,12 +3,20 @@
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include "common.hpp"
 #include "annotation.hpp"
+#include "filter_blacklisted_ranges.hpp"
 #include "read_stats.hpp"
 
 using namespace std;
 
-unsigned int recover_known_fusions(fusions_t& fusions, const string& known_fusions_file_path, const contigs_t& contigs, const unordered_map<string,gene_t>& genes, const coverage_t& coverage, const int max_mate_gap);
+// the known fusions file has the same format as the blacklist file => we can use the same code
+// known fusions are indexed by coordinate for efficient lookup
+typedef indexed_rules_t< pair<blacklist_item_t,blacklist_item_t> > known_fusions_t;
+
+void load_known_fusions(const string& known_fusions_file_path, const contigs_t& contigs, const unordered_map<string,gene_t>& genes, known_fusions_t& known_fusions);
+
+unsigned int recover_known_fusions(fusions_t& fusions, const known_fusions_t& known_fusions_by_coordinate, const coverage_t& coverage, const int max_mate_gap);
 
 #endif /* RECOVER_KNOWN_FUSIONS_H */
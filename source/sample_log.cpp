@@ -0,0 +1,16 @@
+#include <iostream>
+#include <mutex>
+#include <string>
+#include "sample_log.hpp"
+
+using namespace std;
+
+thread_local ostream* sample_log = NULL;
+
+// the worker threads of a sample share its log
+mutex sample_log_mutex;
+
+void print_warning(const string& message) {
+	lock_guard<mutex> lock(sample_log_mutex);
+	((sample_log == NULL) ? cerr : *sample_log) << "WARNING: " << message << endl;
+}
@@ -0,0 +1,26 @@
+#ifndef SAMPLE_LOG_H
+#define SAMPLE_LOG_H 1
+
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+// warnings are written to the log of the sample which the current thread processes, so that in batch mode
+// they end up in the log of the sample they belong to rather than interleaving with other samples on stderr
+// threads which do not process a sample of a batch (e.g., while loading the references) write to stderr
+extern thread_local ostream* sample_log;
+
+// print a warning to the log of the current sample or to stderr
+void print_warning(const string& message);
+
+// redirects the warnings of the current thread to the given log while in scope
+class sample_log_scope_t {
+	private:
+		ostream* previous_log;
+	public:
+		sample_log_scope_t(ostream& log): previous_log(sample_log) { sample_log = &log; }
+		~sample_log_scope_t() { sample_log = previous_log; }
+};
+
+#endif /* SAMPLE_LOG_H */
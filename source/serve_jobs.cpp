@@ -0,0 +1,202 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "options.hpp"
+#include "serve_jobs.hpp"
+
+using namespace std;
+
+struct job_t {
+	unsigned int number;
+	int connection; // socket to the client which submitted the job
+	string arguments;
+	time_t receive_deadline; // a client which has not sent the arguments by then is disconnected
+	pid_t pid;
+};
+
+const time_t RECEIVE_TIMEOUT = 10; // seconds
+
+enum receive_status_t { RECEIVE_INCOMPLETE, RECEIVE_COMPLETE, RECEIVE_FAILED };
+
+// read the part of the arguments of a job which the client has sent so far (the client sends them as a single line)
+// this must only be called when the connection is readable, such that it does not block the server
+receive_status_t receive_job_arguments(job_t& job) {
+	char buffer[4096];
+	const ssize_t bytes_read = read(job.connection, buffer, sizeof(buffer));
+	if (bytes_read < 0)
+		return (errno == EINTR || errno == EAGAIN) ? RECEIVE_INCOMPLETE : RECEIVE_FAILED;
+	if (bytes_read == 0) // the client closed the connection without sending a line break
+		return (job.arguments.empty()) ? RECEIVE_FAILED : RECEIVE_COMPLETE;
+	const char* end_of_line = (const char*) memchr(buffer, '\n', bytes_read);
+	job.arguments.append(buffer, (end_of_line == NULL) ? bytes_read : end_of_line - buffer);
+	return (end_of_line == NULL) ? RECEIVE_INCOMPLETE : RECEIVE_COMPLETE;
+}
+
+void write_to_connection(const int connection, const string& message) {
+	for (string::size_type bytes_written = 0; bytes_written < message.size();) {
+		ssize_t result = write(connection, message.data() + bytes_written, message.size() - bytes_written);
+		if (result <= 0)
+			return; // client has gone away
+		bytes_written += result;
+	}
+}
+
+void serve_jobs(const options_t& options, const function<void(const options_t&)>& run_job) {
+
+	// the server only uses a single thread, such that it is safe to fork
+	signal(SIGPIPE, SIG_IGN); // don't terminate when a client disconnects prematurely
+
+	// listen on Unix domain socket
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	crash(options.server_socket.size() >= sizeof(address.sun_path), "path to socket is too long: " + options.server_socket);
+	strcpy(address.sun_path, options.server_socket.c_str());
+	struct stat file_info;
+	if (stat(options.server_socket.c_str(), &file_info) == 0) {
+		crash(!S_ISSOCK(file_info.st_mode), "file exists and is not a socket: " + options.server_socket);
+		unlink(options.server_socket.c_str()); // remove stale socket of a previous server
+	}
+	const int server_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	crash(server_socket < 0, "failed to create socket: " + strerror(errno));
+	crash(bind(server_socket, (struct sockaddr*) &address, sizeof(address)) != 0, "failed to bind socket '" + options.server_socket + "': " + strerror(errno));
+	crash(listen(server_socket, SOMAXCONN) != 0, "failed to listen on socket '" + options.server_socket + "': " + strerror(errno));
+	cout << get_time_string() << " Listening for jobs on socket '" << options.server_socket << "'" << endl;
+
+	const unsigned long long int memory_quota = options.memory_quota * 1024*1024*1024;
+	unsigned int job_count = 0;
+	list<job_t> receiving_jobs; // clients which are still sending the arguments of their job
+	deque<job_t> queued_jobs;
+	list<job_t> running_jobs;
+	while (true) {
+
+		// report exit status of finished jobs to the clients
+		pid_t pid;
+		int status;
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			for (auto job = running_jobs.begin(); job != running_jobs.end(); ++job) {
+				if (job->pid == pid) {
+					const int exit_status = (WIFEXITED(status)) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+					write_to_connection(job->connection, get_time_string() + " Finished job (exit status=" + to_string(static_cast<long long int>(exit_status)) + ")\n");
+					close(job->connection);
+					cout << get_time_string() << " Finished job " << job->number << " (exit status=" << exit_status << ")" << endl;
+					running_jobs.erase(job);
+					break;
+				}
+			}
+		}
+
+		// start queued jobs, as long as the number of concurrent jobs and the memory quota permit
+		// a job is always started when no other job is running, or else a job might never be started
+		while (!queued_jobs.empty() && running_jobs.size() < options.batch_workers) {
+			if (!running_jobs.empty() && memory_quota > 0) {
+				// the memory which the jobs share with the server (i.e., the references) is counted only once as part of the server
+				unsigned long long int memory_usage = get_memory_usage(getpid());
+				for (auto job = running_jobs.begin(); job != running_jobs.end(); ++job)
+					memory_usage += get_private_memory_usage(job->pid);
+				if (memory_usage >= memory_quota)
+					break;
+			}
+
+			job_t job = queued_jobs.front();
+			queued_jobs.pop_front();
+			cout << get_time_string() << " Starting job " << job.number << " (" << job.arguments << ")" << endl << flush;
+			job.pid = fork();
+			if (job.pid == 0) { // child process
+
+				// the log of the job is sent to the client
+				// the connections of other jobs must be closed, or else their clients will not notice when their job finishes
+				close(server_socket);
+				for (auto other_job = receiving_jobs.begin(); other_job != receiving_jobs.end(); ++other_job)
+					close(other_job->connection);
+				for (auto other_job = queued_jobs.begin(); other_job != queued_jobs.end(); ++other_job)
+					close(other_job->connection);
+				for (auto other_job = running_jobs.begin(); other_job != running_jobs.end(); ++other_job)
+					close(other_job->connection);
+				dup2(job.connection, STDOUT_FILENO);
+				dup2(job.connection, STDERR_FILENO);
+				close(job.connection);
+				signal(SIGPIPE, SIG_DFL);
+
+				// errors in the arguments terminate only the child process
+				options_t job_options = parse_job_arguments(job.arguments, options);
+				run_job(job_options);
+				cout << flush;
+				exit(0);
+
+			} else if (job.pid < 0) {
+				cerr << "WARNING: failed to start job " << job.number << ": " << strerror(errno) << endl;
+				write_to_connection(job.connection, "ERROR: failed to start job: " + string(strerror(errno)) + "\n");
+				close(job.connection);
+			} else {
+				running_jobs.push_back(job);
+			}
+		}
+
+		// wait for new jobs and for the arguments of jobs which are being received
+		// the arguments are only read when they have arrived, so that a stalled client cannot block the server
+		// the timeout makes sure that finished jobs and the memory usage are checked regularly
+		vector<struct pollfd> connections;
+		struct pollfd server_socket_poll = { server_socket, POLLIN, 0 };
+		connections.push_back(server_socket_poll);
+		for (auto job = receiving_jobs.begin(); job != receiving_jobs.end(); ++job) {
+			struct pollfd connection_poll = { job->connection, POLLIN, 0 };
+			connections.push_back(connection_poll);
+		}
+		if (poll(&connections[0], connections.size(), 1000) < 0)
+			continue;
+
+		// read the arguments of jobs which have been received in part
+		// a job is queued, once its arguments have been received in full
+		const time_t now = time(NULL);
+		auto connection = connections.begin() + 1;
+		for (auto job = receiving_jobs.begin(); job != receiving_jobs.end(); ++connection) {
+			receive_status_t status = RECEIVE_INCOMPLETE;
+			if (connection->revents != 0)
+				status = receive_job_arguments(*job);
+			if (status == RECEIVE_INCOMPLETE && now > job->receive_deadline)
+				status = RECEIVE_FAILED;
+			if (status == RECEIVE_INCOMPLETE) {
+				++job;
+				continue;
+			}
+			if (status == RECEIVE_COMPLETE) {
+				job->number = ++job_count;
+				cout << get_time_string() << " Received job " << job->number << " (" << job->arguments << ")" << endl;
+				queued_jobs.push_back(*job);
+			} else {
+				close(job->connection);
+			}
+			job = receiving_jobs.erase(job);
+		}
+
+		// accept new connections
+		if (connections[0].revents & POLLIN) {
+			job_t job;
+			job.connection = accept(server_socket, NULL, NULL);
+			if (job.connection < 0)
+				continue;
+			job.number = 0;
+			job.receive_deadline = now + RECEIVE_TIMEOUT;
+			job.pid = 0;
+			receiving_jobs.push_back(job);
+		}
+	}
+}
@@ -0,0 +1,14 @@
+#ifndef SERVE_JOBS_H
+#define SERVE_JOBS_H 1
+
+#include <functional>
+#include <string>
+#include "options.hpp"
+
+using namespace std;
+
+// accept jobs over a Unix domain socket and run each job in a forked child process,
+// which shares the references loaded by the server via copy-on-write
+void serve_jobs(const options_t& options, const function<void(const options_t&)>& run_job);
+
+#endif /* SERVE_JOBS_H */
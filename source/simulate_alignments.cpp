@@ -0,0 +1,546 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "sam.h"
+#include "common.hpp"
+#include "annotation.hpp"
+#include "assembly.hpp"
+#include "options.hpp"
+
+using namespace std;
+
+// generator of synthetic alignments in the format of STAR for scale and stress testing of Arriba
+// reads are sampled from the transcripts of the given annotation, such that the breakpoints of
+// simulated fusions coincide with splice sites, just like in real data
+// the records are written unsorted, mates are adjacent
+
+struct simulation_options_t {
+	string assembly_file;
+	string gene_annotation_file;
+	string gtf_features;
+	string output_file;
+	unsigned int concordant_pairs;
+	unsigned int split_read_pairs;
+	unsigned int discordant_pairs;
+	unsigned int secondary_hit_pairs;
+	unsigned int random_fusions;
+	unsigned int hot_loci;
+	unsigned int partners_per_hot_locus;
+	unsigned int read_length;
+	unsigned int fragment_length;
+	unsigned int seed;
+};
+
+// a contiguous stretch of the spliced sequence of a transcript, i.e., a subset of its exons
+struct transcript_part_t {
+	contig_t contig;
+	strand_t strand;
+	vector< pair<position_t,position_t> > exons; // ascending genomic order, end is exclusive
+	unsigned int length; // sum of the length of all exons
+};
+
+// a simulated fusion transcript consists of the 5' part of one transcript and the 3' part of another
+struct simulated_fusion_t {
+	transcript_part_t five_prime;
+	transcript_part_t three_prime;
+};
+
+// a read segment which aligns to one transcript part
+struct simulated_segment_t {
+	const transcript_part_t* part;
+	bool reverse; // strand which the segment aligns to
+	position_t position;
+	vector<uint32_t> cigar; // aligned bases only, without clipping
+	string sequence; // in the orientation of the read
+};
+
+void get_default_simulation_options(simulation_options_t& options) {
+	options.gtf_features = DEFAULT_GTF_FEATURES;
+	options.concordant_pairs = 1000000;
+	options.split_read_pairs = 10000;
+	options.discordant_pairs = 10000;
+	options.secondary_hit_pairs = 1000;
+	options.random_fusions = 100;
+	options.hot_loci = 0;
+	options.partners_per_hot_locus = 50;
+	options.read_length = 100;
+	options.fragment_length = 250;
+	options.seed = 1;
+}
+
+void print_simulation_usage() {
+
+	simulation_options_t default_options;
+	get_default_simulation_options(default_options);
+
+	cout << endl
+	     << "Generator of synthetic alignments for testing Arriba" << endl
+	     << "----------------------------------------------------" << endl
+	     << "Version: " << ARRIBA_VERSION << endl << endl
+	     << "Writes a BAM file with reads sampled from the transcripts of the given annotation. " << endl
+	     << "The alignments mimic the output of STAR with chimeric alignments in WithinBAM mode. " << endl
+	     << "The numbers of concordant pairs, split reads, discordant mates, secondary alignments, " << endl
+	     << "fusions and fusion partners of hot loci are controllable, such that inputs of " << endl
+	     << "arbitrary size and composition can be generated for scale testing." << endl
+	     << endl
+	     << "Usage: simulate_alignments -a assembly.fa -g annotation.gtf -o simulated.bam [...]" << endl
+	     << endl
+	     << wrap_help("-a FILE", "FastA file with the genome sequence (assembly). "
+	                  "The file may be gzip-compressed.")
+	     << wrap_help("-g FILE", "GTF file with the gene annotation. "
+	                  "The file may be gzip-compressed.")
+	     << wrap_help("-G GTF_FEATURES", "Comma-/space-separated list of names of GTF features, "
+	                  "as accepted by Arriba. Default: " + default_options.gtf_features)
+	     << wrap_help("-o FILE", "Output file with simulated alignments in BAM format. "
+	                  "If the file name ends with .sam, the output is written in SAM format.")
+	     << wrap_help("-n COUNT", "Number of concordant mate pairs. "
+	                  "Default: " + to_string(static_cast<long long unsigned int>(default_options.concordant_pairs)))
+	     << wrap_help("-c COUNT", "Number of mate pairs, one of which is a split read spanning a fusion breakpoint. "
+	                  "Default: " + to_string(static_cast<long long unsigned int>(default_options.split_read_pairs)))
+	     << wrap_help("-d COUNT", "Number of discordant mate pairs, which flank a fusion breakpoint. "
+	                  "Default: " + to_string(static_cast<long long unsigned int>(default_options.discordant_pairs)))
+	     << wrap_help("-S COUNT", "Number of discordant mate pairs, which have a secondary alignment "
+	                  "at a second fusion (NH:i:2). Every alignment carries the sequence of the locus it "
+	                  "aligns to. So unlike real multi-mapping reads, the hits differ in sequence. "
+	                  "Default: " + to_string(static_cast<long long unsigned int>(default_options.secondary_hit_pairs)))
+	     << wrap_help("-f COUNT", "Number of fusions between random transcripts. "
+	                  "Default: " + to_string(static_cast<long long unsigned int>(default_options.random_fusions)))
+	     << wrap_help("-H COUNT", "Number of hot loci, i.e., transcripts which are fused to many partners, "
+	                  "like the immunoglobulin loci in lymphoma samples. "
+	                  "Default: " + to_string(static_cast<long long unsigned int>(default_options.hot_loci)))
+	     << wrap_help("-P COUNT", "Number of fusion partners of each hot locus. "
+	                  "Default: " + to_string(static_cast<long long unsigned int>(default_options.partners_per_hot_locus)))
+	     << wrap_help("-l LENGTH", "Read length. "
+	                  "Default: " + to_string(static_cast<long long unsigned int>(default_options.read_length)))
+	     << wrap_help("-F LENGTH", "Mean fragment length. "
+	                  "Default: " + to_string(static_cast<long long unsigned int>(default_options.fragment_length)))
+	     << wrap_help("-s SEED", "Seed of the random number generator. The same seed and the same "
+	                  "parameters yield the same output. "
+	                  "Default: " + to_string(static_cast<long long unsigned int>(default_options.seed)))
+	     << wrap_help("-h", "Print help and exit.")
+	     << "Questions or problems may be sent to: " << HELP_CONTACT << endl << endl;
+}
+
+simulation_options_t parse_simulation_arguments(int argc, char **argv) {
+	simulation_options_t options;
+	get_default_simulation_options(options);
+
+	// throw error when first argument is not prefixed with a dash
+	// for some reason getopt does not detect this error and simply skips the argument
+	crash(argc > 1 && (string(argv[1]).empty() || argv[1][0] != '-'), "cannot interpret the first argument: " + argv[1]);
+
+	// parse arguments
+	opterr = 0;
+	int c;
+	unordered_map<char,unsigned int> duplicate_arguments;
+	const string valid_arguments = "a:g:G:o:n:c:d:S:f:H:P:l:F:s:h";
+	while ((c = getopt(argc, argv, valid_arguments.c_str())) != -1) {
+
+		// throw error if the same argument is specified more than once
+		duplicate_arguments[c]++;
+		crash(duplicate_arguments[c] > 1, "option -" + ((char) c) + " specified too often");
+
+		switch (c) {
+			case 'a':
+				options.assembly_file = optarg;
+				crash(access(options.assembly_file.c_str(), R_OK), "file not found/readable: " + options.assembly_file);
+				break;
+			case 'g':
+				options.gene_annotation_file = optarg;
+				crash(access(options.gene_annotation_file.c_str(), R_OK), "file not found/readable: " + options.gene_annotation_file);
+				break;
+			case 'G':
+				options.gtf_features = optarg;
+				break;
+			case 'o':
+				options.output_file = optarg;
+				crash(!output_directory_exists(options.output_file), "parent directory of output file '" + options.output_file + "' does not exist");
+				break;
+			case 'n':
+				crash(!validate_int(optarg, options.concordant_pairs), "invalid argument to -" + ((char) c));
+				break;
+			case 'c':
+				crash(!validate_int(optarg, options.split_read_pairs), "invalid argument to -" + ((char) c));
+				break;
+			case 'd':
+				crash(!validate_int(optarg, options.discordant_pairs), "invalid argument to -" + ((char) c));
+				break;
+			case 'S':
+				crash(!validate_int(optarg, options.secondary_hit_pairs), "invalid argument to -" + ((char) c));
+				break;
+			case 'f':
+				crash(!validate_int(optarg, options.random_fusions), "invalid argument to -" + ((char) c));
+				break;
+			case 'H':
+				crash(!validate_int(optarg, options.hot_loci), "invalid argument to -" + ((char) c));
+				break;
+			case 'P':
+				crash(!validate_int(optarg, options.partners_per_hot_locus, 1), "invalid argument to -" + ((char) c));
+				break;
+			case 'l':
+				crash(!validate_int(optarg, options.read_length, 20, 10000), "invalid argument to -" + ((char) c));
+				break;
+			case 'F':
+				crash(!validate_int(optarg, options.fragment_length, 20, 100000), "invalid argument to -" + ((char) c));
+				break;
+			case 's':
+				crash(!validate_int(optarg, options.seed), "invalid argument to -" + ((char) c));
+				break;
+			case 'h':
+				print_simulation_usage();
+				exit(0);
+				break;
+			default:
+				crash(valid_arguments.find(string(1, (char) optopt) + ":") != string::npos, "option -" + ((char) optopt) + " requires an argument");
+				crash(true, "unknown option: -" + ((char) optopt));
+				break;
+		}
+
+		crash(optind < argc && (string(argv[optind]).empty() || argv[optind][0] != '-'), "option -" + ((char) c) + " has too many arguments (arguments with blanks must be wrapped in quotes)");
+	}
+
+	// check for mandatory arguments
+	if (argc == 1) {
+		print_simulation_usage();
+		exit(1);
+	}
+	crash(options.assembly_file.empty(), "missing mandatory option -a");
+	crash(options.gene_annotation_file.empty(), "missing mandatory option -g");
+	crash(options.output_file.empty(), "missing mandatory option -o");
+	crash(options.fragment_length < options.read_length, "fragment length (-F) must not be shorter than read length (-l)");
+	crash((options.split_read_pairs > 0 || options.discordant_pairs > 0 || options.secondary_hit_pairs > 0) && options.random_fusions == 0 && options.hot_loci == 0, "chimeric reads require fusions (-f or -H)");
+
+	return options;
+}
+
+// extract the exons of the given transcript part, which are transcribed before (5' part) or after (3' part) the given exon
+transcript_part_t make_transcript_part(const transcript_part_t& transcript, const unsigned int exon_count, const bool five_prime) {
+	transcript_part_t part;
+	part.contig = transcript.contig;
+	part.strand = transcript.strand;
+	part.length = 0;
+	// exons are stored in genomic order, but the 5' end of a transcript on the reverse strand is the last exon
+	const bool take_first_exons = (transcript.strand == FORWARD) == five_prime;
+	for (unsigned int i = 0; i < transcript.exons.size(); ++i) {
+		if (take_first_exons && i < exon_count || !take_first_exons && i >= transcript.exons.size() - exon_count) {
+			part.exons.push_back(transcript.exons[i]);
+			part.length += transcript.exons[i].second - transcript.exons[i].first;
+		}
+	}
+	return part;
+}
+
+// pick a random number of exons, such that the part is long enough to accommodate the given length
+transcript_part_t make_random_transcript_part(mt19937& random, const transcript_part_t& transcript, const unsigned int min_length, const bool five_prime) {
+	for (unsigned int exon_count = 1 + random() % transcript.exons.size(); ; ++exon_count) {
+		transcript_part_t part = make_transcript_part(transcript, exon_count, five_prime);
+		if (part.length >= min_length)
+			return part;
+	}
+}
+
+// convert the interval [start, end) of the transcribed sequence of a transcript part to a genomic alignment
+void align_segment(const assembly_t& assembly, const transcript_part_t& part, const unsigned int start, const unsigned int end, const bool reverse_read, simulated_segment_t& segment) {
+	segment.part = &part;
+	segment.reverse = reverse_read != (part.strand == REVERSE);
+	segment.cigar.clear();
+	segment.sequence.clear();
+
+	// transcribed coordinates run against the genome on the reverse strand
+	const unsigned int genomic_start = (part.strand == FORWARD) ? start : part.length - end;
+	const unsigned int genomic_end = (part.strand == FORWARD) ? end : part.length - start;
+
+	const contig_sequence_t& contig_sequence = assembly.at(part.contig);
+	unsigned int offset = 0;
+	position_t previous_exon_end = -1;
+	for (auto exon = part.exons.begin(); exon != part.exons.end(); ++exon) {
+		const unsigned int exon_length = exon->second - exon->first;
+		if (genomic_start < offset + exon_length && genomic_end > offset) {
+			const position_t aligned_start = exon->first + max(genomic_start, offset) - offset;
+			const position_t aligned_end = exon->first + min(genomic_end, offset + exon_length) - offset;
+			if (segment.cigar.empty())
+				segment.position = aligned_start;
+			else
+				segment.cigar.push_back(bam_cigar_gen(aligned_start - previous_exon_end, BAM_CREF_SKIP));
+			segment.cigar.push_back(bam_cigar_gen(aligned_end - aligned_start, BAM_CMATCH));
+			segment.sequence += contig_sequence.substr(aligned_start, aligned_end - aligned_start);
+			previous_exon_end = aligned_end;
+		}
+		offset += exon_length;
+	}
+
+	// the sequence is given in the orientation of the read
+	if (segment.reverse)
+		segment.sequence = dna_to_reverse_complement(segment.sequence);
+}
+
+string cigar_to_string(const vector<uint32_t>& cigar) {
+	string result;
+	for (auto operation = cigar.begin(); operation != cigar.end(); ++operation)
+		result += to_string(static_cast<long long unsigned int>(bam_cigar_oplen(*operation))) + bam_cigar_opchr(*operation);
+	return result;
+}
+
+// add the given number of clipped bases to the CIGAR string of a segment
+// the clipped bases are given in the orientation of the read, but the CIGAR string is in the orientation of the reference
+vector<uint32_t> clip_segment(const simulated_segment_t& segment, unsigned int clipped_before, unsigned int clipped_after, const uint32_t clip_operation) {
+	if (segment.reverse)
+		swap(clipped_before, clipped_after);
+	vector<uint32_t> cigar;
+	if (clipped_before > 0)
+		cigar.push_back(bam_cigar_gen(clipped_before, clip_operation));
+	cigar.insert(cigar.end(), segment.cigar.begin(), segment.cigar.end());
+	if (clipped_after > 0)
+		cigar.push_back(bam_cigar_gen(clipped_after, clip_operation));
+	return cigar;
+}
+
+class alignment_writer_t {
+	private:
+		samFile* output_file;
+		sam_hdr_t* header;
+		unordered_map<contig_t,int> tids;
+		vector<string> contig_names;
+		bam1_t* bam_record;
+	public:
+		alignment_writer_t(const string& output_file_path, const assembly_t& assembly, const vector<string>& original_contig_names);
+		~alignment_writer_t();
+		string make_sa_tag(const simulated_segment_t& segment, const vector<uint32_t>& cigar) const;
+		void write(const string& read_name, const uint16_t flag, const simulated_segment_t& segment, const vector<uint32_t>& cigar, const string& read_sequence,
+		           const simulated_segment_t& mate, const unsigned int hit_index, const unsigned int hit_count, const string& sa_tag);
+		void write(const string& read_name, const uint16_t flag, const simulated_segment_t& segment, const simulated_segment_t& mate, const unsigned int hit_index = 1, const unsigned int hit_count = 1) {
+			write(read_name, flag, segment, segment.cigar, segment.sequence, mate, hit_index, hit_count, "");
+		};
+};
+
+alignment_writer_t::alignment_writer_t(const string& output_file_path, const assembly_t& assembly, const vector<string>& original_contig_names) {
+	const bool is_sam = output_file_path.size() >= 4 && output_file_path.substr(output_file_path.size() - 4) == ".sam";
+	output_file = sam_open(output_file_path.c_str(), is_sam ? "w" : "wb");
+	crash(output_file == NULL, "failed to open '" + output_file_path + "'");
+
+	// list the contigs in the same order as in the assembly
+	string header_text = "@HD\tVN:1.4\tSO:unsorted\n";
+	for (contig_t contig = 0; contig < original_contig_names.size(); ++contig) {
+		auto contig_sequence = assembly.find(contig);
+		if (contig_sequence != assembly.end()) {
+			tids[contig] = contig_names.size();
+			contig_names.push_back(original_contig_names[contig]);
+			header_text += "@SQ\tSN:" + original_contig_names[contig] + "\tLN:" + to_string(static_cast<long long unsigned int>(contig_sequence->second.size())) + "\n";
+		}
+	}
+	header_text += "@PG\tID:simulate_alignments\tPN:simulate_alignments\tVN:" + ARRIBA_VERSION + "\n";
+	header = sam_hdr_parse(header_text.size(), header_text.c_str());
+	crash(header == NULL, "failed to create header of '" + output_file_path + "'");
+	crash(sam_hdr_write(output_file, header) < 0, "failed to write header to '" + output_file_path + "'");
+
+	bam_record = bam_init1();
+	crash(bam_record == NULL, "failed to allocate memory");
+}
+
+alignment_writer_t::~alignment_writer_t() {
+	bam_destroy1(bam_record);
+	sam_hdr_destroy(header);
+	crash(sam_close(output_file) < 0, "failed to close output file");
+}
+
+string alignment_writer_t::make_sa_tag(const simulated_segment_t& segment, const vector<uint32_t>& cigar) const {
+	return contig_names[tids.at(segment.part->contig)] + "," + to_string(static_cast<long long int>(segment.position + 1)) + "," +
+	       (segment.reverse ? "-" : "+") + "," + cigar_to_string(cigar) + ",255,0;";
+}
+
+// write a BAM record for the given segment
+// the read sequence is given in the orientation of the read, the CIGAR string must include clipped bases
+void alignment_writer_t::write(const string& read_name, const uint16_t flag, const simulated_segment_t& segment, const vector<uint32_t>& cigar, const string& read_sequence,
+                               const simulated_segment_t& mate, const unsigned int hit_index, const unsigned int hit_count, const string& sa_tag) {
+
+	// BAM records store the sequence in the orientation of the reference
+	const string sequence = (segment.reverse) ? dna_to_reverse_complement(read_sequence) : read_sequence;
+
+	// the insert size is positive for the leftmost mate and negative for the rightmost
+	hts_pos_t insert_size = 0;
+	if (segment.part->contig == mate.part->contig) {
+		const hts_pos_t end = segment.position + bam_cigar2rlen(segment.cigar.size(), &segment.cigar[0]);
+		const hts_pos_t mate_end = mate.position + bam_cigar2rlen(mate.cigar.size(), &mate.cigar[0]);
+		insert_size = max(end, mate_end) - min(segment.position, mate.position);
+		if (segment.position > mate.position || segment.position == mate.position && (flag & BAM_FREAD2))
+			insert_size = -insert_size;
+	}
+
+	crash(bam_set1(bam_record, read_name.size(), read_name.c_str(),
+	               flag | BAM_FPAIRED | ((segment.reverse) ? BAM_FREVERSE : 0) | ((mate.reverse) ? BAM_FMREVERSE : 0) | ((hit_index > 1) ? BAM_FSECONDARY : 0),
+	               tids.at(segment.part->contig), segment.position, (hit_count == 1) ? 255 : 3, cigar.size(), &cigar[0],
+	               tids.at(mate.part->contig), mate.position, insert_size,
+	               sequence.size(), sequence.c_str(), NULL, 16 + sa_tag.size()) < 0, "failed to create BAM record");
+
+	// add tags in the same way as STAR does
+	uint8_t tag_value = hit_count;
+	bam_aux_append(bam_record, "NH", 'C', 1, &tag_value);
+	tag_value = hit_index;
+	bam_aux_append(bam_record, "HI", 'C', 1, &tag_value);
+	if (!sa_tag.empty())
+		bam_aux_append(bam_record, "SA", 'Z', sa_tag.size() + 1, (const uint8_t*) sa_tag.c_str());
+
+	crash(sam_write1(output_file, header, bam_record) < 0, "failed to write BAM record");
+}
+
+// write a split read, which consists of the segments <first> and <second> (in the orientation of the read)
+// like STAR, the segment which is closer to the mate becomes the primary alignment and the other one the supplementary alignment
+void write_split_read(alignment_writer_t& writer, const string& read_name, const uint16_t flag, const simulated_segment_t& first, const simulated_segment_t& second, const simulated_segment_t& mate) {
+	const vector<uint32_t> primary_cigar = clip_segment(second, first.sequence.size(), 0, BAM_CSOFT_CLIP);
+	const vector<uint32_t> supplementary_cigar = clip_segment(first, 0, second.sequence.size(), BAM_CHARD_CLIP);
+	const string primary_sa_tag = writer.make_sa_tag(first, clip_segment(first, 0, second.sequence.size(), BAM_CSOFT_CLIP));
+	const string supplementary_sa_tag = writer.make_sa_tag(second, primary_cigar);
+	writer.write(read_name, flag, second, primary_cigar, first.sequence + second.sequence, mate, 1, 1, primary_sa_tag);
+	writer.write(read_name, flag | BAM_FSUPPLEMENTARY, first, supplementary_cigar, first.sequence, mate, 1, 1, supplementary_sa_tag);
+}
+
+int main(int argc, char **argv) {
+
+	simulation_options_t options = parse_simulation_arguments(argc, argv);
+	mt19937 random(options.seed);
+
+	// load reference data
+	contigs_t contigs;
+	vector<string> original_contig_names;
+	assembly_t assembly;
+	load_assembly(assembly, options.assembly_file, "", contigs, original_contig_names, "*");
+	gene_annotation_t gene_annotation;
+	transcript_annotation_t transcript_annotation;
+	exon_annotation_t exon_annotation;
+	unordered_map<string,gene_t> gene_names;
+	read_annotation_gtf(options.gene_annotation_file, options.gtf_features, contigs, original_contig_names, assembly, gene_annotation, transcript_annotation, exon_annotation, gene_names);
+
+	// collect transcripts which are long enough to sample fragments from
+	const unsigned int max_fragment_length = 2 * options.fragment_length;
+	vector<transcript_part_t> transcripts;
+	for (auto transcript = transcript_annotation.begin(); transcript != transcript_annotation.end(); ++transcript) {
+		if (transcript->first_exon == NULL)
+			continue;
+		auto contig_sequence = assembly.find(transcript->first_exon->contig);
+		if (contig_sequence == assembly.end())
+			continue;
+		transcript_part_t part;
+		part.contig = transcript->first_exon->contig;
+		part.strand = transcript->first_exon->strand;
+		part.length = 0;
+		for (exon_t exon = transcript->first_exon; exon != NULL; exon = exon->next_exon) {
+			if (exon->end >= (position_t) contig_sequence->second.size()) {
+				part.length = 0;
+				break;
+			}
+			part.exons.push_back(make_pair(exon->start, exon->end + 1));
+			part.length += exon->end + 1 - exon->start;
+		}
+		if (part.length >= max_fragment_length)
+			transcripts.push_back(part);
+	}
+	crash(transcripts.empty(), "no transcripts are long enough to simulate fragments of length " + to_string(static_cast<long long unsigned int>(max_fragment_length)));
+
+	// make fusions between hot loci and many partners as well as between random transcripts
+	// every part is long enough to accommodate a fragment, such that fragments spanning the breakpoint can be placed anywhere around it
+	vector<simulated_fusion_t> fusions;
+	for (unsigned int hot_locus = 0; hot_locus < options.hot_loci; ++hot_locus) {
+		const transcript_part_t& hot_transcript = transcripts[random() % transcripts.size()];
+		for (unsigned int partner = 0; partner < options.partners_per_hot_locus; ++partner) {
+			const transcript_part_t& partner_transcript = transcripts[random() % transcripts.size()];
+			const bool hot_locus_is_five_prime = random() % 2;
+			simulated_fusion_t fusion;
+			fusion.five_prime = make_random_transcript_part(random, (hot_locus_is_five_prime) ? hot_transcript : partner_transcript, max_fragment_length, true);
+			fusion.three_prime = make_random_transcript_part(random, (hot_locus_is_five_prime) ? partner_transcript : hot_transcript, max_fragment_length, false);
+			fusions.push_back(fusion);
+		}
+	}
+	for (unsigned int i = 0; i < options.random_fusions; ++i) {
+		simulated_fusion_t fusion;
+		fusion.five_prime = make_random_transcript_part(random, transcripts[random() % transcripts.size()], max_fragment_length, true);
+		fusion.three_prime = make_random_transcript_part(random, transcripts[random() % transcripts.size()], max_fragment_length, false);
+		fusions.push_back(fusion);
+	}
+
+	// shuffle the types of fragments, such that they are interleaved in the output
+	enum fragment_type_t { CONCORDANT, SPLIT_READ, DISCORDANT, SECONDARY_HITS };
+	vector<char> fragment_types;
+	fragment_types.insert(fragment_types.end(), options.concordant_pairs, CONCORDANT);
+	fragment_types.insert(fragment_types.end(), options.split_read_pairs, SPLIT_READ);
+	fragment_types.insert(fragment_types.end(), options.discordant_pairs, DISCORDANT);
+	fragment_types.insert(fragment_types.end(), options.secondary_hit_pairs, SECONDARY_HITS);
+	shuffle(fragment_types.begin(), fragment_types.end(), random);
+
+	alignment_writer_t writer(options.output_file, assembly, original_contig_names);
+	const unsigned int read_length = options.read_length;
+	const unsigned int min_anchor_length = read_length / 4;
+	normal_distribution<float> fragment_length_distribution(options.fragment_length, options.fragment_length / 5.0);
+	simulated_segment_t left_mate, right_mate, first, second;
+	for (unsigned int fragment = 0; fragment < fragment_types.size(); ++fragment) {
+
+		const string read_name = "read" + to_string(static_cast<long long unsigned int>(fragment + 1));
+		const float sampled_fragment_length = fragment_length_distribution(random);
+		unsigned int fragment_length = max((float) read_length, min((float) max_fragment_length, sampled_fragment_length));
+
+		// the left mate is on the transcribed strand, the right mate on the opposite strand
+		// either one of them is randomly chosen to be the first in pair
+		const bool left_mate_is_read1 = random() % 2;
+		const uint16_t left_flag = (left_mate_is_read1) ? BAM_FREAD1 : BAM_FREAD2;
+		const uint16_t right_flag = (left_mate_is_read1) ? BAM_FREAD2 : BAM_FREAD1;
+
+		if (fragment_types[fragment] == CONCORDANT) {
+
+			const transcript_part_t& transcript = transcripts[random() % transcripts.size()];
+			const unsigned int start = random() % (transcript.length - fragment_length + 1);
+			align_segment(assembly, transcript, start, start + read_length, false, left_mate);
+			align_segment(assembly, transcript, start + fragment_length - read_length, start + fragment_length, true, right_mate);
+			writer.write(read_name, left_flag | BAM_FPROPER_PAIR, left_mate, right_mate);
+			writer.write(read_name, right_flag | BAM_FPROPER_PAIR, right_mate, left_mate);
+
+		} else if (fragment_types[fragment] == SPLIT_READ) {
+
+			const simulated_fusion_t& fusion = fusions[random() % fusions.size()];
+			const unsigned int breakpoint = fusion.five_prime.length;
+			const unsigned int split_read_start = breakpoint - read_length + min_anchor_length + random() % (read_length - 2 * min_anchor_length + 1);
+			if (random() % 2) { // left mate is split
+
+				fragment_length = max(fragment_length, breakpoint - split_read_start + read_length);
+				align_segment(assembly, fusion.five_prime, split_read_start, breakpoint, false, first);
+				align_segment(assembly, fusion.three_prime, 0, split_read_start + read_length - breakpoint, false, second);
+				align_segment(assembly, fusion.three_prime, split_read_start + fragment_length - read_length - breakpoint, split_read_start + fragment_length - breakpoint, true, right_mate);
+				write_split_read(writer, read_name, left_flag | BAM_FPROPER_PAIR, first, second, right_mate);
+				writer.write(read_name, right_flag | BAM_FPROPER_PAIR, right_mate, second);
+
+			} else { // right mate is split
+
+				fragment_length = max(fragment_length, split_read_start + 2 * read_length - breakpoint);
+				const unsigned int start = split_read_start + read_length - fragment_length;
+				align_segment(assembly, fusion.five_prime, start, start + read_length, false, left_mate);
+				align_segment(assembly, fusion.three_prime, 0, split_read_start + read_length - breakpoint, true, first);
+				align_segment(assembly, fusion.five_prime, split_read_start, breakpoint, true, second);
+				writer.write(read_name, left_flag | BAM_FPROPER_PAIR, left_mate, second);
+				write_split_read(writer, read_name, right_flag | BAM_FPROPER_PAIR, first, second, left_mate);
+			}
+
+		} else { // discordant mates
+
+			// mates with secondary hits are additionally aligned to a second fusion
+			// the assembly generally has no repeated sequences, so every hit carries the sequence of its own locus,
+			// such that all alignments match the reference, even though the hits of a read then differ in sequence
+			fragment_length = max(fragment_length, 2 * read_length);
+			const unsigned int hit_count = (fragment_types[fragment] == SECONDARY_HITS && fusions.size() > 1) ? 2 : 1;
+			const unsigned int fusion_index = random() % fusions.size();
+			for (unsigned int hit_index = 1; hit_index <= hit_count; ++hit_index) {
+				const simulated_fusion_t& fusion = fusions[(fusion_index + hit_index - 1) % fusions.size()];
+				const unsigned int breakpoint = fusion.five_prime.length;
+				const unsigned int start = breakpoint - read_length - random() % (fragment_length - 2 * read_length + 1);
+				align_segment(assembly, fusion.five_prime, start, start + read_length, false, left_mate);
+				align_segment(assembly, fusion.three_prime, start + fragment_length - read_length - breakpoint, start + fragment_length - breakpoint, true, right_mate);
+				writer.write(read_name, left_flag, left_mate, right_mate, hit_index, hit_count);
+				writer.write(read_name, right_flag, right_mate, left_mate, hit_index, hit_count);
+			}
+		}
+	}
+
+	return 0;
+}
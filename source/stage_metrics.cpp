@@ -0,0 +1,153 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "options.hpp"
+#include "stage_metrics.hpp"
+
+using namespace std;
+
+const unsigned int TOP_WORK_COUNT = 10; // number of genes and fusions listed by the operations they consumed
+
+// CPU time consumed by all threads of the process so far
+double get_cpu_seconds() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+stage_metrics_t::stage_metrics_t():
+	last_wall_time(chrono::steady_clock::now()),
+	last_cpu_seconds(get_cpu_seconds()),
+	last_rss(get_memory_usage(getpid())),
+	remaining_reads(-1),
+	remaining_fusions(-1) {
+	get_operation_counts(last_operations);
+}
+
+void stage_metrics_t::add_stage(const string& stage, const item_t items, const long long int remaining, const long long int removed) {
+	const chrono::steady_clock::time_point wall_time = chrono::steady_clock::now();
+	const double cpu_seconds = get_cpu_seconds();
+	const long long int rss = get_memory_usage(getpid());
+	operation_counts_t operations;
+	get_operation_counts(operations);
+	stage_t new_stage = { stage, chrono::duration<double>(wall_time - last_wall_time).count(), cpu_seconds - last_cpu_seconds, (rss - last_rss) / 1024.0 / 1024.0, items, remaining, removed, operations };
+	for (unsigned int operation = 0; operation < operations.size(); ++operation)
+		new_stage.operations[operation] -= last_operations[operation];
+	stages.push_back(new_stage);
+	last_wall_time = wall_time;
+	last_cpu_seconds = cpu_seconds;
+	last_rss = rss;
+	last_operations = operations;
+}
+
+void stage_metrics_t::record(const string& stage) {
+	add_stage(stage, NO_ITEMS, 0, 0);
+}
+
+unsigned int stage_metrics_t::record_reads(const string& stage, const unsigned int remaining) {
+	// the first step which counts reads is the one which reads them, so nothing is removed
+	add_stage(stage, READS, remaining, (remaining_reads < 0) ? 0 : remaining_reads - remaining);
+	remaining_reads = remaining;
+	return remaining;
+}
+
+unsigned int stage_metrics_t::record_fusions(const string& stage, const unsigned int remaining) {
+	// the first step which counts fusions is the one which finds them, so nothing is removed
+	add_stage(stage, FUSIONS, remaining, (remaining_fusions < 0) ? 0 : remaining_fusions - remaining);
+	remaining_fusions = remaining;
+	return remaining;
+}
+
+void write_operations(ostream& out, const operation_counts_t& operations) {
+	out << ", \"operations\": {";
+	for (unsigned int operation = 0; operation < operations.size(); ++operation)
+		out << ((operation == 0) ? " " : ", ") << "\"" << OPERATIONS[operation] << "\": " << operations[operation];
+	out << " }";
+}
+
+void write_work_ranking(ostream& out, const string& key, const work_ranking_t& ranking) {
+	for (auto item = ranking.begin(); item != ranking.end(); ++item)
+		out << ((item == ranking.begin()) ? "" : ",") << endl
+		    << "\t\t{ \"" << key << "\": \"" << item->first << "\", \"operations\": " << item->second << " }";
+	out << endl;
+}
+
+void stage_metrics_t::write_stages(ostream& out, bool& first_stage) const {
+	for (auto stage = stages.begin(); stage != stages.end(); ++stage) {
+		out << ((first_stage) ? "" : ",") << endl
+		    << "\t\t{ \"stage\": \"" << stage->name << "\""
+		    << ", \"wall_seconds\": " << stage->wall_seconds
+		    << ", \"cpu_seconds\": " << stage->cpu_seconds
+		    << ", \"rss_delta_mb\": " << stage->rss_delta_mb;
+		if (stage->items == READS)
+			out << ", \"reads_remaining\": " << stage->remaining << ", \"reads_removed\": " << stage->removed;
+		else if (stage->items == FUSIONS)
+			out << ", \"fusions_remaining\": " << stage->remaining << ", \"fusions_removed\": " << stage->removed;
+		if (!stage->operations.empty())
+			write_operations(out, stage->operations);
+		out << " }";
+		first_stage = false;
+	}
+}
+
+void stage_metrics_t::write_json(const string& output_file, const stage_metrics_t* loading_metrics) const {
+
+	// sum up the steps
+	double wall_seconds = 0;
+	double cpu_seconds = 0;
+	if (loading_metrics != NULL) {
+		for (auto stage = loading_metrics->stages.begin(); stage != loading_metrics->stages.end(); ++stage) {
+			wall_seconds += stage->wall_seconds;
+			cpu_seconds += stage->cpu_seconds;
+		}
+	}
+	for (auto stage = stages.begin(); stage != stages.end(); ++stage) {
+		wall_seconds += stage->wall_seconds;
+		cpu_seconds += stage->cpu_seconds;
+	}
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	#ifdef __APPLE__
+		const double peak_rss_mb = usage.ru_maxrss / 1024.0 / 1024.0;
+	#else
+		const double peak_rss_mb = usage.ru_maxrss / 1024.0;
+	#endif
+
+	ofstream out(output_file);
+	crash(!out.is_open(), "failed to open output file");
+	out << fixed << setprecision(3)
+	    << "{" << endl
+	    << "\t\"version\": \"" << ARRIBA_VERSION << "\"," << endl
+	    << "\t\"stages\": [";
+	bool first_stage = true;
+	if (loading_metrics != NULL)
+		loading_metrics->write_stages(out, first_stage);
+	write_stages(out, first_stage);
+	out << endl
+	    << "\t]," << endl
+	    << "\t\"total\": { \"wall_seconds\": " << wall_seconds << ", \"cpu_seconds\": " << cpu_seconds << ", \"peak_rss_mb\": " << peak_rss_mb;
+
+	// operation counters of the whole process and the genes/fusions which consumed the most work
+	operation_counts_t operations;
+	get_operation_counts(operations);
+	if (!operations.empty()) {
+		write_operations(out, operations);
+		out << ", \"align_max_depth\": " << get_max_align_depth() << " }," << endl;
+		work_ranking_t top_genes, top_fusions;
+		get_top_work(TOP_WORK_COUNT, top_genes, top_fusions);
+		out << "\t\"top_genes_by_operations\": [";
+		write_work_ranking(out, "gene", top_genes);
+		out << "\t]," << endl
+		    << "\t\"top_fusions_by_operations\": [";
+		write_work_ranking(out, "fusion", top_fusions);
+		out << "\t]" << endl;
+	} else {
+		out << " }" << endl;
+	}
+	out << "}" << endl;
+	crash(out.bad(), "failed to write to file");
+}
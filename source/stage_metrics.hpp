@@ -0,0 +1,48 @@
+#ifndef STAGE_METRICS_H
+#define STAGE_METRICS_H 1
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "operation_counters.hpp"
+
+using namespace std;
+
+// resource consumption of the steps of the pipeline and the number of reads and fusions removed by each step
+// a step spans the time since the previous step was recorded, such that the steps add up to the total runtime
+// CPU time and memory are measured for the whole process, i.e., they include all threads (and all samples processed concurrently)
+class stage_metrics_t {
+	public:
+		stage_metrics_t();
+		// record the end of a step which does not change the number of reads or fusions
+		void record(const string& stage);
+		// record the end of a step which filters reads or fusions
+		// the number of remaining reads/fusions is passed through, so that the call can wrap the filter in the log message
+		unsigned int record_reads(const string& stage, const unsigned int remaining_reads);
+		unsigned int record_fusions(const string& stage, const unsigned int remaining_fusions);
+		// write the metrics in JSON format, preceded by the metrics of loading the references (if given)
+		void write_json(const string& output_file, const stage_metrics_t* loading_metrics) const;
+	private:
+		enum item_t { NO_ITEMS, READS, FUSIONS };
+		struct stage_t {
+			string name;
+			double wall_seconds;
+			double cpu_seconds;
+			double rss_delta_mb;
+			item_t items;
+			long long int remaining;
+			long long int removed; // negative, when items are recovered
+			operation_counts_t operations; // empty, unless the operation counters are compiled in
+		};
+		vector<stage_t> stages;
+		chrono::steady_clock::time_point last_wall_time;
+		double last_cpu_seconds;
+		long long int last_rss;
+		operation_counts_t last_operations;
+		long long int remaining_reads;
+		long long int remaining_fusions;
+		void add_stage(const string& stage, const item_t items, const long long int remaining, const long long int removed);
+		void write_stages(ostream& out, bool& first_stage) const;
+};
+
+#endif /* STAGE_METRICS_H */
@@ -0,0 +1,134 @@
+#!/bin/bash
+
+# parse command-line arguments
+if [ $# -lt 4 -o $# -gt 5 ]; then
+	echo Usage: $(basename "$0") assembly.fa annotation.gtf golden_dir/ output_dir/ [STAR_genomeDir/]
+	echo
+	echo "Description: This script checks that a build of Arriba produces the same output as before and that it is not slower and does not consume more memory. It runs Arriba on stress inputs, which are generated with 'simulate_alignments' from the given assembly and annotation, and - if a STAR index is given - on the bundled test sample. The files fusions.tsv and fusions.discarded.tsv are compared byte by byte against the golden files in 'golden_dir/'. Each input is processed with every number of threads listed in THREADS, which must all yield identical output. The wall time and the peak memory consumption of every run are compared against the values recorded in 'golden_dir/resources.tsv'. The script fails, if any output differs or if a run takes longer than MAX_SLOWDOWN times the recorded wall time or consumes more than MAX_MEMORY_INCREASE times the recorded memory. Recorded wall times below MIN_SECONDS are too noisy to be compared and are ignored. Additional arguments can be passed to Arriba via ARRIBA_ARGS, e.g., blacklist, known fusions and protein domains. When 'golden_dir/' is empty, the output of the current build is recorded as the golden files."
+	echo "Note: The golden files depend on the given assembly and annotation. To check an upgrade, record the golden files with the old version first."
+	exit 1
+fi 1>&2
+ASSEMBLY_FA="$1"
+ANNOTATION_GTF="$2"
+GOLDEN_DIR="$3"
+OUTPUT_DIR="$4"
+STAR_INDEX_DIR="${5-}"
+THREADS="${THREADS-1 8}" # the output must be the same for every number of threads
+MAX_SLOWDOWN="${MAX_SLOWDOWN-1.25}" # fail when a run takes longer than this factor times the recorded wall time
+MAX_MEMORY_INCREASE="${MAX_MEMORY_INCREASE-1.25}" # fail when a run consumes more than this factor times the recorded memory
+MIN_SECONDS="${MIN_SECONDS-1}" # do not compare wall times below this threshold
+ARRIBA_ARGS="${ARRIBA_ARGS--f blacklist}" # additional arguments to Arriba, which are the same in every run
+
+# tell bash to abort on error
+set -e -u -o pipefail
+
+# find installation directory of arriba
+BASE_DIR=$(dirname "$0")/..
+ARRIBA="${ARRIBA-$BASE_DIR/arriba}"
+SIMULATE_ALIGNMENTS="${SIMULATE_ALIGNMENTS-$BASE_DIR/simulate_alignments}"
+
+mkdir -p "$GOLDEN_DIR" "$OUTPUT_DIR"
+if [ -e "$GOLDEN_DIR/resources.tsv" ]; then
+	RECORD_GOLDEN_FILES=false
+else
+	RECORD_GOLDEN_FILES=true
+	echo -e "input\tthreads\tseconds\tpeak_memory_mb" > "$GOLDEN_DIR/resources.tsv"
+fi
+
+# generate stress inputs with a fixed seed, such that they are the same in every run
+# - many concordant mates with few fusions, as in typical samples
+# - many chimeric reads, as in samples with a high level of chimeric artifacts
+# - a few hot loci fused to hundreds of partners, as in lymphoma samples
+INPUTS=""
+simulate() {
+	local NAME="$1"; shift
+	if [ ! -e "$OUTPUT_DIR/$NAME.bam" ]; then
+		"$SIMULATE_ALIGNMENTS" -a "$ASSEMBLY_FA" -g "$ANNOTATION_GTF" -o "$OUTPUT_DIR/$NAME.bam" -s 1 "$@"
+	fi
+	INPUTS="$INPUTS $NAME"
+}
+simulate concordant -n 2000000 -c 5000 -d 5000 -S 500 -f 50
+simulate chimeric -n 1000000 -c 500000 -d 500000 -S 50000 -f 5000
+simulate hot_loci -n 1000000 -c 100000 -d 100000 -S 10000 -f 50 -H 5 -P 500
+
+# align the bundled test sample, if a STAR index is given
+# (the parameters are the same as in run_arriba.sh)
+if [ -n "$STAR_INDEX_DIR" ]; then
+	if [ ! -e "$OUTPUT_DIR/test_sample.bam" ]; then
+		STAR \
+			--runThreadN 8 \
+			--genomeDir "$STAR_INDEX_DIR" --genomeLoad NoSharedMemory \
+			--readFilesIn "$BASE_DIR/test/read1.fastq.gz" "$BASE_DIR/test/read2.fastq.gz" --readFilesCommand zcat \
+			--outStd BAM_Unsorted --outSAMtype BAM Unsorted --outSAMunmapped Within --outBAMcompression 0 \
+			--outFilterMultimapNmax 50 --peOverlapNbasesMin 10 --alignSplicedMateMapLminOverLmate 0.5 --alignSJstitchMismatchNmax 5 -1 5 5 \
+			--chimSegmentMin 10 --chimOutType WithinBAM HardClip --chimJunctionOverhangMin 10 --chimScoreDropMax 30 --chimScoreJunctionNonGTAG 0 --chimScoreSeparation 1 --chimSegmentReadGapMax 3 --chimMultimapNmax 50 \
+			--outFileNamePrefix "$OUTPUT_DIR/" > "$OUTPUT_DIR/test_sample.bam"
+	fi
+	INPUTS="$INPUTS test_sample"
+fi
+
+# run Arriba on every input with every number of threads
+FAILED=false
+for INPUT in $INPUTS; do
+	for THREAD_COUNT in $THREADS; do
+		RUN="$INPUT.threads$THREAD_COUNT"
+		mkdir -p "$OUTPUT_DIR/$RUN"
+
+		START=$(date +%s.%N)
+		"$ARRIBA" \
+			-x "$OUTPUT_DIR/$INPUT.bam" \
+			-o "$OUTPUT_DIR/$RUN/fusions.tsv" -O "$OUTPUT_DIR/$RUN/fusions.discarded.tsv" \
+			-a "$ASSEMBLY_FA" -g "$ANNOTATION_GTF" -j "$THREAD_COUNT" $ARRIBA_ARGS \
+			> "$OUTPUT_DIR/$RUN/log.txt" 2>&1
+		END=$(date +%s.%N)
+
+		# Arriba reports its peak memory consumption in GB at the end of the log
+		SECONDS_ELAPSED=$(awk -v start="$START" -v end="$END" 'BEGIN{printf "%.2f", end-start}')
+		PEAK_MEMORY_MB=$(sed -n -e 's/.*peak memory=\([0-9.e+-]*\)gb.*/\1/p' "$OUTPUT_DIR/$RUN/log.txt" | awk '{printf "%.1f", $1*1024}')
+
+		if $RECORD_GOLDEN_FILES; then
+			mkdir -p "$GOLDEN_DIR/$INPUT"
+			# the golden files are recorded with the first number of threads, the others must match them
+			if [ ! -e "$GOLDEN_DIR/$INPUT/fusions.tsv" ]; then
+				cp "$OUTPUT_DIR/$RUN/fusions.tsv" "$OUTPUT_DIR/$RUN/fusions.discarded.tsv" "$GOLDEN_DIR/$INPUT/"
+			fi
+			echo -e "$INPUT\t$THREAD_COUNT\t$SECONDS_ELAPSED\t$PEAK_MEMORY_MB" >> "$GOLDEN_DIR/resources.tsv"
+		fi
+
+		# compare output against golden files
+		STATUS=""
+		for OUTPUT_FILE in fusions.tsv fusions.discarded.tsv; do
+			if ! cmp -s "$GOLDEN_DIR/$INPUT/$OUTPUT_FILE" "$OUTPUT_DIR/$RUN/$OUTPUT_FILE"; then
+				STATUS="$STATUS, $OUTPUT_FILE differs"
+				FAILED=true
+			fi
+		done
+
+		# compare resource consumption against recorded values
+		RECORDED=$(awk -F '\t' -v input="$INPUT" -v threads="$THREAD_COUNT" '$1==input && $2==threads{print $3"\t"$4}' "$GOLDEN_DIR/resources.tsv" | head -n 1)
+		if [ -n "$RECORDED" ]; then
+			RECORDED_SECONDS=$(cut -f1 <<<"$RECORDED")
+			RECORDED_MEMORY_MB=$(cut -f2 <<<"$RECORDED")
+			if awk -v now="$SECONDS_ELAPSED" -v before="$RECORDED_SECONDS" -v max="$MAX_SLOWDOWN" -v min="$MIN_SECONDS" 'BEGIN{exit !(before >= min && now > before*max)}'; then
+				STATUS="$STATUS, slower than ${MAX_SLOWDOWN}x ${RECORDED_SECONDS}s"
+				FAILED=true
+			fi
+			if awk -v now="$PEAK_MEMORY_MB" -v before="$RECORDED_MEMORY_MB" -v max="$MAX_MEMORY_INCREASE" 'BEGIN{exit !(now > before*max)}'; then
+				STATUS="$STATUS, more memory than ${MAX_MEMORY_INCREASE}x ${RECORDED_MEMORY_MB}MB"
+				FAILED=true
+			fi
+		else
+			STATUS="$STATUS, no recorded resource consumption"
+		fi
+
+		echo -e "$INPUT\tthreads=$THREAD_COUNT\ttime=${SECONDS_ELAPSED}s\tpeak_memory=${PEAK_MEMORY_MB}MB\t${STATUS:-, ok}" | sed -e 's/\t, /\t/'
+	done
+done
+
+if $RECORD_GOLDEN_FILES; then
+	echo "Recorded golden files in '$GOLDEN_DIR'"
+fi
+if $FAILED; then
+	echo "Performance test failed" 1>&2
+	exit 1
+fi